@@ -0,0 +1,75 @@
+#include "pch.h"
+#include "aabb.h"
+#include "mymath.h"
+#include "utils.h"
+
+void AABB::merge( const Vector3 & p )
+{
+	lower = Vector3( min( lower.x, p.x ), min( lower.y, p.y ), min( lower.z, p.z ) );
+	upper = Vector3( max( upper.x, p.x ), max( upper.y, p.y ), max( upper.z, p.z ) );
+}
+
+void AABB::merge( const AABB & b )
+{
+	lower = Vector3( min( lower.x, b.lower.x ), min( lower.y, b.lower.y ), min( lower.z, b.lower.z ) );
+	upper = Vector3( max( upper.x, b.upper.x ), max( upper.y, b.upper.y ), max( upper.z, b.upper.z ) );
+}
+
+AABB AABB::intersection( const AABB & b ) const
+{
+	return AABB( Vector3( max( lower.x, b.lower.x ), max( lower.y, b.lower.y ), max( lower.z, b.lower.z ) ),
+		Vector3( min( upper.x, b.upper.x ), min( upper.y, b.upper.y ), min( upper.z, b.upper.z ) ) );
+}
+
+Vector3 AABB::centroid() const
+{
+	return ( lower + upper ) * 0.5f;
+}
+
+Vector3 AABB::extent() const
+{
+	return upper - lower;
+}
+
+float AABB::area() const
+{
+	if ( is_empty() ) return 0.0f;
+
+	const Vector3 d = extent();
+
+	return 2.0f * ( d.x * d.y + d.y * d.z + d.z * d.x );
+}
+
+int AABB::longest_axis() const
+{
+	const Vector3 d = extent();
+
+	if ( d.x >= d.y && d.x >= d.z ) return 0;
+	if ( d.y >= d.z ) return 1;
+
+	return 2;
+}
+
+bool AABB::is_empty() const
+{
+	return ( lower.x > upper.x ) || ( lower.y > upper.y ) || ( lower.z > upper.z );
+}
+
+bool AABB::intersect( const Vector3 & origin, const Vector3 & inv_direction, float & t0, float & t1 ) const
+{
+	for ( int i = 0; i < 3; ++i )
+	{
+		float t_near = ( lower.data[i] - origin.data[i] ) * inv_direction.data[i];
+		float t_far = ( upper.data[i] - origin.data[i] ) * inv_direction.data[i];
+
+		if ( t_near > t_far ) utils::swap( t_near, t_far );
+
+		// NaNs from 0 * inf fall through both comparisons and keep the interval untouched
+		t0 = ( t_near > t0 ) ? t_near : t0;
+		t1 = ( t_far < t1 ) ? t_far : t1;
+
+		if ( t0 > t1 ) return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef AABB_H_
+#define AABB_H_
+
+#include <float.h>
+#include "vector3.h"
+
+/*! \struct AABB
+\brief Axis-aligned bounding box.
+
+An empty box is represented by inverted bounds so that the first merged point
+or box becomes the new extent.
+*/
+struct AABB
+{
+	Vector3 lower{ FLT_MAX, FLT_MAX, FLT_MAX }; /*!< Minimal corner of the box. */
+	Vector3 upper{ -FLT_MAX, -FLT_MAX, -FLT_MAX }; /*!< Maximal corner of the box. */
+
+	AABB() { }
+	AABB( const Vector3 & lower, const Vector3 & upper ) : lower( lower ), upper( upper ) { }
+
+	/* enlarge the box to contain the point p */
+	void merge( const Vector3 & p );
+
+	/* enlarge the box to contain the box b */
+	void merge( const AABB & b );
+
+	/* returns the overlap of both boxes, the result may be empty */
+	AABB intersection( const AABB & b ) const;
+
+	Vector3 centroid() const;
+	Vector3 extent() const;
+
+	/* surface area used by SAH, zero for an empty box */
+	float area() const;
+
+	/* index of the longest side of the box */
+	int longest_axis() const;
+
+	bool is_empty() const;
+
+	/* slab test against a ray given by its origin and reciprocal direction, the interval <t0, t1> is clipped on hit */
+	bool intersect( const Vector3 & origin, const Vector3 & inv_direction, float & t0, float & t1 ) const;
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef ALIGNED_ALLOCATOR_H_
+#define ALIGNED_ALLOCATOR_H_
+
+#include <malloc.h>
+
+/*! \class AlignedAllocator
+\brief Allocator for std::vector whose elements have to start at the given alignment, e.g. cache lines.
+*/
+template <class T, int ALIGNMENT> class AlignedAllocator
+{
+public:
+	typedef T value_type;
+
+	template <class U> struct rebind
+	{
+		typedef AlignedAllocator<U, ALIGNMENT> other;
+	};
+
+	AlignedAllocator() { }
+	template <class U> AlignedAllocator( const AlignedAllocator<U, ALIGNMENT> & ) { }
+
+	T * allocate( const size_t n )
+	{
+		void * p = _aligned_malloc( n * sizeof( T ), ALIGNMENT );
+		if ( p == nullptr ) throw std::bad_alloc();
+
+		return static_cast<T *>( p );
+	}
+
+	void deallocate( T * p, const size_t )
+	{
+		_aligned_free( p );
+	}
+
+	template <class U> bool operator==( const AlignedAllocator<U, ALIGNMENT> & ) const { return true; }
+	template <class U> bool operator!=( const AlignedAllocator<U, ALIGNMENT> & ) const { return false; }
+};
+
+#endif
@@ -0,0 +1,1347 @@
+#include "pch.h"
+#include "benchmarks.h"
+#include "objloader.h"
+#include "scenegeometry.h"
+#include "dynamicbvh.h"
+#include "camera.h"
+#include "cputracer.h"
+#include "embreescene.h"
+#include "twolevelbvh.h"
+#include "simdkernels.h"
+#include "scenequery.h"
+#include "wavefronttracer.h"
+#include "sampler.h"
+#include "denoiser.h"
+#include "lights.h"
+#include <algorithm>
+#include <numeric>
+#include <omp.h>
+#include "mymath.h"
+#include "utils.h"
+
+namespace
+{
+	const int kWidth = 320; // benchmark camera resolution
+	const int kHeight = 240;
+	const int kNoAOSamples = 32;
+
+	/* everything the CPU backend needs, loaded without opening the GUI */
+	struct BenchmarkScene
+	{
+		std::vector<Surface *> surfaces;
+		std::vector<Material *> materials;
+		SceneGeometry geometry;
+		Bvh bvh;
+	};
+
+	bool LoadBenchmarkScene( const std::string & file_name, BenchmarkScene & scene )
+	{
+		if ( LoadOBJ( file_name.c_str(), scene.surfaces, scene.materials ) <= 0 ) return false;
+
+		scene.geometry.Build( scene.surfaces );
+		scene.bvh.Build( scene.geometry );
+
+		return true;
+	}
+
+	/* the same view as in tutorial_2 */
+	Camera BenchmarkCamera()
+	{
+		return Camera( kWidth, kHeight, deg2rad( 45.0f ), Vector3( 175, -140, 130 ), Vector3( 0, 0, 35 ) );
+	}
+
+	/* ambient occlusion rays spawned from all primary hits of the benchmark camera, the same ones CpuTracer traces */
+	std::vector<Ray> GenerateAORays( const BenchmarkScene & scene, Camera camera )
+	{
+		std::vector<Ray> rays;
+
+		for ( int y = 0; y < kHeight; ++y )
+		{
+			for ( int x = 0; x < kWidth; ++x )
+			{
+				Vector3 d = camera.M_c_w() * Vector3( x - kWidth * 0.5f, kHeight * 0.5f - y, -camera.focalLength() );
+				d.Normalize();
+
+				Ray ray( camera.view_from(), d );
+				RayHit hit;
+
+				if ( !scene.bvh.Intersect( ray, hit ) ) continue;
+
+				Vector3 normal = scene.geometry.normal( hit.triangle_id, hit.u, hit.v );
+				if ( normal.DotProduct( d ) > 0.0f ) normal *= -1.0f;
+
+				RandomStream rng( x + y * kWidth, 0 );
+
+				for ( int i = 0; i < kNoAOSamples; ++i )
+				{
+					const float random_x = rng.next();
+					const float random_y = rng.next();
+					rays.push_back( Ray( ray.point( ray.t_far ), SampleHemisphere( normal, random_x, random_y ) ) );
+				}
+			}
+		}
+
+		return rays;
+	}
+
+	double Seconds( const std::chrono::high_resolution_clock::time_point & t0 )
+	{
+		return std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count();
+	}
+
+	/* number of bytes which differ between two frames of the same size */
+	int CountMismatches( const std::vector<BYTE> & a, const std::vector<BYTE> & b )
+	{
+		int no_mismatches = 0;
+
+		for ( size_t i = 0; i < a.size(); ++i )
+		{
+			if ( a[i] != b[i] ) ++no_mismatches;
+		}
+
+		return no_mismatches;
+	}
+
+	/* average of frames of the scrambled Sobol sequence with the maximal number of AO rays, each frame continues the sequence */
+	std::vector<double> RenderReference( CpuTracer & tracer, Camera & camera, const int no_frames )
+	{
+		std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+		std::vector<double> reference( buffer.size(), 0.0 );
+		tracer.sampler = SamplerType::SOBOL;
+		tracer.cosine_sampling = true;
+		tracer.adaptive_sampling = false;
+		tracer.no_ao_samples = CpuTracer::kMaxAOSamples;
+
+		for ( int frame = 0; frame < no_frames; ++frame )
+		{
+			tracer.sample_index = frame;
+			tracer.Render( camera, buffer.data(), kWidth, kHeight );
+
+			for ( size_t i = 0; i < buffer.size(); ++i ) reference[i] += buffer[i] / double( no_frames );
+		}
+
+		return reference;
+	}
+
+	/* root mean square error of RGB channels in 8-bit levels */
+	double Rmse( const std::vector<BYTE> & buffer, const std::vector<double> & reference )
+	{
+		double sum = 0.0;
+
+		for ( size_t i = 0; i < buffer.size(); i += 4 )
+		{
+			for ( int c = 0; c < 3; ++c ) sum += sqr( buffer[i + c] - reference[i + c] );
+		}
+
+		return sqrt( sum / ( buffer.size() / 4 * 3 ) );
+	}
+
+	/* primary rays of the benchmark camera */
+	std::vector<Ray> GeneratePrimaryRays( Camera camera )
+	{
+		std::vector<Ray> rays;
+		rays.reserve( kWidth * kHeight );
+
+		for ( int y = 0; y < kHeight; ++y )
+		{
+			for ( int x = 0; x < kWidth; ++x )
+			{
+				Vector3 d = camera.M_c_w() * Vector3( x - kWidth * 0.5f, kHeight * 0.5f - y, -camera.focalLength() );
+				d.Normalize();
+				rays.push_back( Ray( camera.view_from(), d ) );
+			}
+		}
+
+		return rays;
+	}
+
+	/* closest hit throughput in Mrays/s of Bvh, TwoLevelBvh or EmbreeScene, the number of hits is returned via no_hits */
+	template <class T>
+	double MeasureClosestHit( const T & accelerator, const std::vector<Ray> & rays, int & no_hits )
+	{
+		const int no_rays = static_cast<int>( rays.size() );
+		int hits = 0;
+		auto t0 = std::chrono::high_resolution_clock::now();
+
+#pragma omp parallel for reduction( + : hits )
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			Ray ray = rays[i];
+			RayHit hit;
+			if ( accelerator.Intersect( ray, hit ) ) ++hits;
+		}
+
+		no_hits = hits;
+
+		return no_rays * 1e-6 / Seconds( t0 );
+	}
+
+	/* any hit throughput in Mrays/s of Bvh, TwoLevelBvh or EmbreeScene, the number of occluded rays is returned via no_hits */
+	template <class T>
+	double MeasureOcclusion( const T & accelerator, const std::vector<Ray> & rays, int & no_hits )
+	{
+		const int no_rays = static_cast<int>( rays.size() );
+		int hits = 0;
+		auto t0 = std::chrono::high_resolution_clock::now();
+
+#pragma omp parallel for reduction( + : hits )
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			if ( accelerator.Occluded( rays[i] ) ) ++hits;
+		}
+
+		no_hits = hits;
+
+		return no_rays * 1e-6 / Seconds( t0 );
+	}
+}
+
+int benchmark_occlusion( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	const std::vector<Ray> rays = GenerateAORays( scene, BenchmarkCamera() );
+	const int no_rays = static_cast<int>( rays.size() );
+
+	printf( "\nAmbient occlusion workload: %d rays (%d samples per hit)\n", no_rays, kNoAOSamples );
+
+	int closest_hit_occluded = 0;
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+#pragma omp parallel for reduction( + : closest_hit_occluded )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		Ray ray = rays[i];
+		RayHit hit;
+		if ( scene.bvh.Intersect( ray, hit ) ) ++closest_hit_occluded;
+	}
+
+	const double closest_hit_time = Seconds( t0 );
+
+	int any_hit_occluded = 0;
+	t0 = std::chrono::high_resolution_clock::now();
+
+#pragma omp parallel for reduction( + : any_hit_occluded )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( scene.bvh.Occluded( rays[i] ) ) ++any_hit_occluded;
+	}
+
+	const double any_hit_time = Seconds( t0 );
+
+	printf( "closest hit : %s, %0.2f Mrays/s, %d occluded\n", TimeToString( closest_hit_time ).c_str(),
+		no_rays * 1e-6 / closest_hit_time, closest_hit_occluded );
+	printf( "any hit     : %s, %0.2f Mrays/s, %d occluded\n", TimeToString( any_hit_time ).c_str(),
+		no_rays * 1e-6 / any_hit_time, any_hit_occluded );
+	printf( "speedup     : %0.2fx\n", closest_hit_time / any_hit_time );
+
+	return ( closest_hit_occluded == any_hit_occluded ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_sbvh( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	BvhSettings settings;
+	settings.spatial_splits = true;
+
+	Bvh sbvh;
+	sbvh.Build( scene.geometry, settings );
+
+	const std::vector<Ray> primary_rays = GeneratePrimaryRays( BenchmarkCamera() );
+	const std::vector<Ray> ao_rays = GenerateAORays( scene, BenchmarkCamera() );
+
+	printf( "\n%-6s %10s %10s %10s %12s %14s %14s\n", "", "nodes", "refs", "SAH", "build", "primary", "AO" );
+
+	int hits[4] = { 0 };
+	const Bvh * trees[2] = { &scene.bvh, &sbvh };
+
+	for ( int i = 0; i < 2; ++i )
+	{
+		const double primary = MeasureClosestHit( *trees[i], primary_rays, hits[i * 2] );
+		const double ao = MeasureOcclusion( *trees[i], ao_rays, hits[i * 2 + 1] );
+
+		printf( "%-6s %10d %10d %10.1f %12s %8.2f Mrays/s %8.2f Mrays/s\n", ( i == 0 ) ? "BVH" : "SBVH",
+			trees[i]->no_nodes(), trees[i]->no_references(), trees[i]->sah_cost(),
+			TimeToString( trees[i]->build_time() ).c_str(), primary, ao );
+	}
+
+	printf( "SAH cost %+0.1f %%, build time %0.2fx, references %+0.1f %%\n",
+		100.0f * ( sbvh.sah_cost() / scene.bvh.sah_cost() - 1.0f ), sbvh.build_time() / scene.bvh.build_time(),
+		100.0f * ( float( sbvh.no_references() ) / scene.bvh.no_references() - 1.0f ) );
+
+	return ( hits[0] == hits[2] && hits[1] == hits[3] ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_refit( const std::string file_name )
+{
+	const int no_frames = 36;
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) || scene.surfaces.empty() ) return EXIT_FAILURE;
+
+	DynamicBvh dynamic_bvh;
+	dynamic_bvh.Build( scene.geometry );
+
+	// the first surface spins around the vertical axis through its center like a rotor
+	Surface * rotor = scene.surfaces[0];
+	AABB rotor_bounds;
+
+	for ( int i = 0; i < rotor->no_triangles(); ++i )
+	{
+		for ( int j = 0; j < 3; ++j ) rotor_bounds.merge( rotor->get_triangle( i ).vertex( j ).position );
+	}
+
+	const Vector3 center = rotor_bounds.centroid();
+	const std::vector<Ray> rays = GeneratePrimaryRays( BenchmarkCamera() );
+
+	double refit_time = 0.0;
+	double build_time = 0.0;
+	int no_rebuilds = 0;
+	int no_mismatches = 0;
+
+	printf( "\n%6s %12s %12s %10s %10s\n", "frame", "refit", "build", "SAH", "Mrays/s" );
+
+	for ( int frame = 1; frame <= no_frames; ++frame )
+	{
+		const float alpha = deg2rad( 10.0f * frame );
+		const Matrix3x3 rotation( cosf( alpha ), -sinf( alpha ), 0.0f,
+			sinf( alpha ), cosf( alpha ), 0.0f,
+			0.0f, 0.0f, 1.0f );
+
+		scene.geometry.SetTransform( rotor, rotation, center - rotation * center );
+
+		const bool was_rebuilding = dynamic_bvh.is_rebuilding();
+		auto t0 = std::chrono::high_resolution_clock::now();
+		dynamic_bvh.Update();
+		const double t_refit = Seconds( t0 );
+		if ( !was_rebuilding && dynamic_bvh.is_rebuilding() ) ++no_rebuilds;
+
+		// a full rebuild of the same frame as the reference
+		Bvh reference;
+		reference.Build( scene.geometry );
+
+		int hits = 0;
+		int reference_hits = 0;
+		const double mrays = MeasureClosestHit( dynamic_bvh.bvh(), rays, hits );
+		MeasureClosestHit( reference, rays, reference_hits );
+		no_mismatches += abs( hits - reference_hits );
+
+		refit_time += t_refit;
+		build_time += reference.build_time();
+
+		printf( "%6d %12s %12s %10.1f %10.2f\n", frame, TimeToString( t_refit ).c_str(),
+			TimeToString( reference.build_time() ).c_str(), dynamic_bvh.bvh().sah_cost() / reference.sah_cost(), mrays );
+	}
+
+	printf( "refit %s vs rebuild %s per frame (%0.1fx), %d background rebuilds\n",
+		TimeToString( refit_time / no_frames ).c_str(), TimeToString( build_time / no_frames ).c_str(),
+		build_time / refit_time, no_rebuilds );
+
+	return ( no_mismatches == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_quantized( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	BvhSettings settings;
+	settings.quantized_nodes = true;
+
+	Bvh quantized_bvh;
+	quantized_bvh.Build( scene.geometry, settings );
+
+	const std::vector<Ray> primary_rays = GeneratePrimaryRays( BenchmarkCamera() );
+	const std::vector<Ray> ao_rays = GenerateAORays( scene, BenchmarkCamera() );
+
+	printf( "\n%-10s %10s %14s %14s\n", "layout", "MB", "primary", "AO" );
+
+	int hits[4] = { 0 };
+	const Bvh * trees[2] = { &scene.bvh, &quantized_bvh };
+
+	for ( int i = 0; i < 2; ++i )
+	{
+		const double primary = MeasureClosestHit( *trees[i], primary_rays, hits[i * 2] );
+		const double ao = MeasureOcclusion( *trees[i], ao_rays, hits[i * 2 + 1] );
+
+		printf( "%-10s %10.2f %8.2f Mrays/s %8.2f Mrays/s\n", ( i == 0 ) ? "binary" : "quantized",
+			trees[i]->memory_footprint() / ( 1024.0 * 1024.0 ), primary, ao );
+	}
+
+	printf( "hits %d/%d primary, %d/%d AO\n", hits[0], hits[2], hits[1], hits[3] );
+
+	return ( hits[0] == hits[2] && hits[1] == hits[3] ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_ray_sorting( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	// the whole frame of AO rays, generated pixel by pixel as the renderer spawns them
+	std::vector<Ray> rays = GenerateAORays( scene, BenchmarkCamera() );
+	int unsorted_hits = 0;
+	const double unsorted = MeasureOcclusion( scene.bvh, rays, unsorted_hits );
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	std::vector<std::pair<unsigned long long, int>> keys( rays.size() );
+
+	for ( size_t i = 0; i < rays.size(); ++i )
+	{
+		keys[i] = std::make_pair( rays[i].sort_key( scene.bvh.bounds() ), static_cast<int>( i ) );
+	}
+
+	std::sort( keys.begin(), keys.end() );
+
+	std::vector<Ray> sorted_rays( rays.size() );
+	for ( size_t i = 0; i < rays.size(); ++i ) sorted_rays[i] = rays[keys[i].second];
+	rays.swap( sorted_rays );
+
+	const double sort_time = Seconds( t0 );
+
+	int sorted_hits = 0;
+	const double sorted = MeasureOcclusion( scene.bvh, rays, sorted_hits );
+
+	printf( "\nAO rays of the frame (%d rays)\n", static_cast<int>( rays.size() ) );
+	printf( "pixel order : %0.2f Mrays/s\n", unsorted );
+	printf( "sorted      : %0.2f Mrays/s (sort %s)\n", sorted, TimeToString( sort_time ).c_str() );
+
+	// the renderer sorts rays of each tile separately
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+
+	for ( int sorting = 0; sorting < 2; ++sorting )
+	{
+		tracer.ray_sorting = sorting != 0;
+		t0 = std::chrono::high_resolution_clock::now();
+		tracer.Render( camera, buffer.data(), kWidth, kHeight );
+
+		printf( "frame, %-14s : %s\n", ( sorting ) ? "tiles sorted" : "tiles unsorted", TimeToString( Seconds( t0 ) ).c_str() );
+	}
+
+	return ( unsorted_hits == sorted_hits ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_tiles( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+
+	const char * order_names[] = { "scanline", "Morton", "Hilbert" };
+	const int tile_sizes[] = { 8, 16, 32, 64 };
+
+	for ( int order = 0; order < 3; ++order )
+	{
+		for ( const int tile_size : tile_sizes )
+		{
+			tracer.scheduler.order = TileOrder( order );
+			tracer.tile_size = tile_size;
+
+			auto t0 = std::chrono::high_resolution_clock::now();
+			tracer.Render( camera, buffer.data(), kWidth, kHeight );
+			const double frame_time = Seconds( t0 );
+
+			printf( "\n%s order, %dx%d tiles: %s\n", order_names[order], tile_size, tile_size, TimeToString( frame_time ).c_str() );
+
+			const std::vector<TileScheduler::ThreadStats> & stats = tracer.scheduler.stats();
+
+			for ( int i = 0; i < static_cast<int>( stats.size() ); ++i )
+			{
+				printf( "  thread %2d: busy %s, idle %s, %d tiles, %d steals\n", i, TimeToString( stats[i].busy_time ).c_str(),
+					TimeToString( stats[i].idle_time ).c_str(), stats[i].no_tiles, stats[i].no_steals );
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_embree( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	EmbreeScene embree;
+
+	if ( !embree.Build( scene.geometry ) ) return EXIT_FAILURE;
+
+	const std::vector<Ray> primary_rays = GeneratePrimaryRays( BenchmarkCamera() );
+	const std::vector<Ray> ao_rays = GenerateAORays( scene, BenchmarkCamera() );
+
+	int hits[4] = { 0 };
+	const double bvh_primary = MeasureClosestHit( scene.bvh, primary_rays, hits[0] );
+	const double bvh_ao = MeasureOcclusion( scene.bvh, ao_rays, hits[1] );
+	const double embree_primary = MeasureClosestHit( embree, primary_rays, hits[2] );
+	const double embree_ao = MeasureOcclusion( embree, ao_rays, hits[3] );
+
+	printf( "\n%-7s %12s %14s %14s\n", "", "build", "primary", "AO" );
+	printf( "%-7s %12s %8.2f Mrays/s %8.2f Mrays/s\n", "BVH", TimeToString( scene.bvh.build_time() ).c_str(), bvh_primary, bvh_ao );
+	printf( "%-7s %12s %8.2f Mrays/s %8.2f Mrays/s\n", "Embree", TimeToString( embree.build_time() ).c_str(), embree_primary, embree_ao );
+	printf( "BVH reaches %0.1f %% of Embree on primary rays and %0.1f %% on AO rays\n",
+		100.0 * bvh_primary / embree_primary, 100.0 * bvh_ao / embree_ao );
+
+	// both traversals should agree up to rays grazing shared edges
+	printf( "hits %d / %d, occluded %d / %d\n", hits[0], hits[2], hits[1], hits[3] );
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_two_level( const std::string file_name )
+{
+	const int no_frames = 36;
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) || scene.surfaces.empty() ) return EXIT_FAILURE;
+
+	TwoLevelBvh two_level_bvh;
+	two_level_bvh.Build( scene.surfaces );
+
+	// the same rotor as in benchmark_refit
+	Surface * rotor = scene.surfaces[0];
+	AABB rotor_bounds;
+
+	for ( int i = 0; i < rotor->no_triangles(); ++i )
+	{
+		for ( int j = 0; j < 3; ++j ) rotor_bounds.merge( rotor->get_triangle( i ).vertex( j ).position );
+	}
+
+	const Vector3 center = rotor_bounds.centroid();
+	const std::vector<Ray> primary_rays = GeneratePrimaryRays( BenchmarkCamera() );
+	const std::vector<Ray> ao_rays = GenerateAORays( scene, BenchmarkCamera() );
+
+	double refit_time = 0.0;
+	double update_time = 0.0;
+	double mrays[4] = { 0.0 };
+	int no_mismatches = 0;
+
+	for ( int frame = 1; frame <= no_frames; ++frame )
+	{
+		const float alpha = deg2rad( 10.0f * frame );
+		const Matrix3x3 rotation( cosf( alpha ), -sinf( alpha ), 0.0f,
+			sinf( alpha ), cosf( alpha ), 0.0f,
+			0.0f, 0.0f, 1.0f );
+		const Vector3 translation = center - rotation * center;
+
+		scene.geometry.SetTransform( rotor, rotation, translation );
+		auto t0 = std::chrono::high_resolution_clock::now();
+		scene.bvh.Refit( scene.geometry );
+		refit_time += Seconds( t0 );
+
+		t0 = std::chrono::high_resolution_clock::now();
+		two_level_bvh.SetTransform( rotor, rotation, translation );
+		two_level_bvh.Update();
+		update_time += Seconds( t0 );
+
+		int hits[4] = { 0 };
+		mrays[0] += MeasureClosestHit( scene.bvh, primary_rays, hits[0] );
+		mrays[1] += MeasureOcclusion( scene.bvh, ao_rays, hits[1] );
+		mrays[2] += MeasureClosestHit( two_level_bvh, primary_rays, hits[2] );
+		mrays[3] += MeasureOcclusion( two_level_bvh, ao_rays, hits[3] );
+		no_mismatches += abs( hits[0] - hits[2] ) + abs( hits[1] - hits[3] );
+	}
+
+	printf( "\n%d meshes, bottom levels built in %s\n", two_level_bvh.no_meshes(), TimeToString( two_level_bvh.build_time() ).c_str() );
+	printf( "%-10s %12s %14s %14s\n", "", "per frame", "primary", "AO" );
+	printf( "%-10s %12s %8.2f Mrays/s %8.2f Mrays/s\n", "refit", TimeToString( refit_time / no_frames ).c_str(),
+		mrays[0] / no_frames, mrays[1] / no_frames );
+	printf( "%-10s %12s %8.2f Mrays/s %8.2f Mrays/s\n", "two-level", TimeToString( update_time / no_frames ).c_str(),
+		mrays[2] / no_frames, mrays[3] / no_frames );
+	printf( "%d mismatching hits\n", no_mismatches );
+
+	return ( no_mismatches == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_triangle_layouts( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	const std::vector<Ray> primary_rays = GeneratePrimaryRays( BenchmarkCamera() );
+	const std::vector<Ray> ao_rays = GenerateAORays( scene, BenchmarkCamera() );
+
+	const char * layout_names[] = { "vertices", "edges", "Woop" };
+	const size_t triangle_sizes[] = { 0, sizeof( EdgeTriangle ), sizeof( WoopTriangle ) };
+	int hits[6] = { 0 };
+
+	printf( "\n%-10s %10s %10s %12s %14s %14s\n", "layout", "B/ref", "MB", "build", "primary", "AO" );
+
+	for ( int layout = 0; layout < 3; ++layout )
+	{
+		BvhSettings settings;
+		settings.triangle_layout = TriangleLayout( layout );
+		settings.verbose = false;
+
+		Bvh bvh;
+		bvh.Build( scene.geometry, settings );
+
+		const double primary = MeasureClosestHit( bvh, primary_rays, hits[layout * 2] );
+		const double ao = MeasureOcclusion( bvh, ao_rays, hits[layout * 2 + 1] );
+
+		printf( "%-10s %10d %10.2f %12s %8.2f Mrays/s %8.2f Mrays/s\n", layout_names[layout], static_cast<int>( triangle_sizes[layout] ),
+			bvh.memory_footprint() / ( 1024.0 * 1024.0 ), TimeToString( bvh.build_time() ).c_str(), primary, ao );
+	}
+
+	// Woop computes the barycentrics differently, rays grazing shared edges may disagree
+	printf( "hits %d/%d/%d primary, %d/%d/%d AO\n", hits[0], hits[2], hits[4], hits[1], hits[3], hits[5] );
+
+	return ( hits[0] == hits[2] && hits[1] == hits[3] ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_isa( const std::string file_name )
+{
+	const int no_repetitions = 5;
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	const IsaLevel initial = isa_level();
+	const IsaLevel detected = detected_isa_level();
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+
+	std::vector<BYTE> reference( kWidth * kHeight * 4 );
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+	std::vector<Color3f> colors( kWidth * kHeight );
+
+	for ( size_t i = 0; i < colors.size(); ++i )
+	{
+		colors[i] = Color3f( ( i % 301 ) / 250.0f - 0.1f, ( i % 257 ) / 256.0f, ( i % 101 ) / 80.0f );
+	}
+
+	int no_mismatches = 0;
+
+	printf( "\n%-8s %12s %16s\n", "ISA", "frame", "colors" );
+
+	for ( const IsaLevel level : { IsaLevel::SSE42, IsaLevel::AVX2, IsaLevel::AVX512 } )
+	{
+		if ( level > detected ) continue;
+
+		set_isa_level( level );
+
+		double frame_time = FLT_MAX;
+
+		for ( int r = 0; r < no_repetitions; ++r )
+		{
+			auto t0 = std::chrono::high_resolution_clock::now();
+			tracer.Render( camera, buffer.data(), kWidth, kHeight );
+			frame_time = min( frame_time, Seconds( t0 ) );
+		}
+
+		auto t0 = std::chrono::high_resolution_clock::now();
+
+		for ( int r = 0; r < no_repetitions; ++r )
+		{
+			simd_kernels().convert_colors( reinterpret_cast<const float *>( colors.data() ), static_cast<int>( colors.size() ), buffer.data() );
+		}
+
+		const double color_time = Seconds( t0 ) / no_repetitions;
+
+		// the frame is rendered once more as the conversion has overwritten the buffer
+		tracer.Render( camera, buffer.data(), kWidth, kHeight );
+		if ( level == IsaLevel::SSE42 ) reference = buffer;
+
+		for ( size_t i = 0; i < buffer.size(); ++i )
+		{
+			if ( buffer[i] != reference[i] ) ++no_mismatches;
+		}
+
+		printf( "%-8s %12s %10.1f Mpx/s\n", isa_name( level ), TimeToString( frame_time ).c_str(), colors.size() * 1e-6 / color_time );
+	}
+
+	set_isa_level( initial );
+	printf( "%d bytes differ from the SSE4.2 frame\n", no_mismatches );
+
+	return ( no_mismatches == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_ao_radius( const std::string file_name )
+{
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	std::vector<Ray> rays = GenerateAORays( scene, BenchmarkCamera() );
+
+	// radii relative to the scene size, the first one is unbounded
+	const float diagonal = scene.bvh.bounds().extent().L2Norm();
+	const float fractions[] = { 0.0f, 0.5f, 0.2f, 0.1f, 0.05f, 0.02f };
+
+	double unbounded = 0.0;
+
+	printf( "\n%10s %14s %10s %10s\n", "radius", "AO", "speedup", "occluded" );
+
+	for ( const float fraction : fractions )
+	{
+		const float radius = ( fraction > 0.0f ) ? fraction * diagonal : FLT_MAX;
+
+		for ( Ray & ray : rays ) ray.t_far = radius;
+
+		int occluded = 0;
+		const double mrays = MeasureOcclusion( scene.bvh, rays, occluded );
+		if ( fraction == 0.0f ) unbounded = mrays;
+
+		char label[32];
+		if ( fraction > 0.0f ) sprintf( label, "%0.1f", radius ); else sprintf( label, "unbounded" );
+
+		printf( "%10s %8.2f Mrays/s %9.2fx %9.1f%%\n", label, mrays, mrays / unbounded, 100.0 * occluded / rays.size() );
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_queries( const std::string file_name )
+{
+	const int kBatchSize = 1024;
+	const int no_frames = 8;
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	DynamicBvh dynamic_bvh;
+	dynamic_bvh.Build( scene.geometry );
+	std::shared_timed_mutex mutex;
+
+	SceneQuery query;
+	query.set_scene( &scene.geometry, &dynamic_bvh, &mutex );
+
+	Camera camera = BenchmarkCamera();
+
+	// random pixels to pick and segments between random points of the scene box
+	std::mt19937 rng( 1 );
+	std::uniform_int_distribution<int> random_x( 0, kWidth - 1 );
+	std::uniform_int_distribution<int> random_y( 0, kHeight - 1 );
+	std::uniform_real_distribution<float> distribution( 0.0f, 1.0f );
+
+	std::vector<int> x( kBatchSize );
+	std::vector<int> y( kBatchSize );
+	RayStream segments;
+	segments.resize( kBatchSize );
+	const AABB bounds = dynamic_bvh.bvh().bounds();
+
+	for ( int i = 0; i < kBatchSize; ++i )
+	{
+		x[i] = random_x( rng );
+		y[i] = random_y( rng );
+
+		Vector3 a, b;
+
+		for ( int k = 0; k < 3; ++k )
+		{
+			a.data[k] = bounds.lower.data[k] + distribution( rng ) * ( bounds.upper.data[k] - bounds.lower.data[k] );
+			b.data[k] = bounds.lower.data[k] + distribution( rng ) * ( bounds.upper.data[k] - bounds.lower.data[k] );
+		}
+
+		SceneQuery::set_segment( segments, i, a, b );
+	}
+
+	// picked hits have to match single rays of the primary ray generator
+	QueryHits hits;
+	query.Pick( camera, kWidth, kHeight, x.data(), y.data(), kBatchSize, hits );
+
+	const std::vector<Ray> primary_rays = GeneratePrimaryRays( camera );
+	int no_mismatches = 0;
+
+	for ( int i = 0; i < kBatchSize; ++i )
+	{
+		Ray ray = primary_rays[x[i] + y[i] * kWidth];
+		RayHit hit;
+		dynamic_bvh.bvh().Intersect( ray, hit );
+
+		if ( hit.triangle_id != hits.triangle_id[i] ) ++no_mismatches;
+	}
+
+	// batches issued on their own
+	std::vector<char> occluded;
+	int no_batches = 0;
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	while ( Seconds( t0 ) < 0.5 )
+	{
+		query.Pick( camera, kWidth, kHeight, x.data(), y.data(), kBatchSize, hits );
+		query.Occluded( segments, occluded );
+		no_batches += 2;
+	}
+
+	const double idle_rate = no_batches * kBatchSize / Seconds( t0 );
+
+	// frames rendered alone and then while another thread keeps issuing the same batches
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &dynamic_bvh.bvh() );
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+
+	double frame_times[2] = { 0.0, 0.0 };
+	double busy_rate = 0.0;
+
+	for ( int concurrent = 0; concurrent < 2; ++concurrent )
+	{
+		std::atomic<bool> done{ false };
+		std::atomic<int> no_queries{ 0 };
+		std::thread worker;
+
+		if ( concurrent )
+		{
+			worker = std::thread( [&]()
+			{
+				QueryHits worker_hits;
+				std::vector<char> worker_occluded;
+
+				while ( !done )
+				{
+					query.Pick( camera, kWidth, kHeight, x.data(), y.data(), kBatchSize, worker_hits );
+					query.Occluded( segments, worker_occluded );
+					no_queries += 2 * kBatchSize;
+				}
+			} );
+		}
+
+		t0 = std::chrono::high_resolution_clock::now();
+
+		for ( int frame = 0; frame < no_frames; ++frame )
+		{
+			std::shared_lock<std::shared_timed_mutex> lock( mutex );
+			tracer.Render( camera, buffer.data(), kWidth, kHeight );
+		}
+
+		frame_times[concurrent] = Seconds( t0 ) / no_frames;
+
+		if ( concurrent )
+		{
+			busy_rate = no_queries / ( frame_times[concurrent] * no_frames );
+			done = true;
+			worker.join();
+		}
+	}
+
+	printf( "\n%d of %d picks differ from single rays\n", no_mismatches, kBatchSize );
+	printf( "queries alone: %0.2f Mqueries/s, during rendering: %0.2f Mqueries/s\n", idle_rate * 1e-6, busy_rate * 1e-6 );
+	printf( "frame %s alone, %s with queries\n", TimeToString( frame_times[0] ).c_str(), TimeToString( frame_times[1] ).c_str() );
+
+	return ( no_mismatches == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_rng( const std::string file_name )
+{
+	const int no_pixels = 1 << 20;
+
+	// a stream per pixel as the tracers need it, mt19937 has to be seeded for each of them
+	auto t0 = std::chrono::high_resolution_clock::now();
+	double sum = 0.0;
+
+#pragma omp parallel for reduction( + : sum )
+	for ( int pixel = 0; pixel < no_pixels; ++pixel )
+	{
+		std::mt19937 rng( pixel );
+		std::uniform_real_distribution<float> distribution( 0.0f, 1.0f );
+		for ( int i = 0; i < 2 * kNoAOSamples; ++i ) sum += distribution( rng );
+	}
+
+	const double mt_time = Seconds( t0 );
+	t0 = std::chrono::high_resolution_clock::now();
+
+#pragma omp parallel for reduction( + : sum )
+	for ( int pixel = 0; pixel < no_pixels; ++pixel )
+	{
+		RandomStream rng( pixel, 0 );
+		for ( int i = 0; i < 2 * kNoAOSamples; ++i ) sum += rng.next();
+	}
+
+	const double counter_time = Seconds( t0 );
+
+	printf( "\n%d pixels, %d numbers each (mean %0.4f)\n", no_pixels, 2 * kNoAOSamples, sum / ( 4.0 * no_pixels * kNoAOSamples ) );
+	printf( "mt19937 %s, counter-based %s (%0.1fx)\n", TimeToString( mt_time ).c_str(), TimeToString( counter_time ).c_str(),
+		mt_time / counter_time );
+
+	// frames have to be identical for any number of threads and between both CPU tracers
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	CpuTracer cpu_tracer;
+	cpu_tracer.set_scene( &scene.geometry, &scene.bvh );
+	WavefrontTracer wavefront_tracer;
+	wavefront_tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+
+	std::vector<BYTE> reference( kWidth * kHeight * 4 );
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+	const int max_threads = omp_get_max_threads();
+	int no_mismatches = 0;
+
+	omp_set_num_threads( 1 );
+	cpu_tracer.Render( camera, reference.data(), kWidth, kHeight );
+
+	for ( const int no_threads : { 2, 3, max_threads } )
+	{
+		omp_set_num_threads( no_threads );
+
+		cpu_tracer.Render( camera, buffer.data(), kWidth, kHeight );
+		const int cpu_mismatches = CountMismatches( buffer, reference );
+
+		wavefront_tracer.Render( camera, buffer.data(), kWidth, kHeight );
+		const int wavefront_mismatches = CountMismatches( buffer, reference );
+
+		printf( "%2d threads: %d bytes of CpuTracer and %d bytes of WavefrontTracer differ from a single thread\n",
+			no_threads, cpu_mismatches, wavefront_mismatches );
+
+		no_mismatches += cpu_mismatches + wavefront_mismatches;
+	}
+
+	omp_set_num_threads( max_threads );
+
+	return ( no_mismatches == 0 ) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int benchmark_samplers( const std::string file_name )
+{
+	const int no_reference_frames = 8;
+	const int sample_counts[] = { 4, 8, 16, 32 };
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+
+	const std::vector<double> reference = RenderReference( tracer, camera, no_reference_frames );
+
+	// rows are samplers with uniform and cosine-weighted directions, columns sample counts
+	double rmse[3][2][4];
+
+	for ( int type = 0; type < 3; ++type )
+	{
+		for ( int cosine = 0; cosine < 2; ++cosine )
+		{
+			tracer.sampler = SamplerType( type );
+			tracer.cosine_sampling = cosine != 0;
+			tracer.sample_index = no_reference_frames; // disjoint from the points of the reference
+
+			for ( int j = 0; j < 4; ++j )
+			{
+				tracer.no_ao_samples = sample_counts[j];
+				tracer.Render( camera, buffer.data(), kWidth, kHeight );
+				rmse[type][cosine][j] = Rmse( buffer, reference );
+			}
+		}
+	}
+
+	printf( "\nRMSE of 8-bit pixels against %d spp\n%-12s %-8s", no_reference_frames * CpuTracer::kMaxAOSamples, "sampler", "mapping" );
+	for ( const int n : sample_counts ) printf( " %7d spp", n );
+	printf( "\n" );
+
+	const char * sampler_names[] = { "random", "Sobol", "blue noise" };
+	const double baseline = rmse[0][0][3]; // uniform random directions at the highest count, i.e. the original AO
+
+	for ( int type = 0; type < 3; ++type )
+	{
+		for ( int cosine = 0; cosine < 2; ++cosine )
+		{
+			printf( "%-12s %-8s", sampler_names[type], ( cosine ) ? "cosine" : "uniform" );
+			int no_samples_needed = 0;
+
+			for ( int j = 0; j < 4; ++j )
+			{
+				printf( " %11.3f", rmse[type][cosine][j] );
+				if ( no_samples_needed == 0 && rmse[type][cosine][j] <= baseline ) no_samples_needed = sample_counts[j];
+			}
+
+			printf( "   %d spp reach the error of the original %d spp\n", no_samples_needed, sample_counts[3] );
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_adaptive( const std::string file_name )
+{
+	const int no_reference_frames = 8;
+	const int sample_counts[] = { 8, 16, 32, 64 };
+	const float thresholds[] = { 0.1f, 0.05f, 0.02f, 0.01f, 0.005f };
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+
+	const std::vector<double> reference = RenderReference( tracer, camera, no_reference_frames );
+	tracer.sample_index = no_reference_frames; // disjoint from the points of the reference
+
+	// the error of fixed sample counts, the rays needed for any error in between are interpolated on the log-log scale
+	double fixed_rmse[4];
+	double fixed_rays[4];
+
+	printf( "\n%-20s %12s %10s %8s\n", "", "AO rays", "RMSE", "saved" );
+
+	for ( int j = 0; j < 4; ++j )
+	{
+		tracer.no_ao_samples = sample_counts[j];
+		tracer.Render( camera, buffer.data(), kWidth, kHeight );
+		fixed_rmse[j] = Rmse( buffer, reference );
+		fixed_rays[j] = double( tracer.no_ao_rays() );
+
+		printf( "fixed %3d spp        %12lld %10.3f\n", sample_counts[j], tracer.no_ao_rays(), fixed_rmse[j] );
+	}
+
+	tracer.adaptive_sampling = true;
+	tracer.no_ao_samples = CpuTracer::kMaxAOSamples;
+
+	for ( const float threshold : thresholds )
+	{
+		tracer.adaptive_threshold = threshold;
+		tracer.Render( camera, buffer.data(), kWidth, kHeight );
+		const double rmse = Rmse( buffer, reference );
+		const double rays = double( tracer.no_ao_rays() );
+
+		// fixed rays at the same error, errors beyond the measured range are extrapolated from the nearest segment
+		int j = 0;
+		while ( j < 2 && rmse < fixed_rmse[j + 1] ) ++j;
+		const double slope = log( fixed_rays[j + 1] / fixed_rays[j] ) / log( fixed_rmse[j + 1] / fixed_rmse[j] );
+		const double equal_error_rays = fixed_rays[j] * exp( slope * log( rmse / fixed_rmse[j] ) );
+
+		printf( "adaptive %0.3f       %12lld %10.3f %7.1f%%\n", threshold, tracer.no_ao_rays(), rmse,
+			100.0 * ( 1.0 - rays / equal_error_rays ) );
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_denoiser( const std::string file_name )
+{
+	const int no_reference_frames = 8;
+	const int no_runs = 10;
+	const int sample_counts[] = { 1, 2, 4, 8, 32 };
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> noisy( kWidth * kHeight * 4 );
+	std::vector<BYTE> buffer( noisy.size() );
+	GBuffer gbuffer;
+	gbuffer.outputs = Denoiser::kGuides;
+	Denoiser denoiser;
+
+	const std::vector<double> reference = RenderReference( tracer, camera, no_reference_frames );
+	tracer.sample_index = no_reference_frames; // disjoint from the points of the reference
+
+	printf( "\nDenoiser, %d passes on %d threads\n", denoiser.no_passes, omp_get_max_threads() );
+	printf( "%-8s %12s %14s %12s\n", "AO spp", "noisy RMSE", "denoised RMSE", "time" );
+
+	for ( const int no_samples : sample_counts )
+	{
+		tracer.no_ao_samples = no_samples;
+		tracer.Render( camera, noisy.data(), kWidth, kHeight, &gbuffer );
+
+		double time = 0.0;
+
+		for ( int run = 0; run < no_runs; ++run )
+		{
+			buffer = noisy;
+			denoiser.Run( buffer.data(), gbuffer );
+			time += denoiser.time() / no_runs;
+		}
+
+		printf( "%-8d %12.3f %14.3f %12s\n", no_samples, Rmse( noisy, reference ), Rmse( buffer, reference ),
+			TimeToString( time ).c_str() );
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_aovs( const std::string file_name )
+{
+	const int no_runs = 10;
+	const char * names[kNoAovs] = { "depth", "normal", "albedo", "material", "primitive" };
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	tracer.no_ao_samples = 4; // a cheap frame so that the cost of the outputs shows
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+	GBuffer gbuffer;
+
+	// the color alone, each output on its own and all of them together
+	std::vector<unsigned int> output_sets = { 0 };
+	for ( int i = 0; i < kNoAovs; ++i ) output_sets.push_back( aov_bit( Aov( i ) ) );
+	output_sets.push_back( ( 1u << kNoAovs ) - 1 );
+
+	printf( "\n%-12s %14s %12s\n", "outputs", "bytes / pixel", "frame" );
+
+	for ( const unsigned int outputs : output_sets )
+	{
+		gbuffer.outputs = outputs;
+		tracer.Render( camera, buffer.data(), kWidth, kHeight, &gbuffer ); // warm up
+
+		auto t0 = std::chrono::high_resolution_clock::now();
+		for ( int run = 0; run < no_runs; ++run ) tracer.Render( camera, buffer.data(), kWidth, kHeight, &gbuffer );
+		const double time = Seconds( t0 ) / no_runs;
+
+		const size_t bytes = gbuffer.depth.size() * sizeof( float ) + gbuffer.normal.size() * sizeof( unsigned int ) +
+			gbuffer.albedo.size() * sizeof( unsigned int ) + gbuffer.material.size() * sizeof( unsigned short ) +
+			gbuffer.primitive.size() * sizeof( int );
+
+		std::string name = ( outputs == 0 ) ? "none" : "all";
+		for ( int i = 0; i < kNoAovs; ++i ) if ( outputs == aov_bit( Aov( i ) ) ) name = names[i];
+
+		printf( "%-12s %14d %12s\n", name.c_str(), 4 + static_cast<int>( bytes / ( kWidth * kHeight ) ), TimeToString( time ).c_str() );
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_lights( const std::string file_name )
+{
+	const int no_reference_frames = 16;
+	const int light_sample_counts[] = { 1, 4, 16, 64 };
+	const int no_draws = 1 << 24;
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	LightList lights;
+	lights.Build( scene.geometry );
+
+	// the alias table against the inverse of the cumulative distribution on the same weights, random ones without emitters
+	std::vector<float> weights;
+	for ( int i = 0; i < lights.no_lights(); ++i ) weights.push_back( Luminance( lights.emission( i ) ) * lights.area( i ) );
+
+	if ( weights.empty() )
+	{
+		RandomStream rng( 0, 0 );
+		weights.resize( 1 << 16 );
+		for ( float & w : weights ) w = rng.next();
+	}
+
+	AliasTable table;
+	table.Build( weights );
+	std::vector<double> cdf( weights.size() );
+	std::partial_sum( weights.begin(), weights.end(), cdf.begin() );
+
+	RandomStream rng( 1, 0 );
+	long long checksum = 0; // keeps the draws alive
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < no_draws; ++i ) checksum += table.Sample( rng.next() );
+	const double alias_time = Seconds( t0 );
+
+	t0 = std::chrono::high_resolution_clock::now();
+	for ( int i = 0; i < no_draws; ++i )
+	{
+		const double u = rng.next() * cdf.back();
+		checksum += min( static_cast<int>( std::upper_bound( cdf.begin(), cdf.end(), u ) - cdf.begin() ), int( cdf.size() ) - 1 );
+	}
+	const double cdf_time = Seconds( t0 );
+
+	printf( "\n%d weights, %d draws (checksum %lld)\n", static_cast<int>( weights.size() ), no_draws, checksum );
+	printf( "alias table %s (%0.1f ns / draw), binary search %s (%0.1f ns / draw)\n", TimeToString( alias_time ).c_str(),
+		alias_time / no_draws * 1e+9, TimeToString( cdf_time ).c_str(), cdf_time / no_draws * 1e+9 );
+
+	if ( lights.no_lights() == 0 )
+	{
+		printf( "No emissive triangles, frames are lit by the default point light.\n" );
+
+		return EXIT_SUCCESS;
+	}
+
+	// error of direct light against many light points drawn from the tree, AO rays too short to hit anything add no noise
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	tracer.set_lights( &lights );
+	tracer.ao_radius = 1e-3f;
+	tracer.light_scale = 0.25f;
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffer( kWidth * kHeight * 4 );
+
+	tracer.no_light_samples = kMaxLightSamples;
+	const std::vector<double> reference = RenderReference( tracer, camera, no_reference_frames );
+	tracer.sample_index = no_reference_frames;
+
+	printf( "\n%d emissive triangles, %0.1f total power, light tree of depth %d\n", lights.no_lights(), lights.power(),
+		lights.tree().depth() );
+	printf( "%-14s %12s %12s %12s %12s\n", "light samples", "power RMSE", "tree RMSE", "power frame", "tree frame" );
+
+	// both strategies at equal light samples
+	for ( const int no_samples : light_sample_counts )
+	{
+		tracer.no_light_samples = no_samples;
+		double rmse[2], time[2];
+
+		for ( int sampling = 0; sampling < 2; ++sampling )
+		{
+			tracer.light_sampling = LightSampling( sampling );
+
+			auto t1 = std::chrono::high_resolution_clock::now();
+			tracer.Render( camera, buffer.data(), kWidth, kHeight );
+			time[sampling] = Seconds( t1 );
+			rmse[sampling] = Rmse( buffer, reference );
+		}
+
+		printf( "%-14d %12.3f %12.3f %12s %12s\n", no_samples, rmse[0], rmse[1], TimeToString( time[0] ).c_str(),
+			TimeToString( time[1] ).c_str() );
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_shading( const std::string file_name )
+{
+	const int no_repeats = 5;
+	const int light_sample_counts[] = { 1, 4, 16 };
+
+	BenchmarkScene scene;
+
+	if ( !LoadBenchmarkScene( file_name, scene ) ) return EXIT_FAILURE;
+
+	LightList lights;
+	lights.Build( scene.geometry );
+
+	CpuTracer tracer;
+	tracer.set_scene( &scene.geometry, &scene.bvh );
+	tracer.set_lights( &lights );
+	WavefrontTracer wavefront;
+	wavefront.set_scene( &scene.geometry, &scene.bvh );
+	wavefront.set_lights( &lights );
+	Camera camera = BenchmarkCamera();
+	std::vector<BYTE> buffers[2] = { std::vector<BYTE>( kWidth * kHeight * 4 ), std::vector<BYTE>( kWidth * kHeight * 4 ) };
+	std::vector<BYTE> wave_buffer( kWidth * kHeight * 4 );
+	int no_mismatches = 0;
+
+	printf( "\n%d materials, %d emissive triangles, %s kernels, best of %d frames\n", static_cast<int>( scene.materials.size() ),
+		lights.no_lights(), isa_name( isa_level() ), no_repeats );
+	printf( "%-14s %14s %14s %14s %14s %14s %14s\n", "light samples", "pixel shading", "batch shading", "pixel frame", "batch frame",
+		"wave pixel", "wave batch" );
+
+	// the shading stage is timed by the tracer, it includes the shadow rays both orders trace alike
+	for ( const int no_samples : light_sample_counts )
+	{
+		tracer.no_light_samples = wavefront.no_light_samples = no_samples;
+		double shading[2] = { FLT_MAX, FLT_MAX }, frame[2] = { FLT_MAX, FLT_MAX }, wave[2] = { FLT_MAX, FLT_MAX };
+
+		for ( int sorting = 0; sorting < 2; ++sorting )
+		{
+			tracer.shader_sorting = wavefront.shader_sorting = sorting != 0;
+
+			for ( int i = 0; i < no_repeats; ++i )
+			{
+				auto t0 = std::chrono::high_resolution_clock::now();
+				tracer.Render( camera, buffers[sorting].data(), kWidth, kHeight );
+				frame[sorting] = min( frame[sorting], Seconds( t0 ) );
+				shading[sorting] = min( shading[sorting], tracer.shading_time() );
+
+				t0 = std::chrono::high_resolution_clock::now();
+				wavefront.Render( camera, wave_buffer.data(), kWidth, kHeight );
+				wave[sorting] = min( wave[sorting], Seconds( t0 ) );
+			}
+
+			no_mismatches += CountMismatches( buffers[0], wave_buffer );
+		}
+
+		no_mismatches += CountMismatches( buffers[0], buffers[1] );
+
+		printf( "%-14d %14s %14s %14s %14s %14s %14s\n", no_samples, TimeToString( shading[0] ).c_str(), TimeToString( shading[1] ).c_str(),
+			TimeToString( frame[0] ).c_str(), TimeToString( frame[1] ).c_str(), TimeToString( wave[0] ).c_str(), TimeToString( wave[1] ).c_str() );
+	}
+
+	// the vectorized power of the Phong lobe is a few ulps off powf, so rarely a byte may round the other way
+	printf( "%d mismatched bytes between pixel and batch shading of both backends\n", no_mismatches );
+
+	return EXIT_SUCCESS;
+}
+
+int benchmark_textures( const std::string file_name )
+{
+	const int no_lookups = 1 << 22;
+	const int no_repeats = 5;
+	const TextureStorage storages[] = { TextureStorage::BYTES, TextureStorage::FLOAT16, TextureStorage::FLOAT32 };
+	const char * storage_names[] = { "bytes", "float16", "float32" };
+
+	Texture texture( file_name.c_str() );
+
+	if ( texture.width() <= 0 || texture.height() <= 0 ) return EXIT_FAILURE;
+
+	// uniformly random coordinates, i.e. the worst case for the caches
+	RandomStream rng( 0, 0 );
+	std::vector<float> u( no_lookups ), v( no_lookups );
+	for ( int i = 0; i < no_lookups; ++i )
+	{
+		u[i] = rng.next();
+		v[i] = rng.next();
+	}
+
+	std::vector<Color3f> reference( no_lookups ), colors( no_lookups );
+	texture.texels( u.data(), v.data(), no_lookups, true, reference.data() );
+
+	printf( "\n%dx%d texture, %d linearized lookups, %s kernels, best of %d runs\n", texture.width(), texture.height(), no_lookups,
+		isa_name( isa_level() ), no_repeats );
+	printf( "%-8s %12s %16s %16s %12s\n", "storage", "conversion", "texel [M/s]", "texels [M/s]", "mean error" );
+
+	for ( int s = 0; s < 3; ++s )
+	{
+		auto t0 = std::chrono::high_resolution_clock::now();
+		texture.Convert( storages[s], true );
+		const double conversion_time = Seconds( t0 );
+
+		double texel_time = FLT_MAX, texels_time = FLT_MAX;
+		float checksum = 0.0f; // keeps the single lookups alive
+
+		for ( int r = 0; r < no_repeats; ++r )
+		{
+			t0 = std::chrono::high_resolution_clock::now();
+			for ( int i = 0; i < no_lookups; ++i ) checksum += texture.texel( u[i], v[i], true ).g;
+			texel_time = min( texel_time, Seconds( t0 ) );
+
+			t0 = std::chrono::high_resolution_clock::now();
+			texture.texels( u.data(), v.data(), no_lookups, true, colors.data() );
+			texels_time = min( texels_time, Seconds( t0 ) );
+		}
+
+		// bytes are linearized after the filtering, converted texels before it
+		double error = 0.0;
+		for ( int i = 0; i < no_lookups; ++i )
+		{
+			error += fabs( colors[i].r - reference[i].r ) + fabs( colors[i].g - reference[i].g ) + fabs( colors[i].b - reference[i].b );
+		}
+
+		printf( "%-8s %12s %16.1f %16.1f %12.2e%s\n", storage_names[s], TimeToString( conversion_time ).c_str(), no_lookups * 1e-6 / texel_time,
+			no_lookups * 1e-6 / texels_time, error / ( 3.0 * no_lookups ), ( checksum < 0.0f ) ? " " : "" );
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+
+/* compares the occlusion-only any hit query with the closest hit query on ambient occlusion rays */
+int benchmark_occlusion( const std::string file_name );
+
+/* compares the plain binned SAH BVH with the SBVH, reports SAH costs, build times and traversal performance */
+int benchmark_sbvh( const std::string file_name );
+
+/* spins a surface over several frames and compares the BVH refit with full rebuilds */
+int benchmark_refit( const std::string file_name );
+
+/* compares memory footprint and traversal speed of the full precision and the quantized node layouts */
+int benchmark_quantized( const std::string file_name );
+
+/* traces AO rays in the order they are spawned and sorted by direction octant and origin cell */
+int benchmark_ray_sorting( const std::string file_name );
+
+/* renders the benchmark view with all tile orders and several tile sizes, reports per-thread busy and idle times */
+int benchmark_tiles( const std::string file_name );
+
+/* compares the in-house BVH with Embree on the same primary and AO rays, requires USE_EMBREE */
+int benchmark_embree( const std::string file_name );
+
+/* spins a surface as benchmark_refit does and compares the refit of the flat BVH with the top-level rebuild of the two-level BVH */
+int benchmark_two_level( const std::string file_name );
+
+/* compares traversal speed and memory cost of triangles fetched from the geometry, precomputed edges and Woop transforms */
+int benchmark_triangle_layouts( const std::string file_name );
+
+/* renders the benchmark view with the kernels of every ISA level the CPU supports and checks that the frames match */
+int benchmark_isa( const std::string file_name );
+
+/* traces AO rays limited to several radii relative to the scene size and reports the throughput gained over unbounded rays */
+int benchmark_ao_radius( const std::string file_name );
+
+/* picks random pixels and tests random segments in batches, alone and from a second thread while frames are rendered */
+int benchmark_queries( const std::string file_name );
+
+/* compares seeding mt19937 per pixel with counter-based streams and checks that frames do not depend on the number of threads */
+int benchmark_rng( const std::string file_name );
+
+/* compares AO error of the random, Sobol and blue-noise samplers with uniform and cosine-weighted directions at equal sample counts */
+int benchmark_samplers( const std::string file_name );
+
+/* compares AO rays spent by fixed sample counts and by adaptive sampling with several thresholds, reports rays saved at equal error */
+int benchmark_adaptive( const std::string file_name );
+
+/* filters frames of several AO sample counts with the a-trous denoiser, reports errors before and after and the filter time */
+int benchmark_denoiser( const std::string file_name );
+
+/* renders frames with no auxiliary output, with each of them and with all of them, reports their size and the frame time */
+int benchmark_aovs( const std::string file_name );
+
+/* times draws from the alias table of the emitters against a binary search and compares the error of direct light of the alias table and the light tree by light samples */
+int benchmark_lights( const std::string file_name );
+
+/* renders frames with hits shaded pixel by pixel and in batches sorted by material on both CPU backends, reports the shading and frame times and the bytes in which the frames differ */
+int benchmark_shading( const std::string file_name );
+
+/* converts the texture into each storage and times random bilinear lookups one by one and in batches, reports the mean difference from the bytes */
+int benchmark_textures( const std::string file_name );
+
+#endif
@@ -0,0 +1,1506 @@
+#include "pch.h"
+#include "bvh.h"
+#include "mymath.h"
+#include "utils.h"
+#include "simdkernels.h"
+#include <algorithm>
+#include <bitset>
+
+namespace
+{
+	const float kTraversalCost = 1.0f; // relative cost of a single node visit
+	const float kIntersectionCost = 1.0f; // relative cost of a single ray-triangle test
+	const int kMaxSahDepth = 48; // deeper nodes are split by the object median which bounds the tree depth
+
+	const int kBvhFileVersion = 1;
+	const int kBvhFileAlignment = 64; // every section of the cache file starts at a cache line
+
+	/* header of the BVH cache file followed by nodes, indices and quantized nodes */
+	struct BvhFileHeader
+	{
+		char magic[8];
+		int version;
+		int no_nodes;
+		int no_indices;
+		int no_quantized_nodes;
+		unsigned long long key;
+		float build_sah_cost;
+		char pad[28];
+	};
+
+	inline long long AlignedOffset( const long long offset )
+	{
+		return ( offset + kBvhFileAlignment - 1 ) / kBvhFileAlignment * kBvhFileAlignment;
+	}
+
+	const char kBvhFileMagic[8] = { 'P', 'G', '2', 'B', 'V', 'H', 0, 0 };
+
+	/* 2^exponent built directly from the bits of the float */
+	inline float PowerOfTwo( const int exponent )
+	{
+		const unsigned int bits = static_cast<unsigned int>( exponent + 127 ) << 23;
+		float value;
+		memcpy( &value, &bits, sizeof( value ) );
+
+		return value;
+	}
+
+	/* the largest grid plane not above the value */
+	inline unsigned char QuantizeLower( const float value, const float origin, const float scale )
+	{
+		int q = clamp( int( floorf( ( value - origin ) / scale ) ), 0, 255 );
+		while ( q > 0 && origin + q * scale > value ) --q;
+
+		return static_cast<unsigned char>( q );
+	}
+
+	/* the smallest grid plane not below the value */
+	inline unsigned char QuantizeUpper( const float value, const float origin, const float scale )
+	{
+		int q = clamp( int( ceilf( ( value - origin ) / scale ) ), 0, 255 );
+		while ( q < 255 && origin + q * scale < value ) ++q;
+
+		return static_cast<unsigned char>( q );
+	}
+
+	/* slab test of all children of the compressed node, returns the number of hit children sorted front to back */
+	inline int IntersectChildren( const QuantizedBvhNode & node, const Ray & ray, const Vector3 & inv_direction,
+		float t_entry[4], int order[4] )
+	{
+		float scale[3];
+		float offset[3];
+
+		for ( int a = 0; a < 3; ++a )
+		{
+			scale[a] = PowerOfTwo( node.exponent[a] );
+			offset[a] = node.origin[a] - ray.origin.data[a];
+		}
+
+		int no_hits = 0;
+
+		for ( int c = 0; c < node.no_children; ++c )
+		{
+			float t0 = ray.t_near;
+			float t1 = ray.t_far;
+
+			float t_near = ( node.lower_x[c] * scale[0] + offset[0] ) * inv_direction.x;
+			float t_far = ( node.upper_x[c] * scale[0] + offset[0] ) * inv_direction.x;
+			if ( t_near > t_far ) utils::swap( t_near, t_far );
+			t0 = ( t_near > t0 ) ? t_near : t0;
+			t1 = ( t_far < t1 ) ? t_far : t1;
+
+			t_near = ( node.lower_y[c] * scale[1] + offset[1] ) * inv_direction.y;
+			t_far = ( node.upper_y[c] * scale[1] + offset[1] ) * inv_direction.y;
+			if ( t_near > t_far ) utils::swap( t_near, t_far );
+			t0 = ( t_near > t0 ) ? t_near : t0;
+			t1 = ( t_far < t1 ) ? t_far : t1;
+
+			t_near = ( node.lower_z[c] * scale[2] + offset[2] ) * inv_direction.z;
+			t_far = ( node.upper_z[c] * scale[2] + offset[2] ) * inv_direction.z;
+			if ( t_near > t_far ) utils::swap( t_near, t_far );
+			t0 = ( t_near > t0 ) ? t_near : t0;
+			t1 = ( t_far < t1 ) ? t_far : t1;
+
+			if ( t0 > t1 ) continue;
+
+			// insertion sort, there are four children at most
+			int k = no_hits++;
+
+			for ( ; k > 0 && t_entry[k - 1] > t0; --k )
+			{
+				t_entry[k] = t_entry[k - 1];
+				order[k] = order[k - 1];
+			}
+
+			t_entry[k] = t0;
+			order[k] = c;
+		}
+
+		return no_hits;
+	}
+
+	/* the part of Bvh::IntersectTriangle shared by all rays of the packet is computed here rather than in the kernel units
+	built with /arch:AVX2 and above, where it might be contracted into FMAs and differ from single rays */
+	void IntersectPacketTriangle( const SimdKernels & kernels, const Vector3 & p0, const Vector3 & e1, const Vector3 & e2,
+		const int triangle_id, RayPacket & packet, const RayMask mask )
+	{
+		const Vector3 s = packet.origin - p0;
+		const Vector3 q = s.CrossProduct( e1 );
+
+		kernels.intersect_triangle( e1.data, e2.data, s.data, q.data, q.DotProduct( e2 ), triangle_id, packet, mask );
+	}
+}
+
+void Bvh::Build( const SceneGeometry & geometry, const BvhSettings & settings )
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	geometry_ = &geometry;
+	settings_ = settings;
+
+	const int no_triangles = geometry.no_triangles();
+
+	std::vector<BuildPrimitive> references( no_triangles );
+
+	for ( int i = 0; i < no_triangles; ++i )
+	{
+		references[i].bounds = geometry.bounds( i );
+		references[i].centroid = references[i].bounds.centroid();
+		references[i].index = i;
+	}
+
+	nodes_.clear();
+	indices_.clear();
+	refit_order_.clear();
+	level_offsets_.clear();
+	quantized_nodes_.clear();
+	nodes_.reserve( 2 * no_triangles );
+	indices_.reserve( no_triangles );
+
+	root_area_ = geometry.bounds().area();
+	no_build_references_ = no_triangles;
+	max_build_references_ = static_cast<int>( settings.memory_growth * no_triangles );
+
+	if ( no_triangles > 0 )
+	{
+		BuildNode( references, 0 );
+	}
+
+	if ( settings.quantized_nodes )
+	{
+		Compress();
+	}
+
+	PrecomputeTriangles();
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	build_time_ = std::chrono::duration<double>( t1 - t0 ).count();
+	build_sah_cost_ = sah_cost();
+
+	if ( settings.verbose ) printf( "%s%s (%d triangles, %d references, %d nodes, %0.1f MB, SAH %0.1f) built in %s.\n",
+		( settings.spatial_splits ) ? "SBVH" : "BVH", ( settings.quantized_nodes ) ? " (quantized)" : "",
+		no_triangles, no_references(), no_nodes(), memory_footprint() / ( 1024.0f * 1024.0f ), build_sah_cost_,
+		TimeToString( build_time_ ).c_str() );
+}
+
+void Bvh::Refit( const SceneGeometry & geometry )
+{
+	geometry_ = &geometry;
+
+	if ( nodes_.empty() ) return;
+
+	if ( refit_order_.empty() )
+	{
+		// children always follow their parent so depths are resolved in a single pass
+		std::vector<int> depths( nodes_.size(), 0 );
+		int max_depth = 0;
+
+		for ( int i = 0; i < no_nodes(); ++i )
+		{
+			max_depth = max( max_depth, depths[i] );
+
+			if ( !nodes_[i].is_leaf() )
+			{
+				depths[i + 1] = depths[nodes_[i].offset] = depths[i] + 1;
+			}
+		}
+
+		level_offsets_.assign( max_depth + 2, 0 );
+
+		for ( const int depth : depths ) ++level_offsets_[depth + 1];
+		for ( int l = 0; l <= max_depth; ++l ) level_offsets_[l + 1] += level_offsets_[l];
+
+		refit_order_.resize( nodes_.size() );
+		std::vector<int> positions( level_offsets_.begin(), level_offsets_.end() - 1 );
+
+		for ( int i = 0; i < no_nodes(); ++i ) refit_order_[positions[depths[i]]++] = i;
+	}
+
+	// the deepest level first, nodes of a single level are independent
+	for ( int l = static_cast<int>( level_offsets_.size() ) - 2; l >= 0; --l )
+	{
+		const int begin = level_offsets_[l];
+		const int end = level_offsets_[l + 1];
+
+#pragma omp parallel for schedule( static ) if ( end - begin > 256 )
+		for ( int k = begin; k < end; ++k )
+		{
+			BvhNode & node = nodes_[refit_order_[k]];
+			AABB bounds;
+
+			if ( node.is_leaf() )
+			{
+				// spatial splits clipped the references, after a motion the whole triangles have to be enclosed
+				for ( int j = node.offset; j < node.offset + node.count; ++j )
+				{
+					bounds.merge( geometry.bounds( indices_[j] ) );
+				}
+			}
+			else
+			{
+				bounds = nodes_[refit_order_[k] + 1].bounds;
+				bounds.merge( nodes_[node.offset].bounds );
+			}
+
+			node.bounds = bounds;
+		}
+	}
+
+	if ( settings_.quantized_nodes )
+	{
+		Compress();
+	}
+
+	PrecomputeTriangles();
+}
+
+void Bvh::Compress()
+{
+	quantized_nodes_.clear();
+	quantized_nodes_.reserve( nodes_.size() / 2 + 1 );
+
+	if ( !nodes_.empty() )
+	{
+		CompressNode( 0 );
+	}
+}
+
+int Bvh::CompressNode( const int node_index )
+{
+	const BvhNode & node = nodes_[node_index];
+
+	// collapse the binary subtree by opening the largest interior child until there are four children
+	int children[4] = { node_index };
+	int no_children = 1;
+
+	if ( !node.is_leaf() )
+	{
+		children[0] = node_index + 1;
+		children[1] = node.offset;
+		no_children = 2;
+
+		while ( no_children < 4 )
+		{
+			int largest = -1;
+			float largest_area = -1.0f;
+
+			for ( int c = 0; c < no_children; ++c )
+			{
+				const BvhNode & child = nodes_[children[c]];
+
+				if ( !child.is_leaf() && child.bounds.area() > largest_area )
+				{
+					largest = c;
+					largest_area = child.bounds.area();
+				}
+			}
+
+			if ( largest < 0 ) break;
+
+			const int opened = children[largest];
+			children[largest] = opened + 1;
+			children[no_children++] = nodes_[opened].offset;
+		}
+	}
+
+	QuantizedBvhNode q;
+	memset( &q, 0, sizeof( q ) );
+	q.no_children = static_cast<unsigned char>( no_children );
+
+	float scale[3];
+
+	for ( int a = 0; a < 3; ++a )
+	{
+		// the smallest power of two grid spanning the node box with 255 steps
+		const float origin = node.bounds.lower.data[a];
+		const float upper = node.bounds.upper.data[a];
+		int exponent = 0;
+		frexpf( ( upper - origin ) / 255.0f, &exponent );
+		exponent = clamp( exponent, -126, 127 );
+
+		while ( exponent < 127 && origin + 255.0f * PowerOfTwo( exponent ) < upper ) ++exponent;
+
+		q.origin[a] = origin;
+		q.exponent[a] = static_cast<signed char>( exponent );
+		scale[a] = PowerOfTwo( exponent );
+	}
+
+	for ( int c = 0; c < no_children; ++c )
+	{
+		const BvhNode & child = nodes_[children[c]];
+
+		q.lower_x[c] = QuantizeLower( child.bounds.lower.x, q.origin[0], scale[0] );
+		q.lower_y[c] = QuantizeLower( child.bounds.lower.y, q.origin[1], scale[1] );
+		q.lower_z[c] = QuantizeLower( child.bounds.lower.z, q.origin[2], scale[2] );
+		q.upper_x[c] = QuantizeUpper( child.bounds.upper.x, q.origin[0], scale[0] );
+		q.upper_y[c] = QuantizeUpper( child.bounds.upper.y, q.origin[1], scale[1] );
+		q.upper_z[c] = QuantizeUpper( child.bounds.upper.z, q.origin[2], scale[2] );
+
+		if ( child.is_leaf() )
+		{
+			q.child[c] = child.offset;
+			q.count[c] = static_cast<unsigned char>( child.count );
+		}
+	}
+
+	// children are appended depth-first after their parent, the vector may reallocate meanwhile
+	const int quantized_index = static_cast<int>( quantized_nodes_.size() );
+	quantized_nodes_.push_back( q );
+
+	for ( int c = 0; c < no_children; ++c )
+	{
+		if ( !nodes_[children[c]].is_leaf() )
+		{
+			const int child_index = CompressNode( children[c] );
+			quantized_nodes_[quantized_index].child[c] = child_index;
+		}
+	}
+
+	return quantized_index;
+}
+
+int Bvh::BuildNode( std::vector<BuildPrimitive> & references, const int depth )
+{
+	// the vector may reallocate during the recursion so the node is referred by its index only
+	const int node_index = static_cast<int>( nodes_.size() );
+	nodes_.push_back( BvhNode() );
+
+	AABB bounds;
+	AABB centroid_bounds;
+
+	for ( const BuildPrimitive & reference : references )
+	{
+		bounds.merge( reference.bounds );
+		centroid_bounds.merge( reference.centroid );
+	}
+
+	nodes_[node_index].bounds = bounds;
+
+	const int count = static_cast<int>( references.size() );
+
+	std::vector<BuildPrimitive> left;
+	std::vector<BuildPrimitive> right;
+	int axis = centroid_bounds.longest_axis();
+
+	if ( count > 1 && depth < kMaxSahDepth )
+	{
+		const Split object_split = FindObjectSplit( references, centroid_bounds );
+		Split spatial_split;
+
+		if ( settings_.spatial_splits && no_build_references_ < max_build_references_ )
+		{
+			// spatial splits pay off only where children of the object split overlap noticeably
+			const float overlap = object_split.left.intersection( object_split.right ).area();
+
+			if ( object_split.bin < 0 || overlap > settings_.overlap_threshold * root_area_ )
+			{
+				spatial_split = FindSpatialSplit( references, bounds );
+			}
+		}
+
+		const float best_cost = min( object_split.cost, spatial_split.cost );
+		const float leaf_cost = kIntersectionCost * count;
+		const float split_cost = kTraversalCost + kIntersectionCost * best_cost / bounds.area();
+
+		if ( best_cost < FLT_MAX && ( count > kMaxLeafSize || split_cost < leaf_cost ) )
+		{
+			if ( spatial_split.cost < object_split.cost )
+			{
+				PerformSpatialSplit( references, spatial_split, left, right );
+				axis = spatial_split.axis;
+			}
+			else
+			{
+				const float c_min = centroid_bounds.lower.data[object_split.axis];
+				const float k = kNoBins * ( 1.0f - 1e-4f ) / ( centroid_bounds.upper.data[object_split.axis] - c_min );
+
+				for ( const BuildPrimitive & reference : references )
+				{
+					const int b = min( kNoBins - 1, int( k * ( reference.centroid.data[object_split.axis] - c_min ) ) );
+					( ( b < object_split.bin ) ? left : right ).push_back( reference );
+				}
+
+				axis = object_split.axis;
+			}
+		}
+	}
+
+	if ( left.empty() || right.empty() )
+	{
+		left.clear();
+		right.clear();
+
+		if ( count > kMaxLeafSize )
+		{
+			// degenerate centroids or too deep tree, fall back to the object median
+			const int mid = count / 2;
+			std::nth_element( references.begin(), references.begin() + mid, references.end(),
+				[axis]( const BuildPrimitive & a, const BuildPrimitive & b ) { return a.centroid.data[axis] < b.centroid.data[axis]; } );
+
+			left.assign( references.begin(), references.begin() + mid );
+			right.assign( references.begin() + mid, references.end() );
+		}
+	}
+
+	if ( left.empty() )
+	{
+		// leaf
+		nodes_[node_index].offset = static_cast<int>( indices_.size() );
+		nodes_[node_index].count = static_cast<unsigned short>( count );
+
+		for ( const BuildPrimitive & reference : references )
+		{
+			indices_.push_back( reference.index );
+		}
+	}
+	else
+	{
+		std::vector<BuildPrimitive>().swap( references ); // release the memory before going deeper
+
+		BuildNode( left, depth + 1 );
+		const int second = BuildNode( right, depth + 1 );
+		nodes_[node_index].offset = second;
+		nodes_[node_index].axis = static_cast<unsigned short>( axis );
+	}
+
+	return node_index;
+}
+
+Bvh::Split Bvh::FindObjectSplit( const std::vector<BuildPrimitive> & references, const AABB & centroid_bounds ) const
+{
+	// binned SAH along the longest axis of centroid bounds
+	Split split;
+	split.axis = centroid_bounds.longest_axis();
+
+	const float c_min = centroid_bounds.lower.data[split.axis];
+	const float c_extent = centroid_bounds.upper.data[split.axis] - c_min;
+
+	if ( !( c_extent > 0.0f ) ) return split;
+
+	int bin_counts[kNoBins] = { 0 };
+	AABB bin_bounds[kNoBins];
+
+	const float k = kNoBins * ( 1.0f - 1e-4f ) / c_extent;
+
+	for ( const BuildPrimitive & reference : references )
+	{
+		const int b = min( kNoBins - 1, int( k * ( reference.centroid.data[split.axis] - c_min ) ) );
+		++bin_counts[b];
+		bin_bounds[b].merge( reference.bounds );
+	}
+
+	// sweep from the right to get areas of all right-hand side candidates
+	AABB right_bounds[kNoBins];
+	int right_counts[kNoBins];
+	AABB right;
+	int right_count = 0;
+
+	for ( int b = kNoBins - 1; b > 0; --b )
+	{
+		right.merge( bin_bounds[b] );
+		right_count += bin_counts[b];
+		right_bounds[b] = right;
+		right_counts[b] = right_count;
+	}
+
+	AABB left;
+	int left_count = 0;
+
+	for ( int b = 1; b < kNoBins; ++b )
+	{
+		left.merge( bin_bounds[b - 1] );
+		left_count += bin_counts[b - 1];
+
+		if ( left_count == 0 || right_counts[b] == 0 ) continue;
+
+		const float cost = left.area() * left_count + right_bounds[b].area() * right_counts[b];
+
+		if ( cost < split.cost )
+		{
+			split.cost = cost;
+			split.bin = b;
+			split.left = left;
+			split.right = right_bounds[b];
+			split.left_count = left_count;
+			split.right_count = right_counts[b];
+		}
+	}
+
+	return split;
+}
+
+Bvh::Split Bvh::FindSpatialSplit( const std::vector<BuildPrimitive> & references, const AABB & bounds ) const
+{
+	Split split;
+
+	for ( int axis = 0; axis < 3; ++axis )
+	{
+		const float b_min = bounds.lower.data[axis];
+		const float b_extent = bounds.upper.data[axis] - b_min;
+
+		if ( !( b_extent > 0.0f ) ) continue;
+
+		const float k = kNoSpatialBins / b_extent;
+		const float bin_width = b_extent / kNoSpatialBins;
+
+		AABB bin_bounds[kNoSpatialBins];
+		int entries[kNoSpatialBins] = { 0 };
+		int exits[kNoSpatialBins] = { 0 };
+
+		for ( const BuildPrimitive & reference : references )
+		{
+			const int first = max( 0, min( kNoSpatialBins - 1, int( k * ( reference.bounds.lower.data[axis] - b_min ) ) ) );
+			const int last = max( first, min( kNoSpatialBins - 1, int( k * ( reference.bounds.upper.data[axis] - b_min ) ) ) );
+
+			// chop the triangle into all bins it spans
+			BuildPrimitive rest = reference;
+
+			for ( int b = first; b < last; ++b )
+			{
+				AABB left, right;
+				SplitReference( rest, axis, b_min + ( b + 1 ) * bin_width, left, right );
+				bin_bounds[b].merge( left );
+				rest.bounds = right;
+			}
+
+			bin_bounds[last].merge( rest.bounds );
+			++entries[first];
+			++exits[last];
+		}
+
+		AABB right_bounds[kNoSpatialBins];
+		int right_counts[kNoSpatialBins];
+		AABB right;
+		int right_count = 0;
+
+		for ( int b = kNoSpatialBins - 1; b > 0; --b )
+		{
+			right.merge( bin_bounds[b] );
+			right_count += exits[b];
+			right_bounds[b] = right;
+			right_counts[b] = right_count;
+		}
+
+		AABB left;
+		int left_count = 0;
+
+		for ( int b = 1; b < kNoSpatialBins; ++b )
+		{
+			left.merge( bin_bounds[b - 1] );
+			left_count += entries[b - 1];
+
+			if ( left_count == 0 || right_counts[b] == 0 ) continue;
+
+			const float cost = left.area() * left_count + right_bounds[b].area() * right_counts[b];
+
+			if ( cost < split.cost )
+			{
+				split.cost = cost;
+				split.axis = axis;
+				split.bin = b;
+				split.position = b_min + b * bin_width;
+				split.left = left;
+				split.right = right_bounds[b];
+				split.left_count = left_count;
+				split.right_count = right_counts[b];
+			}
+		}
+	}
+
+	return split;
+}
+
+void Bvh::PerformSpatialSplit( std::vector<BuildPrimitive> & references, const Split & split,
+	std::vector<BuildPrimitive> & left, std::vector<BuildPrimitive> & right )
+{
+	const int axis = split.axis;
+	const float position = split.position;
+
+	AABB left_bounds = split.left;
+	AABB right_bounds = split.right;
+	int left_count = split.left_count;
+	int right_count = split.right_count;
+
+	for ( const BuildPrimitive & reference : references )
+	{
+		if ( reference.bounds.upper.data[axis] <= position )
+		{
+			left.push_back( reference );
+			continue;
+		}
+
+		if ( reference.bounds.lower.data[axis] >= position )
+		{
+			right.push_back( reference );
+			continue;
+		}
+
+		// straddling reference, consider keeping it whole on one side instead of splitting it (reference unsplitting)
+		AABB l, r;
+		SplitReference( reference, axis, position, l, r );
+
+		AABB left_union = left_bounds;
+		left_union.merge( reference.bounds );
+		AABB right_union = right_bounds;
+		right_union.merge( reference.bounds );
+
+		const float split_cost = left_bounds.area() * left_count + right_bounds.area() * right_count;
+		const float left_cost = left_union.area() * left_count + right_bounds.area() * ( right_count - 1 );
+		const float right_cost = left_bounds.area() * ( left_count - 1 ) + right_union.area() * right_count;
+
+		if ( r.is_empty() || ( !l.is_empty() && left_cost < split_cost && left_cost <= right_cost ) )
+		{
+			left.push_back( reference );
+			left_bounds = left_union;
+			--right_count;
+		}
+		else if ( l.is_empty() || right_cost < split_cost )
+		{
+			right.push_back( reference );
+			right_bounds = right_union;
+			--left_count;
+		}
+		else
+		{
+			BuildPrimitive part = reference;
+			part.bounds = l;
+			part.centroid = l.centroid();
+			left.push_back( part );
+
+			part.bounds = r;
+			part.centroid = r.centroid();
+			right.push_back( part );
+
+			++no_build_references_;
+		}
+	}
+}
+
+void Bvh::SplitReference( const BuildPrimitive & reference, const int axis, const float position, AABB & left, AABB & right ) const
+{
+	left = AABB();
+	right = AABB();
+
+	// clip all triangle edges by the plane
+	for ( int j = 0; j < 3; ++j )
+	{
+		const Vector3 v0 = geometry_->position( reference.index, j );
+		const Vector3 v1 = geometry_->position( reference.index, ( j + 1 ) % 3 );
+		const float p0 = v0.data[axis];
+		const float p1 = v1.data[axis];
+
+		if ( p0 <= position ) left.merge( v0 );
+		if ( p0 >= position ) right.merge( v0 );
+
+		if ( ( p0 < position && p1 > position ) || ( p0 > position && p1 < position ) )
+		{
+			Vector3 q = v0 + ( v1 - v0 ) * ( ( position - p0 ) / ( p1 - p0 ) );
+			q.data[axis] = position;
+			left.merge( q );
+			right.merge( q );
+		}
+	}
+
+	// the reference may already be a clipped part of the triangle
+	left = left.intersection( reference.bounds );
+	right = right.intersection( reference.bounds );
+}
+
+void Bvh::PrecomputeTriangles()
+{
+	edge_triangles_.clear();
+	woop_triangles_.clear();
+
+	const int no_references = static_cast<int>( indices_.size() );
+
+	if ( settings_.triangle_layout == TriangleLayout::EDGES )
+	{
+		edge_triangles_.resize( no_references );
+
+#pragma omp parallel for schedule( static ) if ( no_references > 4096 )
+		for ( int r = 0; r < no_references; ++r )
+		{
+			const int i = indices_[r];
+			const Vector3 p0 = geometry_->position( i, 0 );
+
+			edge_triangles_[r] = EdgeTriangle{ p0, geometry_->position( i, 1 ) - p0, geometry_->position( i, 2 ) - p0 };
+		}
+	}
+	else if ( settings_.triangle_layout == TriangleLayout::WOOP )
+	{
+		woop_triangles_.resize( no_references );
+
+#pragma omp parallel for schedule( static ) if ( no_references > 4096 )
+		for ( int r = 0; r < no_references; ++r )
+		{
+			const int i = indices_[r];
+			const Vector3 p0 = geometry_->position( i, 0 );
+			const Vector3 e1 = geometry_->position( i, 1 ) - p0;
+			const Vector3 e2 = geometry_->position( i, 2 ) - p0;
+			const Vector3 n = e1.CrossProduct( e2 );
+			const float det = n.DotProduct( n ); // determinant of the matrix with columns e1, e2 and n
+
+			WoopTriangle & w = woop_triangles_[r];
+
+			if ( det == 0.0f )
+			{
+				// a degenerate triangle, the plane test never passes
+				w = WoopTriangle{ { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+				continue;
+			}
+
+			// rows of the inverse of the matrix with columns e1, e2 and n
+			const Vector3 rows[3] = { e2.CrossProduct( n ) / det, n.CrossProduct( e1 ) / det, n / det };
+
+			for ( int k = 0; k < 3; ++k )
+			{
+				w.m[k][0] = rows[k].x;
+				w.m[k][1] = rows[k].y;
+				w.m[k][2] = rows[k].z;
+				w.m[k][3] = -rows[k].DotProduct( p0 );
+			}
+		}
+	}
+}
+
+bool Bvh::IntersectTriangle( const int r, const Ray & ray, float & t, float & u, float & v ) const
+{
+	if ( settings_.triangle_layout == TriangleLayout::WOOP ) return IntersectWoop( r, ray, t, u, v );
+
+	// Moller-Trumbore
+	Vector3 p0, e1, e2;
+
+	if ( settings_.triangle_layout == TriangleLayout::EDGES )
+	{
+		const EdgeTriangle & triangle = edge_triangles_[r];
+		p0 = triangle.p0;
+		e1 = triangle.e1;
+		e2 = triangle.e2;
+	}
+	else
+	{
+		const int i = indices_[r];
+		p0 = geometry_->position( i, 0 );
+		e1 = geometry_->position( i, 1 ) - p0;
+		e2 = geometry_->position( i, 2 ) - p0;
+	}
+
+	const Vector3 p = ray.direction.CrossProduct( e2 );
+	const float det = e1.DotProduct( p );
+
+	if ( det == 0.0f ) return false;
+
+	const float inv_det = 1.0f / det;
+	const Vector3 s = ray.origin - p0;
+
+	u = s.DotProduct( p ) * inv_det;
+	if ( u < 0.0f || u > 1.0f ) return false;
+
+	const Vector3 q = s.CrossProduct( e1 );
+
+	v = ray.direction.DotProduct( q ) * inv_det;
+	if ( v < 0.0f || u + v > 1.0f ) return false;
+
+	t = e2.DotProduct( q ) * inv_det;
+
+	return ( t > ray.t_near ) && ( t < ray.t_far );
+}
+
+bool Bvh::IntersectWoop( const int r, const Ray & ray, float & t, float & u, float & v ) const
+{
+	const WoopTriangle & w = woop_triangles_[r];
+	const Vector3 & o = ray.origin;
+	const Vector3 & d = ray.direction;
+
+	// the plane first, rays parallel to it give t = inf or nan and fail the interval test
+	const float o_z = w.m[2][0] * o.x + w.m[2][1] * o.y + w.m[2][2] * o.z + w.m[2][3];
+	const float d_z = w.m[2][0] * d.x + w.m[2][1] * d.y + w.m[2][2] * d.z;
+	t = -o_z / d_z;
+
+	if ( !( t > ray.t_near && t < ray.t_far ) ) return false;
+
+	const Vector3 h = ray.point( t );
+
+	u = w.m[0][0] * h.x + w.m[0][1] * h.y + w.m[0][2] * h.z + w.m[0][3];
+	if ( u < 0.0f || u > 1.0f ) return false;
+
+	v = w.m[1][0] * h.x + w.m[1][1] * h.y + w.m[1][2] * h.z + w.m[1][3];
+
+	return ( v >= 0.0f ) && ( u + v <= 1.0f );
+}
+
+bool Bvh::OccludedTriangle( const int r, const Ray & ray ) const
+{
+	if ( settings_.triangle_layout == TriangleLayout::WOOP )
+	{
+		float t, u, v;
+
+		return IntersectWoop( r, ray, t, u, v );
+	}
+
+	// Moller-Trumbore without the division, the interval tests are scaled by the determinant instead
+	Vector3 p0, e1, e2;
+
+	if ( settings_.triangle_layout == TriangleLayout::EDGES )
+	{
+		const EdgeTriangle & triangle = edge_triangles_[r];
+		p0 = triangle.p0;
+		e1 = triangle.e1;
+		e2 = triangle.e2;
+	}
+	else
+	{
+		const int i = indices_[r];
+		p0 = geometry_->position( i, 0 );
+		e1 = geometry_->position( i, 1 ) - p0;
+		e2 = geometry_->position( i, 2 ) - p0;
+	}
+
+	const Vector3 p = ray.direction.CrossProduct( e2 );
+	const float det = e1.DotProduct( p );
+
+	if ( det == 0.0f ) return false;
+
+	const float sign = ( det > 0.0f ) ? 1.0f : -1.0f;
+	const float abs_det = det * sign;
+	const Vector3 s = ray.origin - p0;
+
+	const float u = s.DotProduct( p ) * sign;
+	if ( u < 0.0f || u > abs_det ) return false;
+
+	const Vector3 q = s.CrossProduct( e1 );
+
+	const float v = ray.direction.DotProduct( q ) * sign;
+	if ( v < 0.0f || u + v > abs_det ) return false;
+
+	const float t = e2.DotProduct( q ) * sign;
+
+	return ( t > ray.t_near * abs_det ) && ( t < ray.t_far * abs_det );
+}
+
+bool Bvh::Intersect( Ray & ray, RayHit & hit ) const
+{
+	if ( nodes_.empty() ) return false;
+
+	if ( settings_.quantized_nodes ) return IntersectQuantized( ray, hit );
+
+	return IntersectSubtree( 0, ray, hit );
+}
+
+bool Bvh::IntersectSubtree( const int root, Ray & ray, RayHit & hit ) const
+{
+	const Vector3 inv_direction = ray.inv_direction();
+
+	int stack[kStackSize];
+	int top = 0;
+	stack[top++] = root;
+
+	bool found = false;
+
+	while ( top > 0 )
+	{
+		const int node_index = stack[--top];
+		const BvhNode & node = nodes_[node_index];
+
+		float t0 = ray.t_near;
+		float t1 = ray.t_far;
+
+		if ( !node.bounds.intersect( ray.origin, inv_direction, t0, t1 ) ) continue;
+
+		if ( node.is_leaf() )
+		{
+			for ( int k = 0; k < node.count; ++k )
+			{
+				const int i = indices_[node.offset + k];
+				float t, u, v;
+
+				if ( IntersectTriangle( node.offset + k, ray, t, u, v ) )
+				{
+					ray.t_far = t;
+					hit.triangle_id = i;
+					hit.u = u;
+					hit.v = v;
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			// visit the child closer to the ray origin first
+			int near_child = node_index + 1;
+			int far_child = node.offset;
+
+			if ( ray.direction.data[node.axis] < 0.0f ) utils::swap( near_child, far_child );
+
+			stack[top++] = far_child;
+			stack[top++] = near_child;
+		}
+	}
+
+	return found;
+}
+
+bool Bvh::Occluded( const Ray & ray ) const
+{
+	if ( nodes_.empty() ) return false;
+
+	if ( settings_.quantized_nodes ) return OccludedQuantized( ray );
+
+	return OccludedSubtree( 0, ray );
+}
+
+bool Bvh::OccludedSubtree( const int root, const Ray & ray ) const
+{
+	const Vector3 inv_direction = ray.inv_direction();
+
+	int stack[kStackSize];
+	int top = 0;
+	stack[top++] = root;
+
+	while ( top > 0 )
+	{
+		const int node_index = stack[--top];
+		const BvhNode & node = nodes_[node_index];
+
+		float t0 = ray.t_near;
+		float t1 = ray.t_far;
+
+		if ( !node.bounds.intersect( ray.origin, inv_direction, t0, t1 ) ) continue;
+
+		if ( node.is_leaf() )
+		{
+			for ( int k = 0; k < node.count; ++k )
+			{
+				if ( OccludedTriangle( node.offset + k, ray ) ) return true;
+			}
+		}
+		else
+		{
+			// nearer geometry is more likely to occlude the ray, so the closer child goes first here as well
+			int near_child = node_index + 1;
+			int far_child = node.offset;
+
+			if ( ray.direction.data[node.axis] < 0.0f ) utils::swap( near_child, far_child );
+
+			stack[top++] = far_child;
+			stack[top++] = near_child;
+		}
+	}
+
+	return false;
+}
+
+bool Bvh::IsOutsideFrustum( const AABB & bounds, const RayPacket & packet ) const
+{
+	for ( int i = 0; i < 4; ++i )
+	{
+		const Vector3 & n = packet.frustum[i];
+
+		// the box corner lying farthest along the plane normal
+		const Vector3 p( ( n.x >= 0.0f ) ? bounds.upper.x : bounds.lower.x,
+			( n.y >= 0.0f ) ? bounds.upper.y : bounds.lower.y,
+			( n.z >= 0.0f ) ? bounds.upper.z : bounds.lower.z );
+
+		if ( n.DotProduct( p - packet.origin ) < 0.0f ) return true;
+	}
+
+	return false;
+}
+
+void Bvh::IntersectPacket( RayPacket & packet ) const
+{
+	if ( nodes_.empty() || packet.no_rays == 0 ) return;
+
+	const SimdKernels & kernels = simd_kernels();
+
+	struct Entry
+	{
+		int node_index;
+		RayMask mask;
+	};
+
+	Entry stack[kStackSize];
+	int top = 0;
+	stack[top++] = Entry{ 0, ( packet.no_rays == RayPacket::kSize ) ? ~RayMask( 0 ) : ( ( RayMask( 1 ) << packet.no_rays ) - 1 ) };
+
+	while ( top > 0 )
+	{
+		const Entry entry = stack[--top];
+		const BvhNode & node = nodes_[entry.node_index];
+
+		if ( packet.has_frustum && IsOutsideFrustum( node.bounds, packet ) ) continue;
+
+		const RayMask mask = kernels.intersect_box( node.bounds.lower.data, node.bounds.upper.data, packet.origin.data, packet, entry.mask );
+
+		if ( mask == 0 ) continue;
+
+		if ( !node.is_leaf() && static_cast<int>( std::bitset<64>( mask ).count() ) < kMinActiveRays )
+		{
+			// the packet has diverged, finish the subtree ray by ray
+			for ( int i = 0; i < packet.no_rays; ++i )
+			{
+				if ( ( mask >> i ) & 1 )
+				{
+					Ray ray = packet.ray( i );
+					RayHit hit = packet.hit( i );
+
+					if ( IntersectSubtree( entry.node_index, ray, hit ) )
+					{
+						packet.t_far[i] = ray.t_far;
+						packet.triangle_id[i] = hit.triangle_id;
+						packet.u[i] = hit.u;
+						packet.v[i] = hit.v;
+					}
+				}
+			}
+
+			continue;
+		}
+
+		if ( node.is_leaf() )
+		{
+			for ( int k = 0; k < node.count; ++k )
+			{
+				const int j = indices_[node.offset + k];
+
+				if ( settings_.triangle_layout == TriangleLayout::EDGES )
+				{
+					const EdgeTriangle & triangle = edge_triangles_[node.offset + k];
+					IntersectPacketTriangle( kernels, triangle.p0, triangle.e1, triangle.e2, j, packet, mask );
+				}
+				else
+				{
+					const Vector3 p0 = geometry_->position( j, 0 );
+					IntersectPacketTriangle( kernels, p0, geometry_->position( j, 1 ) - p0, geometry_->position( j, 2 ) - p0, j, packet, mask );
+				}
+			}
+		}
+		else
+		{
+			// order children by the direction of the first active ray
+			int first = 0;
+			while ( ( ( mask >> first ) & 1 ) == 0 ) ++first;
+
+			const float d[3] = { packet.dir_x[first], packet.dir_y[first], packet.dir_z[first] };
+
+			int near_child = entry.node_index + 1;
+			int far_child = node.offset;
+
+			if ( d[node.axis] < 0.0f ) utils::swap( near_child, far_child );
+
+			stack[top++] = Entry{ far_child, mask };
+			stack[top++] = Entry{ near_child, mask };
+		}
+	}
+}
+
+void Bvh::OccludedPacket( RayPacket & packet ) const
+{
+	if ( nodes_.empty() || packet.no_rays == 0 ) return;
+
+	const SimdKernels & kernels = simd_kernels();
+
+	struct Entry
+	{
+		int node_index;
+		RayMask mask;
+	};
+
+	Entry stack[kStackSize];
+	int top = 0;
+	stack[top++] = Entry{ 0, ( packet.no_rays == RayPacket::kSize ) ? ~RayMask( 0 ) : ( ( RayMask( 1 ) << packet.no_rays ) - 1 ) };
+	RayMask occluded = 0;
+
+	while ( top > 0 )
+	{
+		const Entry entry = stack[--top];
+		const BvhNode & node = nodes_[entry.node_index];
+
+		// rays occluded meanwhile are dropped from the entries pushed before
+		const RayMask active = entry.mask & ~occluded;
+		if ( active == 0 ) continue;
+
+		if ( packet.has_frustum && IsOutsideFrustum( node.bounds, packet ) ) continue;
+
+		const RayMask mask = kernels.intersect_box( node.bounds.lower.data, node.bounds.upper.data, packet.origin.data, packet, active );
+
+		if ( mask == 0 ) continue;
+
+		if ( !node.is_leaf() && static_cast<int>( std::bitset<64>( mask ).count() ) < kMinActiveRays )
+		{
+			for ( int i = 0; i < packet.no_rays; ++i )
+			{
+				if ( ( ( mask >> i ) & 1 ) && OccludedSubtree( entry.node_index, packet.ray( i ) ) )
+				{
+					packet.triangle_id[i] = 0;
+					occluded |= RayMask( 1 ) << i;
+				}
+			}
+
+			continue;
+		}
+
+		if ( node.is_leaf() )
+		{
+			for ( int k = 0; k < node.count; ++k )
+			{
+				const int j = indices_[node.offset + k];
+
+				if ( settings_.triangle_layout == TriangleLayout::EDGES )
+				{
+					const EdgeTriangle & triangle = edge_triangles_[node.offset + k];
+					IntersectPacketTriangle( kernels, triangle.p0, triangle.e1, triangle.e2, j, packet, mask );
+				}
+				else
+				{
+					const Vector3 p0 = geometry_->position( j, 0 );
+					IntersectPacketTriangle( kernels, p0, geometry_->position( j, 1 ) - p0, geometry_->position( j, 2 ) - p0, j, packet, mask );
+				}
+			}
+
+			for ( int i = 0; i < packet.no_rays; ++i )
+			{
+				if ( ( ( mask >> i ) & 1 ) && packet.triangle_id[i] >= 0 ) occluded |= RayMask( 1 ) << i;
+			}
+		}
+		else
+		{
+			int first = 0;
+			while ( ( ( mask >> first ) & 1 ) == 0 ) ++first;
+
+			const float d[3] = { packet.dir_x[first], packet.dir_y[first], packet.dir_z[first] };
+
+			int near_child = entry.node_index + 1;
+			int far_child = node.offset;
+
+			if ( d[node.axis] < 0.0f ) utils::swap( near_child, far_child );
+
+			stack[top++] = Entry{ far_child, mask };
+			stack[top++] = Entry{ near_child, mask };
+		}
+	}
+}
+
+bool Bvh::IntersectQuantized( Ray & ray, RayHit & hit ) const
+{
+	const Vector3 inv_direction = ray.inv_direction();
+
+	struct Entry
+	{
+		int node_index;
+		float t_entry;
+	};
+
+	Entry stack[kStackSize];
+	int top = 0;
+	stack[top++] = Entry{ 0, ray.t_near };
+
+	bool found = false;
+
+	while ( top > 0 )
+	{
+		const Entry entry = stack[--top];
+
+		// the ray may have been shortened since the node was pushed
+		if ( entry.t_entry > ray.t_far ) continue;
+
+		const QuantizedBvhNode & node = quantized_nodes_[entry.node_index];
+
+		float t_entry[4];
+		int order[4];
+		const int no_hits = IntersectChildren( node, ray, inv_direction, t_entry, order );
+
+		// leaves are intersected right away front to back, interior children are pushed back to front
+		for ( int k = 0; k < no_hits; ++k )
+		{
+			const int c = order[k];
+
+			if ( node.count[c] == 0 || t_entry[k] > ray.t_far ) continue;
+
+			for ( int j = node.child[c]; j < node.child[c] + node.count[c]; ++j )
+			{
+				const int i = indices_[j];
+				float t, u, v;
+
+				if ( IntersectTriangle( j, ray, t, u, v ) )
+				{
+					ray.t_far = t;
+					hit.triangle_id = i;
+					hit.u = u;
+					hit.v = v;
+					found = true;
+				}
+			}
+		}
+
+		for ( int k = no_hits - 1; k >= 0; --k )
+		{
+			const int c = order[k];
+
+			if ( node.count[c] == 0 ) stack[top++] = Entry{ node.child[c], t_entry[k] };
+		}
+	}
+
+	return found;
+}
+
+bool Bvh::OccludedQuantized( const Ray & ray ) const
+{
+	const Vector3 inv_direction = ray.inv_direction();
+
+	int stack[kStackSize];
+	int top = 0;
+	stack[top++] = 0;
+
+	while ( top > 0 )
+	{
+		const QuantizedBvhNode & node = quantized_nodes_[stack[--top]];
+
+		float t_entry[4];
+		int order[4];
+		const int no_hits = IntersectChildren( node, ray, inv_direction, t_entry, order );
+
+		for ( int k = 0; k < no_hits; ++k )
+		{
+			const int c = order[k];
+
+			for ( int j = node.child[c]; j < node.child[c] + node.count[c]; ++j )
+			{
+				if ( OccludedTriangle( j, ray ) ) return true;
+			}
+		}
+
+		for ( int k = no_hits - 1; k >= 0; --k )
+		{
+			const int c = order[k];
+
+			if ( node.count[c] == 0 ) stack[top++] = node.child[c];
+		}
+	}
+
+	return false;
+}
+
+bool Bvh::Save( const std::string & file_name ) const
+{
+	FILE * file = fopen( file_name.c_str(), "wb" );
+
+	if ( file == NULL )
+	{
+		printf( "Unable to write BVH cache %s.\n", file_name.c_str() );
+
+		return false;
+	}
+
+	BvhFileHeader header;
+	memset( &header, 0, sizeof( header ) );
+	memcpy( header.magic, kBvhFileMagic, sizeof( header.magic ) );
+	header.version = kBvhFileVersion;
+	header.no_nodes = no_nodes();
+	header.no_indices = static_cast<int>( indices_.size() );
+	header.no_quantized_nodes = static_cast<int>( quantized_nodes_.size() );
+	header.key = cache_key( *geometry_, settings_ );
+	header.build_sah_cost = build_sah_cost_;
+
+	const char padding[kBvhFileAlignment] = { 0 };
+	long long offset = 0;
+
+	auto write_section = [&]( const void * data, const size_t size )
+	{
+		fwrite( padding, 1, static_cast<size_t>( AlignedOffset( offset ) - offset ), file );
+		offset = AlignedOffset( offset );
+		offset += fwrite( data, 1, size, file );
+	};
+
+	write_section( &header, sizeof( header ) );
+	write_section( nodes_.data(), nodes_.size() * sizeof( BvhNode ) );
+	write_section( indices_.data(), indices_.size() * sizeof( int ) );
+	write_section( quantized_nodes_.data(), quantized_nodes_.size() * sizeof( QuantizedBvhNode ) );
+
+	const bool ok = ferror( file ) == 0;
+	fclose( file );
+
+	return ok;
+}
+
+bool Bvh::Load( const std::string & file_name, const SceneGeometry & geometry, const BvhSettings & settings )
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	FILE * file = fopen( file_name.c_str(), "rb" );
+	if ( file == NULL ) return false;
+
+	BvhFileHeader header;
+	long long offset = 0;
+
+	auto read_section = [&]( void * data, const size_t size )
+	{
+		_fseeki64( file, AlignedOffset( offset ), SEEK_SET );
+		offset = AlignedOffset( offset ) + size;
+
+		return fread( data, 1, size, file ) == size;
+	};
+
+	bool ok = read_section( &header, sizeof( header ) ) &&
+		memcmp( header.magic, kBvhFileMagic, sizeof( header.magic ) ) == 0 && header.version == kBvhFileVersion &&
+		header.key == cache_key( geometry, settings ) && header.no_nodes >= 0 && header.no_indices >= 0 &&
+		header.no_quantized_nodes >= 0;
+
+	if ( ok )
+	{
+		nodes_.resize( header.no_nodes );
+		indices_.resize( header.no_indices );
+		quantized_nodes_.resize( header.no_quantized_nodes );
+
+		ok = read_section( nodes_.data(), nodes_.size() * sizeof( BvhNode ) ) &&
+			read_section( indices_.data(), indices_.size() * sizeof( int ) ) &&
+			read_section( quantized_nodes_.data(), quantized_nodes_.size() * sizeof( QuantizedBvhNode ) );
+	}
+
+	fclose( file );
+
+	// a damaged file with an intact header must not send the traversal out of the arrays
+	if ( ok && !IsValid( geometry ) )
+	{
+		printf( "BVH cache %s is corrupted, the tree will be rebuilt.\n", file_name.c_str() );
+		ok = false;
+	}
+
+	if ( !ok )
+	{
+		nodes_.clear();
+		indices_.clear();
+		quantized_nodes_.clear();
+
+		return false;
+	}
+
+	geometry_ = &geometry;
+	settings_ = settings;
+	refit_order_.clear();
+	level_offsets_.clear();
+	build_sah_cost_ = header.build_sah_cost;
+	PrecomputeTriangles();
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	build_time_ = std::chrono::duration<double>( t1 - t0 ).count();
+
+	printf( "BVH (%d references, %d nodes, %0.1f MB) loaded from %s in %s.\n", no_references(), no_nodes(),
+		memory_footprint() / ( 1024.0f * 1024.0f ), file_name.c_str(), TimeToString( build_time_ ).c_str() );
+
+	return true;
+}
+
+bool Bvh::IsValid( const SceneGeometry & geometry ) const
+{
+	const int no_nodes = static_cast<int>( nodes_.size() );
+	const int no_quantized_nodes = static_cast<int>( quantized_nodes_.size() );
+	const int no_indices = static_cast<int>( indices_.size() );
+	const int no_triangles = geometry.no_triangles();
+
+	// children after their parents also rule out cycles
+	for ( int i = 0; i < no_nodes; ++i )
+	{
+		const BvhNode & node = nodes_[i];
+
+		if ( node.is_leaf() )
+		{
+			if ( node.offset < 0 || node.offset > no_indices - node.count ) return false;
+		}
+		else if ( i + 1 >= no_nodes || node.offset <= i + 1 || node.offset >= no_nodes )
+		{
+			return false;
+		}
+	}
+
+	for ( int i = 0; i < no_quantized_nodes; ++i )
+	{
+		const QuantizedBvhNode & node = quantized_nodes_[i];
+
+		if ( node.no_children < 1 || node.no_children > 4 ) return false;
+
+		for ( int c = 0; c < node.no_children; ++c )
+		{
+			if ( node.count[c] > 0 )
+			{
+				if ( node.child[c] < 0 || node.child[c] > no_indices - node.count[c] ) return false;
+			}
+			else if ( node.child[c] <= i || node.child[c] >= no_quantized_nodes )
+			{
+				return false;
+			}
+		}
+	}
+
+	for ( int i = 0; i < no_indices; ++i )
+	{
+		if ( indices_[i] < 0 || indices_[i] >= no_triangles ) return false;
+	}
+
+	return true;
+}
+
+std::string Bvh::cache_file_name( const std::string & scene_file_name, const SceneGeometry & geometry, const BvhSettings & settings )
+{
+	char key[32];
+	sprintf( key, ".%016llx.bvh", cache_key( geometry, settings ) );
+
+	return scene_file_name + key;
+}
+
+unsigned long long Bvh::cache_key( const SceneGeometry & geometry, const BvhSettings & settings )
+{
+	// fields are hashed one by one as the padding of the struct is undefined
+	const float values[] = { float( settings.spatial_splits ), settings.overlap_threshold, settings.memory_growth,
+		float( settings.quantized_nodes ), float( kMaxLeafSize ), float( sizeof( BvhNode ) ), float( sizeof( QuantizedBvhNode ) ) };
+
+	return QuickHash( reinterpret_cast<const BYTE *>( values ), sizeof( values ), geometry.hash() );
+}
+
+int Bvh::no_nodes() const
+{
+	return static_cast<int>( nodes_.size() );
+}
+
+int Bvh::no_references() const
+{
+	return static_cast<int>( indices_.size() );
+}
+
+size_t Bvh::memory_footprint() const
+{
+	const size_t nodes = ( settings_.quantized_nodes ) ? quantized_nodes_.size() * sizeof( QuantizedBvhNode ) : nodes_.size() * sizeof( BvhNode );
+
+	return nodes + indices_.size() * sizeof( int ) + edge_triangles_.size() * sizeof( EdgeTriangle ) +
+		woop_triangles_.size() * sizeof( WoopTriangle );
+}
+
+AABB Bvh::bounds() const
+{
+	return nodes_.empty() ? AABB() : nodes_[0].bounds;
+}
+
+float Bvh::sah_cost() const
+{
+	if ( nodes_.empty() ) return 0.0f;
+
+	const float root_area = nodes_[0].bounds.area();
+	double cost = 0.0;
+
+	for ( const BvhNode & node : nodes_ )
+	{
+		cost += node.bounds.area() * ( ( node.is_leaf() ) ? kIntersectionCost * node.count : kTraversalCost );
+	}
+
+	return static_cast<float>( cost / root_area );
+}
+
+float Bvh::build_sah_cost() const
+{
+	return build_sah_cost_;
+}
+
+double Bvh::build_time() const
+{
+	return build_time_;
+}
@@ -0,0 +1,223 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include "aabb.h"
+#include "ray.h"
+#include "scenegeometry.h"
+#include "alignedallocator.h"
+
+/*! \struct BvhNode
+\brief A single node of the flattened BVH (32 bytes).
+
+Nodes are stored in the depth-first order, the first child of an interior node immediately
+follows its parent.
+*/
+struct BvhNode
+{
+	AABB bounds; /*!< Bounds of all triangles in the subtree. */
+	int offset{ 0 }; /*!< Leaf: index of the first triangle in the index array, interior node: index of the second child. */
+	unsigned short count{ 0 }; /*!< Number of triangles in a leaf, zero for interior nodes. */
+	unsigned short axis{ 0 }; /*!< Split axis used to order the traversal of children. */
+
+	bool is_leaf() const
+	{
+		return count > 0;
+	}
+};
+
+/*! \struct QuantizedBvhNode
+\brief A node of the 4-wide compressed BVH occupying a single 64-byte cache line.
+
+Bounds of children are stored with 8 bits per plane relative to the node box, i.e. a plane
+is decoded as origin + q * 2^exponent (Ylitie et al., Efficient Incoherent Ray Traversal on
+GPUs Through Compressed Wide BVHs, 2017). Quantization is conservative, decoded boxes
+always enclose the original ones.
+*/
+struct QuantizedBvhNode
+{
+	float origin[3]; /*!< Lower corner of the node box. */
+	signed char exponent[3]; /*!< Power of two scale of the quantization grid per axis. */
+	unsigned char no_children; /*!< Number of valid children, 1 to 4. */
+	unsigned char lower_x[4], lower_y[4], lower_z[4]; /*!< Quantized lower planes of children. */
+	unsigned char upper_x[4], upper_y[4], upper_z[4]; /*!< Quantized upper planes of children. */
+	int child[4]; /*!< Interior child: index of the node, leaf child: index of the first triangle in the index array. */
+	unsigned char count[4]; /*!< Number of triangles of a leaf child, zero for interior children. */
+	unsigned char pad[4];
+};
+
+/*! \enum TriangleLayout
+\brief Representation of triangles tested in leaves.
+*/
+enum class TriangleLayout : char
+{
+	VERTICES, /*!< Positions are fetched from SceneGeometry, nothing is stored. */
+	EDGES, /*!< The first vertex and both edges are precomputed. */
+	WOOP /*!< Affine transform into the space of the unit triangle (Woop, Optimized Ray Tracing of Dynamic Scenes, 2004). */
+};
+
+/*! \struct EdgeTriangle
+\brief A triangle ready for the Moller-Trumbore test (36 bytes).
+*/
+struct EdgeTriangle
+{
+	Vector3 p0;
+	Vector3 e1; /*!< p1 - p0 */
+	Vector3 e2; /*!< p2 - p0 */
+};
+
+/*! \struct WoopTriangle
+\brief Rows of the affine transform from world space into the space where the triangle is (0,0,0), (1,0,0), (0,1,0) (48 bytes).
+
+The third row maps a point to its signed distance from the triangle plane so the hit distance
+follows from a single plane test, the first two rows then give the barycentrics u and v.
+*/
+struct WoopTriangle
+{
+	float m[3][4];
+};
+
+/*! \struct BvhSettings
+\brief Options of the BVH builder.
+*/
+struct BvhSettings
+{
+	bool spatial_splits{ false }; /*!< Consider spatial splits of triangles (SBVH), the counterpart of the OptiX "Sbvh" builder. */
+	float overlap_threshold{ 1e-5f }; /*!< Spatial splits are tried only if children of the best object split overlap by more than this fraction of the root area. */
+	float memory_growth{ 1.5f }; /*!< Maximal ratio of triangle references to triangles, spatial splits stop once it is reached. */
+	bool quantized_nodes{ false }; /*!< Single rays traverse the compressed 4-wide nodes, packets keep the full precision binary ones. */
+	TriangleLayout triangle_layout{ TriangleLayout::VERTICES }; /*!< Triangles are precomputed at build time and stored in the order of leaf references. */
+	bool verbose{ true }; /*!< Print statistics of each build, does not affect the tree. */
+};
+
+/*! \class Bvh
+\brief Bounding volume hierarchy over the scene triangles used by the CPU backend.
+
+The tree is built top-down with the binned SAH, optionally with spatial splits which clip
+long and thin triangles into several leaves (Stich et al., Spatial Splits in Bounding Volume
+Hierarchies, 2009). Besides the usual single-ray closest hit query,
+coherent packets of primary rays may be traced at once with the frustum culling of nodes.
+*/
+class Bvh
+{
+public:
+	static const int kMaxLeafSize = 4; /*!< Maximal number of triangles in a leaf. */
+	static const int kNoBins = 16; /*!< Number of SAH bins per node. */
+	static const int kNoSpatialBins = 32; /*!< Number of spatial split candidates per axis. */
+	static const int kStackSize = 128; /*!< Size of the traversal stack. */
+	static const int kMinActiveRays = 8; /*!< Below this number of active rays a packet falls back to single-ray traversal. */
+
+	void Build( const SceneGeometry & geometry, const BvhSettings & settings = BvhSettings() );
+
+	/* writes the built tree into a binary file of cache-line aligned sections, nodes, indices and quantized nodes follow the header */
+	bool Save( const std::string & file_name ) const;
+
+	/* reads the tree saved for the same geometry and settings, fails if the file does not match them or refers out of its own ranges */
+	bool Load( const std::string & file_name, const SceneGeometry & geometry, const BvhSettings & settings );
+
+	/* name of the cache file next to the scene keyed by the hash of the geometry and the build settings */
+	static std::string cache_file_name( const std::string & scene_file_name, const SceneGeometry & geometry, const BvhSettings & settings );
+
+	/* updates node bounds bottom-up after vertex positions of the same triangles have changed, the topology is kept */
+	void Refit( const SceneGeometry & geometry );
+
+	/* finds the closest hit within <ray.t_near, ray.t_far>, on hit ray.t_far is set to the hit distance */
+	bool Intersect( Ray & ray, RayHit & hit ) const;
+
+	/* finds the closest hits of all rays in the packet */
+	void IntersectPacket( RayPacket & packet ) const;
+
+	/* any hit query for shadow and AO rays, terminates on the first hit within <ray.t_near, ray.t_far> */
+	bool Occluded( const Ray & ray ) const;
+
+	/* any hit queries of all rays in the packet, occluded rays get a non-negative triangle_id and stop taking part in the traversal */
+	void OccludedPacket( RayPacket & packet ) const;
+
+	int no_nodes() const;
+	int no_references() const;
+
+	/* size of nodes and indices touched by the traversal in bytes */
+	size_t memory_footprint() const;
+	AABB bounds() const;
+
+	/* SAH cost of the whole tree normalized by the root area */
+	float sah_cost() const;
+
+	/* SAH cost right after the last build */
+	float build_sah_cost() const;
+
+	/* wall time of the last build in seconds */
+	double build_time() const;
+
+private:
+	/* a triangle reference, spatial splits may clip its bounds to a part of the triangle */
+	struct BuildPrimitive
+	{
+		AABB bounds;
+		Vector3 centroid;
+		int index;
+	};
+
+	/* the best split candidate found for a node, cost is the unnormalized SAH term A(L) N(L) + A(R) N(R) */
+	struct Split
+	{
+		float cost{ FLT_MAX };
+		int axis{ 0 };
+		int bin{ -1 };
+		float position{ 0.0f };
+		AABB left;
+		AABB right;
+		int left_count{ 0 };
+		int right_count{ 0 };
+	};
+
+	int BuildNode( std::vector<BuildPrimitive> & references, const int depth );
+	Split FindObjectSplit( const std::vector<BuildPrimitive> & references, const AABB & centroid_bounds ) const;
+	Split FindSpatialSplit( const std::vector<BuildPrimitive> & references, const AABB & bounds ) const;
+	void PerformSpatialSplit( std::vector<BuildPrimitive> & references, const Split & split,
+		std::vector<BuildPrimitive> & left, std::vector<BuildPrimitive> & right );
+	void SplitReference( const BuildPrimitive & reference, const int axis, const float position, AABB & left, AABB & right ) const;
+
+	static unsigned long long cache_key( const SceneGeometry & geometry, const BvhSettings & settings );
+
+	/* checks that children follow their parents within the node arrays, leaves stay within the indices and indices within the triangles of the geometry */
+	bool IsValid( const SceneGeometry & geometry ) const;
+
+	/* fills the precomputed triangles of all references for the selected layout */
+	void PrecomputeTriangles();
+
+	/* tests the triangle of the r-th reference, i.e. the triangle indices_[r] */
+	bool IntersectTriangle( const int r, const Ray & ray, float & t, float & u, float & v ) const;
+	bool OccludedTriangle( const int r, const Ray & ray ) const;
+	bool IntersectWoop( const int r, const Ray & ray, float & t, float & u, float & v ) const;
+	bool IntersectSubtree( const int root, Ray & ray, RayHit & hit ) const;
+	bool OccludedSubtree( const int root, const Ray & ray ) const;
+	bool IsOutsideFrustum( const AABB & bounds, const RayPacket & packet ) const;
+
+	/* converts the binary tree into the compressed 4-wide one */
+	void Compress();
+	int CompressNode( const int node_index );
+	bool IntersectQuantized( Ray & ray, RayHit & hit ) const;
+	bool OccludedQuantized( const Ray & ray ) const;
+
+	const SceneGeometry * geometry_{ nullptr };
+	BvhSettings settings_;
+
+	std::vector<BvhNode> nodes_;
+	std::vector<int> indices_; // triangle indices reordered so that each leaf references a continuous range
+	std::vector<QuantizedBvhNode, AlignedAllocator<QuantizedBvhNode, 64>> quantized_nodes_; // empty unless settings_.quantized_nodes
+	std::vector<EdgeTriangle> edge_triangles_; // parallel to indices_, empty unless the layout is EDGES
+	std::vector<WoopTriangle, AlignedAllocator<WoopTriangle, 16>> woop_triangles_; // parallel to indices_, empty unless the layout is WOOP
+
+	// nodes grouped by depth so that each level may be refitted in parallel
+	std::vector<int> refit_order_;
+	std::vector<int> level_offsets_;
+
+	// build state
+	float build_sah_cost_{ 0.0f };
+	float root_area_{ 0.0f };
+	int no_build_references_{ 0 };
+	int max_build_references_{ 0 };
+	double build_time_{ 0.0 };
+};
+
+#endif
@@ -0,0 +1,493 @@
+#include "pch.h"
+#include "cputracer.h"
+#include "mymath.h"
+#include "simdkernels.h"
+#include "shadingbatch.h"
+#include <algorithm>
+
+void CpuTracer::set_scene( const SceneGeometry * geometry, const Bvh * bvh )
+{
+	geometry_ = geometry;
+	bvh_ = bvh;
+}
+
+void CpuTracer::set_embree( const EmbreeScene * embree )
+{
+	embree_ = embree;
+}
+
+void CpuTracer::set_two_level( const TwoLevelBvh * two_level_bvh )
+{
+	two_level_bvh_ = two_level_bvh;
+}
+
+void CpuTracer::set_lights( const LightList * lights )
+{
+	lights_ = lights;
+}
+
+Vector3 CpuTracer::primary_direction( const float x, const float y ) const
+{
+	const Vector3 d_c( x - width_ * 0.5f, height_ * 0.5f - y, -focal_length_ );
+	Vector3 d_w = M_c_w_ * d_c;
+	d_w.Normalize();
+
+	return d_w;
+}
+
+int CpuTracer::Render( Camera & camera, BYTE * buffer, const int width, const int height, GBuffer * gbuffer, Color3f * colors )
+{
+	if ( geometry_ == nullptr || bvh_ == nullptr ) return S_OK;
+
+	colors_ = colors;
+	width_ = width;
+	height_ = height;
+	view_from_ = camera.view_from();
+	M_c_w_ = camera.M_c_w();
+	focal_length_ = camera.focalLength();
+	no_ao_rays_ = 0;
+	shading_time_ = 0;
+
+	if ( gbuffer != nullptr ) gbuffer->resize( width, height );
+
+	// tiles are whole multiples of blocks, random numbers are keyed by pixels so the noise depends neither on tiles nor on threads
+	const int tile = max( kBlockSize, tile_size - tile_size % kBlockSize );
+
+	scheduler.Run( ( width + tile - 1 ) / tile, ( height + tile - 1 ) / tile, [&]( const int tile_x, const int tile_y )
+	{
+		for ( int y0 = tile_y * tile; y0 < min( ( tile_y + 1 ) * tile, height ); y0 += kBlockSize )
+		{
+			for ( int x0 = tile_x * tile; x0 < min( ( tile_x + 1 ) * tile, width ); x0 += kBlockSize )
+			{
+				RenderBlock( x0, y0, buffer, gbuffer );
+			}
+		}
+	} );
+
+	return S_OK;
+}
+
+void CpuTracer::RenderBlock( const int x0, const int y0, BYTE * buffer, GBuffer * gbuffer ) const
+{
+	const int x1 = min( x0 + kBlockSize, width_ );
+	const int y1 = min( y0 + kBlockSize, height_ );
+
+	Ray rays[kBlockSize * kBlockSize];
+	RayHit hits[kBlockSize * kBlockSize];
+	int pixels[kBlockSize * kBlockSize];
+
+	for ( int y = y0, i = 0; y < y1; ++y )
+	{
+		for ( int x = x0; x < x1; ++x, ++i )
+		{
+			pixels[i] = x + y * width_;
+		}
+	}
+
+	if ( packet_traversal && !embree_active() && !two_level_active() )
+	{
+		RayPacket packet;
+		packet.origin = view_from_;
+
+		for ( int y = y0; y < y1; ++y )
+		{
+			for ( int x = x0; x < x1; ++x )
+			{
+				packet.add( primary_direction( float( x ), float( y ) ) );
+			}
+		}
+
+		packet.set_frustum( primary_direction( float( x0 ), float( y0 ) ), primary_direction( float( x1 - 1 ), float( y0 ) ),
+			primary_direction( float( x1 - 1 ), float( y1 - 1 ) ), primary_direction( float( x0 ), float( y1 - 1 ) ) );
+
+		bvh_->IntersectPacket( packet );
+
+		for ( int i = 0; i < packet.no_rays; ++i )
+		{
+			rays[i] = packet.ray( i );
+			hits[i] = packet.hit( i );
+		}
+	}
+	else
+	{
+		for ( int y = y0, i = 0; y < y1; ++y )
+		{
+			for ( int x = x0; x < x1; ++x, ++i )
+			{
+				rays[i] = Ray( view_from_, primary_direction( float( x ), float( y ) ) );
+				Intersect( rays[i], hits[i] );
+			}
+		}
+	}
+
+	const int no_rays = ( x1 - x0 ) * ( y1 - y0 );
+	Color3f ambient_occlusion[kBlockSize * kBlockSize];
+
+	int no_ao_rays = 0;
+
+	if ( ray_sorting && !adaptive_sampling )
+	{
+		AmbientOcclusionStream( rays, hits, pixels, no_rays, ambient_occlusion );
+
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			if ( hits[i].is_valid() ) no_ao_rays += no_samples();
+		}
+	}
+	else
+	{
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			if ( !hits[i].is_valid() ) continue;
+
+			const Vector3 normal = shading_normal( rays[i], hits[i] );
+			int no_pixel_rays;
+			ambient_occlusion[i] = AmbientOcclusion( rays[i].point( rays[i].t_far ), normal,
+				geometry_->material( hits[i].triangle_id )->diffuse(), pixels[i], no_pixel_rays );
+			no_ao_rays += no_pixel_rays;
+		}
+	}
+
+	no_ao_rays_ += no_ao_rays;
+
+	if ( gbuffer != nullptr )
+	{
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			const Vector3 normal = ( hits[i].is_valid() ) ? shading_normal( rays[i], hits[i] ) : Vector3( 0.0f, 0.0f, 0.0f );
+			gbuffer->Write( pixels[i], *geometry_, hits[i].triangle_id, hits[i].u, hits[i].v, rays[i].t_far, normal );
+		}
+	}
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	Color3f colors[kBlockSize * kBlockSize];
+
+	if ( shader_sorting )
+	{
+		ShadeSorted( rays, hits, ambient_occlusion, pixels, no_rays, colors );
+	}
+	else
+	{
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			// miss_program returns black
+			colors[i] = ( hits[i].is_valid() ) ? Shade( rays[i], hits[i], ambient_occlusion[i], pixels[i] ) : Color3f( 0.0f, 0.0f, 0.0f );
+		}
+	}
+
+	shading_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::high_resolution_clock::now() - t0 ).count();
+
+	const SimdKernels & kernels = simd_kernels();
+
+	for ( int y = y0; y < y1; ++y )
+	{
+		kernels.convert_colors( reinterpret_cast<const float *>( &colors[( y - y0 ) * ( x1 - x0 )] ), x1 - x0, &buffer[( x0 + y * width_ ) * 4] );
+		if ( colors_ != nullptr ) std::copy_n( &colors[( y - y0 ) * ( x1 - x0 )], x1 - x0, &colors_[x0 + y * width_] );
+	}
+}
+
+Vector3 CpuTracer::shading_normal( const Ray & ray, const RayHit & hit ) const
+{
+	// attribute_program
+	Vector3 normal = geometry_->normal( hit.triangle_id, hit.u, hit.v );
+
+	if ( ray.direction.DotProduct( normal ) > 0.0f )
+	{
+		normal *= -1.0f;
+	}
+
+	return normal;
+}
+
+Color3f CpuTracer::Shade( const Ray & ray, const RayHit & hit, const Color3f & ambient_occlusion, const int pixel ) const
+{
+	const Material * material = geometry_->material( hit.triangle_id );
+	const Vector3 normal = shading_normal( ray, hit );
+	const Color3f emitted = material->emission() * light_scale;
+
+	if ( material->shader() == Shader::NORMAL ) return Color3f( normal.x, normal.y, normal.z ) * ambient_occlusion * 0.5f + emitted;
+
+	const Coord2f texcoord = geometry_->texcoord( hit.triangle_id, hit.u, hit.v );
+	const Coord2f flipped_texcoord{ texcoord.u, 1.0f - texcoord.v };
+	const Color3f diffuse = material->diffuse( &flipped_texcoord );
+	const Vector3 point = ray.point( ray.t_far );
+
+	// each light point is shaded the way the former point light was, lights behind the surface are skipped
+	RandomStream rng( pixel, sample_index, kLightDimension );
+	const int n = no_light_points();
+	Color3f direct;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		const LightSample light = SampleLight( point, normal, rng );
+		const float cos_theta = light.direction.DotProduct( normal );
+
+		if ( cos_theta <= 0.0f || light.radiance.is_zero() ) continue;
+		if ( light.distance > 0.0f && Occluded( Ray( point, light.direction, 0.01f, light.distance - 0.01f ) ) ) continue;
+
+		if ( material->shader() == Shader::PHONG )
+		{
+			const Vector3 lr = ( 2.0f * cos_theta ) * normal - light.direction;
+			direct = direct + ( diffuse * cos_theta + material->specular() * powf( max( 0.0f, ( -ray.direction ).DotProduct( lr ) ),
+				material->shininess ) ) * light.radiance;
+		}
+		else // Shader::LAMBERT
+		{
+			direct = direct + diffuse * cos_theta * light.radiance;
+		}
+	}
+
+	direct = direct * ( light_scale / n );
+
+	if ( material->shader() == Shader::PHONG ) return ( material->ambient() + direct ) * ambient_occlusion + emitted;
+
+	return direct * ambient_occlusion + emitted;
+}
+
+void CpuTracer::ShadeSorted( const Ray * rays, const RayHit * hits, const Color3f * ambient_occlusion, const int * pixels, const int no_rays,
+	Color3f * colors ) const
+{
+	// the ray index in the low bits keeps the sort stable without the allocations of std::stable_sort
+	long long keys[kBlockSize * kBlockSize];
+	int order[kBlockSize * kBlockSize];
+	int no_hits = 0;
+
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		// miss_program returns black
+		colors[i] = Color3f( 0.0f, 0.0f, 0.0f );
+		if ( hits[i].is_valid() ) keys[no_hits++] = ( static_cast<long long>( shading_key( *geometry_->material( hits[i].triangle_id ) ) ) << 8 ) | i;
+	}
+
+	std::sort( keys, keys + no_hits );
+	for ( int k = 0; k < no_hits; ++k ) order[k] = static_cast<int>( keys[k] & 0xff );
+
+	// light points and shadow rays of each hit exactly as Shade traces them, only the arithmetic is deferred to the batches
+	thread_local ShadingBuffer shading_buffer;
+	const int n = no_light_points();
+	shading_buffer.resize( no_hits, n );
+
+	for ( int k = 0; k < no_hits; ++k )
+	{
+		const int i = order[k];
+		const Material * material = geometry_->material( hits[i].triangle_id );
+		const Vector3 normal = shading_normal( rays[i], hits[i] );
+
+		if ( material->shader() == Shader::NORMAL )
+		{
+			shading_buffer.set_hit( k, normal, rays[i].direction, Color3f(), ambient_occlusion[i] );
+			continue;
+		}
+
+		const Coord2f texcoord = geometry_->texcoord( hits[i].triangle_id, hits[i].u, hits[i].v );
+		const Coord2f flipped_texcoord{ texcoord.u, 1.0f - texcoord.v };
+		shading_buffer.set_hit( k, normal, rays[i].direction, material->diffuse( &flipped_texcoord ), ambient_occlusion[i] );
+
+		const Vector3 point = rays[i].point( rays[i].t_far );
+		RandomStream rng( pixels[i], sample_index, kLightDimension );
+
+		for ( int j = 0; j < n; ++j )
+		{
+			const LightSample light = SampleLight( point, normal, rng );
+			const bool visible = light.direction.DotProduct( normal ) > 0.0f && !light.radiance.is_zero();
+			const bool occluded = visible && light.distance > 0.0f && Occluded( Ray( point, light.direction, 0.01f, light.distance - 0.01f ) );
+
+			shading_buffer.set_light( k, j, light.direction, ( occluded ) ? Color3f( 0.0f, 0.0f, 0.0f ) : light.radiance );
+		}
+	}
+
+	const SimdKernels & kernels = simd_kernels();
+	Color3f sorted_colors[kBlockSize * kBlockSize];
+
+	for ( int first = 0, last; first < no_hits; first = last )
+	{
+		const Material * material = geometry_->material( hits[order[first]].triangle_id );
+		for ( last = first + 1; last < no_hits && geometry_->material( hits[order[last]].triangle_id ) == material; ++last );
+
+		kernels.shade_batch( shading_buffer.batch( first, last, *material, light_scale ), reinterpret_cast<float *>( sorted_colors + first ) );
+	}
+
+	for ( int k = 0; k < no_hits; ++k )
+	{
+		colors[order[k]] = sorted_colors[k];
+	}
+}
+
+LightSample CpuTracer::SampleLight( const Vector3 & point, const Vector3 & normal, RandomStream & rng ) const
+{
+	if ( lights_ != nullptr ) return lights_->Sample( point, normal, rng, light_sampling );
+
+	return LightList::DefaultLight( point );
+}
+
+int CpuTracer::no_light_points() const
+{
+	// the default point light needs a single sample
+	return ( lights_ != nullptr && lights_->no_lights() > 0 ) ? min( max( no_light_samples, 1 ), kMaxLightSamples ) : 1;
+}
+
+Color3f CpuTracer::AmbientOcclusion( const Vector3 & point, const Vector3 & normal, const Color3f & diffuse, const int pixel,
+	int & no_rays ) const
+{
+	PixelSampler sampler = ao_sampler( pixel );
+	const int n = no_samples();
+
+	Color3f sum;
+	float sum_s = 0.0f; // the estimate divided by pi is the unoccluded fraction of the hemisphere
+	float half_sum_s = 0.0f; // sum_s of the first half of the samples before the next check
+	int next_check = ao_batch();
+	const float scale = max( diffuse.r, max( diffuse.g, diffuse.b ) ) / float( M_PI ); // from sum_s to the brightest channel
+	int i = 0;
+
+	while ( i < n )
+	{
+		float weight;
+		const Vector3 omega_i = SampleAmbientOcclusion( normal, sampler, cosine_sampling, weight );
+		const float shade = ShadowRay( point, omega_i );
+
+		sum = sum + diffuse * ( shade * weight );
+		sum_s += shade * weight;
+		++i;
+
+		if ( !adaptive_sampling ) continue;
+
+		if ( i == next_check / 2 ) half_sum_s = sum_s;
+
+		if ( i == next_check )
+		{
+			// both halves of a power of two run of the sequence are stratified on their own, their difference estimates
+			// the error of the whole run, the 1/n term keeps pixels whose first samples happen to agree from retiring early
+			const float error = ( fabsf( 2.0f * half_sum_s - sum_s ) / i + 0.5f * float( M_PI ) / i ) * scale;
+			if ( error <= adaptive_threshold ) break;
+
+			half_sum_s = sum_s;
+			next_check *= 2;
+		}
+	}
+
+	no_rays = i;
+
+	return sum * ( 1.0f / i );
+}
+
+void CpuTracer::AmbientOcclusionStream( const Ray * rays, const RayHit * hits, const int * pixels, const int no_rays,
+	Color3f * ambient_occlusion ) const
+{
+	// the sort key and the index of the ray are packed together so that only integers are sorted
+	const int kIndexBits = 12;
+	static_assert( kBlockSize * kBlockSize * kMaxAOSamples <= ( 1 << kIndexBits ), "AO rays of a block do not fit the key" );
+
+	const int n = no_samples();
+	const AABB bounds = bvh_->bounds();
+
+	thread_local std::vector<Ray> stream;
+	thread_local std::vector<float> weights; // cosine over pdf divided by the number of samples
+	thread_local std::vector<unsigned long long> keys;
+
+	stream.clear();
+	weights.clear();
+	keys.clear();
+
+	// gather, each pixel draws the same numbers as in AmbientOcclusion
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( !hits[i].is_valid() ) continue;
+
+		const Vector3 point = rays[i].point( rays[i].t_far );
+		const Vector3 normal = shading_normal( rays[i], hits[i] );
+		PixelSampler sampler = ao_sampler( pixels[i] );
+
+		for ( int j = 0; j < n; ++j )
+		{
+			float weight;
+			const Ray ray( point, SampleAmbientOcclusion( normal, sampler, cosine_sampling, weight ), 0.01f, ao_radius );
+
+			keys.push_back( ( ray.sort_key( bounds ) << kIndexBits ) | stream.size() );
+			weights.push_back( weight / n );
+			stream.push_back( ray );
+		}
+	}
+
+	// sort, rays of the same octant starting close to each other visit mostly the same nodes
+	std::sort( keys.begin(), keys.end() );
+
+	// trace and scatter
+	float visibility[kBlockSize * kBlockSize] = { 0.0f };
+
+	for ( const unsigned long long key : keys )
+	{
+		const int k = static_cast<int>( key & ( ( 1 << kIndexBits ) - 1 ) );
+
+		if ( !Occluded( stream[k] ) ) visibility[k / n] += weights[k];
+	}
+
+	for ( int i = 0, k = 0; i < no_rays; ++i )
+	{
+		if ( hits[i].is_valid() )
+		{
+			ambient_occlusion[i] = geometry_->material( hits[i].triangle_id )->diffuse() * visibility[k++];
+		}
+	}
+}
+
+float CpuTracer::ShadowRay( const Vector3 & origin, const Vector3 & direction ) const
+{
+	// shader_hit terminates the ray on the first hit, no attributes are needed
+	return ( Occluded( Ray( origin, direction, 0.01f, ao_radius ) ) ) ? 0.0f : 1.0f;
+}
+
+long long CpuTracer::no_ao_rays() const
+{
+	return no_ao_rays_;
+}
+
+double CpuTracer::shading_time() const
+{
+	return shading_time_ * 1e-9;
+}
+
+PixelSampler CpuTracer::ao_sampler( const int pixel ) const
+{
+	return pixel_sampler( sampler, pixel % width_, pixel / width_, width_, sample_index, no_samples() );
+}
+
+int CpuTracer::ao_batch() const
+{
+	int batch = 2;
+
+	while ( batch < adaptive_batch && batch < kMaxAOSamples ) batch *= 2;
+
+	return batch;
+}
+
+int CpuTracer::no_samples() const
+{
+	return min( max( no_ao_samples, 1 ), kMaxAOSamples );
+}
+
+bool CpuTracer::Intersect( Ray & ray, RayHit & hit ) const
+{
+	// Embree is refitted together with the flat BVH, i.e. it is stale while the two-level BVH is traced
+	if ( two_level_active() ) return two_level_bvh_->Intersect( ray, hit );
+	if ( embree_active() ) return embree_->Intersect( ray, hit );
+
+	return bvh_->Intersect( ray, hit );
+}
+
+bool CpuTracer::Occluded( const Ray & ray ) const
+{
+	if ( two_level_active() ) return two_level_bvh_->Occluded( ray );
+	if ( embree_active() ) return embree_->Occluded( ray );
+
+	return bvh_->Occluded( ray );
+}
+
+bool CpuTracer::embree_active() const
+{
+	return use_embree && embree_ != nullptr && embree_->is_valid();
+}
+
+bool CpuTracer::two_level_active() const
+{
+	return two_level && two_level_bvh_ != nullptr;
+}
@@ -0,0 +1,125 @@
+#ifndef CPU_TRACER_H_
+#define CPU_TRACER_H_
+
+#include "bvh.h"
+#include "embreescene.h"
+#include "twolevelbvh.h"
+#include "camera.h"
+#include "tilescheduler.h"
+#include "sampler.h"
+#include "gbuffer.h"
+#include "lights.h"
+
+/*! \class CpuTracer
+\brief CPU counterpart of the OptiX programs in optixtutorial.cu.
+
+Traces primary rays from the pin-hole camera, shades hits with the same Phong, Lambert and
+Normal shaders including 32 samples of ambient occlusion and direct light of sampled emissive
+triangles and writes the result into a buffer with the same layout as output_buffer.
+*/
+class CpuTracer
+{
+public:
+	static const int kBlockSize = 8; /*!< Side of a square block traced as a single packet. */
+	static const int kMaxAOSamples = 64; /*!< Upper bound of no_ao_samples. */
+
+	void set_scene( const SceneGeometry * geometry, const Bvh * bvh );
+
+	/* Embree scene over the same geometry used instead of the BVH when use_embree is set */
+	void set_embree( const EmbreeScene * embree );
+
+	/* two-level BVH over the same surfaces used instead of the BVH when two_level is set */
+	void set_two_level( const TwoLevelBvh * two_level_bvh );
+
+	/* emissive triangles of the scene, without them the default point light is used */
+	void set_lights( const LightList * lights );
+
+	/* renders the whole frame into the RGBA buffer of the given size, the requested outputs of primary hits go to the optional G-buffer,
+	the optional colors receive the linear color of each pixel before it is clamped and converted into the buffer */
+	int Render( Camera & camera, BYTE * buffer, const int width, const int height, GBuffer * gbuffer = nullptr, Color3f * colors = nullptr );
+
+	bool packet_traversal{ true }; /*!< Trace primary rays of each block as a single packet. */
+	bool ray_sorting{ false }; /*!< Gather AO rays of a block, sort them by direction octant and origin cell and trace them in this order. */
+	bool use_embree{ false }; /*!< Trace all rays with Embree as a reference, packets fall back to single rays, ignored while two_level is set. */
+	bool two_level{ false }; /*!< Trace all rays through the instances of the two-level BVH, packets fall back to single rays. */
+	float ao_radius{ FLT_MAX }; /*!< Maximal distance of occluders, i.e. t_far of AO rays, shorter rays skip distant nodes. */
+	int tile_size{ 32 }; /*!< Side of a scheduled tile in pixels, rounded down to a multiple of kBlockSize. */
+	unsigned int sample_index{ 0 }; /*!< Index of the frame sample, keys the random numbers of each pixel together with the pixel index. */
+	int no_ao_samples{ 32 }; /*!< AO rays per pixel and frame. */
+	SamplerType sampler{ SamplerType::SOBOL }; /*!< Sequence of the sample points of AO rays. */
+	bool cosine_sampling{ true }; /*!< AO rays follow the cosine-weighted instead of the uniform hemisphere. */
+	bool adaptive_sampling{ false }; /*!< Double AO rays of a pixel until the estimated error drops below adaptive_threshold or no_ao_samples are spent, AO rays are not sorted. */
+	float adaptive_threshold{ 0.02f }; /*!< Error of the AO color at which a pixel is retired, the brightest channel is taken. */
+	int adaptive_batch{ 8 }; /*!< AO rays traced by a pixel before its error is first estimated, each further estimate follows twice as many rays, see ao_batch. */
+	int no_light_samples{ 1 }; /*!< Light points per pixel and frame, each one with its own shadow ray. */
+	float light_scale{ 1.0f }; /*!< Factor of the emission of all lights including the emitters seen directly. */
+	LightSampling light_sampling{ LightSampling::TREE }; /*!< Lights are drawn by their power or by their importance for the shading point. */
+	bool shader_sorting{ false }; /*!< Sort hits of a block by their shader and material and shade each run of a material by SimdKernels::shade_batch. */
+
+	/* number of AO rays traced by the last frame */
+	long long no_ao_rays() const;
+
+	/* adaptive_batch rounded up to a power of two of at least 2, the error is estimated from both halves of such runs of the sequence */
+	int ao_batch() const;
+
+	/* seconds spent by all threads shading hits of the last frame including their shadow rays */
+	double shading_time() const;
+
+	TileScheduler scheduler; /*!< Distributes tiles among threads, holds per-thread times of the last frame. */
+
+private:
+	void RenderBlock( const int x0, const int y0, BYTE * buffer, GBuffer * gbuffer ) const;
+
+	/* direction of the primary ray through the pixel (x, y) exactly as primary_ray computes it */
+	Vector3 primary_direction( const float x, const float y ) const;
+
+	/* interpolated normal flipped towards the ray origin as attribute_program does */
+	Vector3 shading_normal( const Ray & ray, const RayHit & hit ) const;
+
+	Color3f Shade( const Ray & ray, const RayHit & hit, const Color3f & ambient_occlusion, const int pixel ) const;
+
+	/* the same colors as Shade for all rays of a block, valid hits are sorted by shading_key and each run of a material is shaded as a batch */
+	void ShadeSorted( const Ray * rays, const RayHit * hits, const Color3f * ambient_occlusion, const int * pixels, const int no_rays,
+		Color3f * colors ) const;
+	Color3f AmbientOcclusion( const Vector3 & point, const Vector3 & normal, const Color3f & diffuse, const int pixel, int & no_rays ) const;
+
+	/* the same ambient occlusion for all hits of a block, the rays are traced in the sorted order and results scattered back */
+	void AmbientOcclusionStream( const Ray * rays, const RayHit * hits, const int * pixels, const int no_rays, Color3f * ambient_occlusion ) const;
+	float ShadowRay( const Vector3 & origin, const Vector3 & direction ) const;
+
+	/* a point on one of the lights for the shading point */
+	LightSample SampleLight( const Vector3 & point, const Vector3 & normal, RandomStream & rng ) const;
+
+	/* light points per shading point in the current frame */
+	int no_light_points() const;
+
+	/* sample points of AO rays of the pixel in the current frame */
+	PixelSampler ao_sampler( const int pixel ) const;
+	int no_samples() const;
+
+	/* dispatch single-ray queries to the BVH, the two-level BVH or Embree */
+	bool Intersect( Ray & ray, RayHit & hit ) const;
+	bool Occluded( const Ray & ray ) const;
+	bool embree_active() const;
+	bool two_level_active() const;
+
+	const SceneGeometry * geometry_{ nullptr };
+	const Bvh * bvh_{ nullptr };
+	const EmbreeScene * embree_{ nullptr };
+	const TwoLevelBvh * two_level_bvh_{ nullptr };
+	const LightList * lights_{ nullptr };
+
+	mutable std::atomic<long long> no_ao_rays_{ 0 };
+	mutable std::atomic<long long> shading_time_{ 0 }; // nanoseconds
+
+	Color3f * colors_{ nullptr }; // linear colors of the frame being rendered, see Render
+
+	// camera snapshot of the frame being rendered
+	int width_{ 0 };
+	int height_{ 0 };
+	Vector3 view_from_;
+	Matrix3x3 M_c_w_;
+	float focal_length_{ 1.0f };
+};
+
+#endif
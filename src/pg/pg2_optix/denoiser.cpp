@@ -0,0 +1,138 @@
+#include "pch.h"
+#include "denoiser.h"
+#include "mymath.h"
+#include "simdkernels.h"
+
+namespace
+{
+	const float kMinAlbedo = 0.01f; // albedos are clamped from below so that dark texels do not amplify the noise
+	const float kMissDepth = 1e+3f; // logarithm of the depth of misses, far from any hit so that misses filter only among themselves
+	const int kRowsPerTask = 8;
+}
+
+const unsigned int Denoiser::kGuides = aov_bit( Aov::DEPTH ) | aov_bit( Aov::NORMAL ) | aov_bit( Aov::ALBEDO );
+
+void Denoiser::Run( BYTE * buffer, const GBuffer & gbuffer )
+{
+	if ( ( gbuffer.outputs & kGuides ) != kGuides ) return;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	const int width = gbuffer.width;
+	const int height = gbuffer.height;
+	const int no_pixels = width * height;
+
+	color_[0].resize( no_pixels * 4 );
+	color_[1].resize( no_pixels * 4 );
+	guide_.resize( no_pixels * 4 );
+
+	// demodulation, the logarithm turns relative depth differences into plain ones
+#pragma omp parallel for schedule( static )
+	for ( int p = 0; p < no_pixels; ++p )
+	{
+		const Color3f albedo = gbuffer.decoded_albedo( p );
+		const BYTE * rgba = &buffer[p * 4];
+		float * color = &color_[0][p * 4];
+		color[0] = rgba[0] / ( 255.0f * max( albedo.r, kMinAlbedo ) );
+		color[1] = rgba[1] / ( 255.0f * max( albedo.g, kMinAlbedo ) );
+		color[2] = rgba[2] / ( 255.0f * max( albedo.b, kMinAlbedo ) );
+		color[3] = 1.0f;
+
+		const Vector3 normal = gbuffer.decoded_normal( p );
+		float * guide = &guide_[p * 4];
+		guide[0] = normal.x;
+		guide[1] = normal.y;
+		guide[2] = normal.z;
+		guide[3] = ( gbuffer.depth[p] > 0.0f ) ? logf( gbuffer.depth[p] ) : kMissDepth;
+	}
+
+	noise_ = EstimateNoise( width, height );
+
+	const SimdKernels & kernels = simd_kernels();
+	const int no_tasks = ( height + kRowsPerTask - 1 ) / kRowsPerTask;
+	float sigma = max( sigma_color * noise_, 1e-3f );
+
+	for ( int pass = 0; pass < no_passes; ++pass, sigma *= 0.5f )
+	{
+		const int step = 1 << pass;
+		const float inv_color = 1.0f / sqr( sigma );
+		const float inv_normal = 1.0f / sqr( sigma_normal );
+		const float inv_depth = 1.0f / sqr( sigma_depth * step ); // depths of slanted surfaces differ in proportion to the tap distance
+		const float inv_sigmas[8] = { inv_color, inv_color, inv_color, 0.0f, inv_normal, inv_normal, inv_normal, inv_depth };
+
+		const float * input = color_[pass % 2].data();
+		float * output = color_[( pass + 1 ) % 2].data();
+
+#pragma omp parallel for schedule( dynamic )
+		for ( int task = 0; task < no_tasks; ++task )
+		{
+			const int y0 = task * kRowsPerTask;
+			kernels.filter_atrous( input, guide_.data(), width, height, y0, min( y0 + kRowsPerTask, height ), step, inv_sigmas, output );
+		}
+	}
+
+	// remodulation
+	const AlignedFloats & filtered = color_[no_passes % 2];
+
+#pragma omp parallel for schedule( static )
+	for ( int y = 0; y < height; ++y )
+	{
+		std::vector<Color3f> row( width );
+
+		for ( int x = 0; x < width; ++x )
+		{
+			const int p = x + y * width;
+			const Color3f albedo = gbuffer.decoded_albedo( p );
+			const float * color = &filtered[p * 4];
+			row[x] = Color3f( color[0] * max( albedo.r, kMinAlbedo ), color[1] * max( albedo.g, kMinAlbedo ),
+				color[2] * max( albedo.b, kMinAlbedo ) );
+		}
+
+		kernels.convert_colors( reinterpret_cast<const float *>( row.data() ), width, &buffer[y * width * 4] );
+	}
+
+	time_ = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count();
+}
+
+float Denoiser::EstimateNoise( const int width, const int height ) const
+{
+	if ( width < 3 || height < 3 ) return 0.0f;
+
+	const float * color = color_[0].data();
+	double sum = 0.0;
+
+	// Immerkaer, Fast Noise Variance Estimation, 1996: the mask is the difference of two Laplacians which cancels out on
+	// smooth image structures, its mean absolute response over the mean channel is proportional to the standard deviation
+#pragma omp parallel for schedule( static ) reduction( + : sum )
+	for ( int y = 1; y < height - 1; ++y )
+	{
+		for ( int x = 1; x < width - 1; ++x )
+		{
+			static const float kMask[3][3] = { { 1.0f, -2.0f, 1.0f }, { -2.0f, 4.0f, -2.0f }, { 1.0f, -2.0f, 1.0f } };
+			float response = 0.0f;
+
+			for ( int j = -1; j <= 1; ++j )
+			{
+				for ( int i = -1; i <= 1; ++i )
+				{
+					const float * c = &color[( x + i + ( y + j ) * width ) * 4];
+					response += kMask[j + 1][i + 1] * ( c[0] + c[1] + c[2] ) * ( 1.0f / 3.0f );
+				}
+			}
+
+			sum += fabsf( response );
+		}
+	}
+
+	return float( sqrt( M_PI * 0.5 ) * sum / ( 6.0 * ( width - 2 ) * ( height - 2 ) ) );
+}
+
+float Denoiser::noise() const
+{
+	return noise_;
+}
+
+double Denoiser::time() const
+{
+	return time_;
+}
@@ -0,0 +1,51 @@
+#ifndef DENOISER_H_
+#define DENOISER_H_
+
+#include "gbuffer.h"
+#include "alignedallocator.h"
+
+/*! \class Denoiser
+\brief Edge-avoiding a-trous wavelet filter of the RGBA frame (Dammertz et al., 2010).
+
+Each pass convolves the frame with the 5x5 B3-spline kernel whose taps are spread 2^i pixels
+apart, so that a few passes cover a large footprint with 25 taps per pixel each. Taps across
+edges are suppressed by weights falling off with differences of colors, shading normals and
+depths. Colors are divided by the albedo before filtering and multiplied back afterwards so
+that textures stay sharp and only the noise of the lighting is smoothed. The color tolerance
+is relative to the noise estimated from the frame itself, so the same settings suit a single
+sample as well as converged frames, and it halves with every pass as the remaining noise drops.
+*/
+class Denoiser
+{
+public:
+	/* outputs of the G-buffer the filter is guided by */
+	static const unsigned int kGuides;
+
+	/* filters the RGBA buffer in place, the G-buffer has to be of the same size and hold kGuides */
+	void Run( BYTE * buffer, const GBuffer & gbuffer );
+
+	/* duration of the last run in seconds */
+	double time() const;
+
+	/* standard deviation of the noise of demodulated colors estimated by the last run */
+	float noise() const;
+
+	int no_passes{ 4 }; /*!< Number of passes, the last one has taps 2^(no_passes - 1) pixels apart. */
+	float sigma_color{ 24.0f }; /*!< Tolerance of differences of demodulated colors in the first pass in multiples of the estimated noise. */
+	float sigma_normal{ 0.2f }; /*!< Tolerance of distances of unit normals. */
+	float sigma_depth{ 0.02f }; /*!< Tolerance of relative differences of depths per pixel of the tap distance. */
+
+private:
+	/* noise of the demodulated colors in color_[0] */
+	float EstimateNoise( const int width, const int height ) const;
+
+	typedef std::vector<float, AlignedAllocator<float, 16>> AlignedFloats;
+
+	AlignedFloats color_[2]; // demodulated colors, pass i reads color_[i % 2] and writes the other one
+	AlignedFloats guide_; // normal and the logarithm of depth
+
+	std::atomic<double> time_{ 0.0 };
+	std::atomic<float> noise_{ 0.0f };
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "pch.h"
+#include "dynamicbvh.h"
+
+DynamicBvh::~DynamicBvh()
+{
+	Join();
+}
+
+void DynamicBvh::Build( const SceneGeometry & geometry, const BvhSettings & settings, const std::string & cache_file_name )
+{
+	Join();
+
+	geometry_ = &geometry;
+	settings_ = settings;
+	active_ = 0;
+	reference_sah_cost_ = 0.0f;
+
+	if ( cache_file_name.empty() )
+	{
+		bvhs_[active_].Build( geometry, settings );
+	}
+	else if ( !bvhs_[active_].Load( cache_file_name, geometry, settings ) )
+	{
+		bvhs_[active_].Build( geometry, settings );
+		bvhs_[active_].Save( cache_file_name );
+	}
+}
+
+void DynamicBvh::Update()
+{
+	if ( geometry_ == nullptr ) return;
+
+	if ( rebuilding_ && rebuild_finished_.load( std::memory_order_acquire ) )
+	{
+		Join();
+		active_ = 1 - active_;
+		reference_sah_cost_ = 0.0f;
+	}
+
+	// the rebuilt tree references the snapshot, refit moves it back to the live geometry
+	Bvh & bvh = bvhs_[active_];
+	bvh.Refit( *geometry_ );
+
+	const float sah_cost = bvh.sah_cost();
+
+	if ( reference_sah_cost_ <= 0.0f )
+	{
+		// refit of a spatial split tree is looser than the build itself, so the degradation is measured from here
+		reference_sah_cost_ = sah_cost;
+	}
+	else if ( !rebuilding_ && sah_cost > rebuild_threshold * reference_sah_cost_ )
+	{
+		printf( "BVH SAH cost degraded from %0.1f to %0.1f, rebuilding in the background...\n", reference_sah_cost_, sah_cost );
+
+		snapshot_ = *geometry_;
+		rebuild_finished_.store( false, std::memory_order_release );
+		rebuilding_ = true;
+		rebuild_thread_ = std::thread( &DynamicBvh::Rebuild, this, 1 - active_ );
+	}
+}
+
+const Bvh & DynamicBvh::bvh() const
+{
+	return bvhs_[active_];
+}
+
+bool DynamicBvh::is_rebuilding() const
+{
+	return rebuilding_;
+}
+
+void DynamicBvh::Rebuild( const int target )
+{
+	bvhs_[target].Build( snapshot_, settings_ );
+	rebuild_finished_.store( true, std::memory_order_release );
+}
+
+void DynamicBvh::Join()
+{
+	if ( rebuild_thread_.joinable() )
+	{
+		rebuild_thread_.join();
+	}
+
+	rebuilding_ = false;
+}
@@ -0,0 +1,49 @@
+#ifndef DYNAMIC_BVH_H_
+#define DYNAMIC_BVH_H_
+
+#include "bvh.h"
+
+/*! \class DynamicBvh
+\brief BVH of a scene with rigidly moving surfaces.
+
+After each change of vertex positions the tree is only refitted. Once its SAH cost grows
+above rebuild_threshold times the cost of the freshly refitted tree, a full rebuild is
+started on a snapshot of the geometry in a background thread and the new tree replaces
+the refitted one by the first update after the rebuild finishes.
+*/
+class DynamicBvh
+{
+public:
+	~DynamicBvh();
+
+	/* builds the tree or loads it from the cache file if given, a newly built tree is saved there */
+	void Build( const SceneGeometry & geometry, const BvhSettings & settings = BvhSettings(), const std::string & cache_file_name = "" );
+
+	/* refits the tree after the geometry has changed and schedules a rebuild if needed */
+	void Update();
+
+	const Bvh & bvh() const;
+
+	/* true while a background rebuild is running */
+	bool is_rebuilding() const;
+
+	float rebuild_threshold{ 1.3f }; /*!< Allowed relative growth of the SAH cost of a refitted tree. */
+
+private:
+	void Rebuild( const int target );
+	void Join();
+
+	const SceneGeometry * geometry_{ nullptr };
+	BvhSettings settings_;
+
+	Bvh bvhs_[2]; // the active tree and the one being rebuilt
+	int active_{ 0 };
+	float reference_sah_cost_{ 0.0f }; // cost of the active tree after its first refit, zero if not refitted yet
+
+	SceneGeometry snapshot_; // geometry seen by the background build
+	std::thread rebuild_thread_;
+	std::atomic<bool> rebuild_finished_{ false };
+	bool rebuilding_{ false };
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "pch.h"
+#include "embreescene.h"
+#include "utils.h"
+
+#ifdef USE_EMBREE
+#pragma comment( lib, "embree3.lib" )
+
+EmbreeScene::~EmbreeScene()
+{
+	Release();
+}
+
+bool EmbreeScene::Build( const SceneGeometry & geometry )
+{
+	Release();
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	geometry_ = &geometry;
+	device_ = rtcNewDevice( nullptr );
+
+	if ( device_ == nullptr )
+	{
+		printf( "Unable to create Embree device (error %d).\n", rtcGetDeviceError( nullptr ) );
+
+		return false;
+	}
+
+	scene_ = rtcNewScene( device_ );
+	rtcSetSceneBuildQuality( scene_, RTC_BUILD_QUALITY_HIGH );
+
+	// no copies, SceneGeometry keeps one spare vertex so that Embree may read the last one with a 16-byte load
+	RTCGeometry mesh = rtcNewGeometry( device_, RTC_GEOMETRY_TYPE_TRIANGLE );
+	rtcSetSharedGeometryBuffer( mesh, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, geometry.vertices(), 0,
+		sizeof( Vertex3f ), geometry.no_vertices() );
+	rtcSetSharedGeometryBuffer( mesh, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, geometry.triangles(), 0,
+		sizeof( Triangle3ui ), geometry.no_triangles() );
+	rtcCommitGeometry( mesh );
+	geometry_id_ = rtcAttachGeometry( scene_, mesh );
+	rtcReleaseGeometry( mesh );
+
+	rtcCommitScene( scene_ );
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	build_time_ = std::chrono::duration<double>( t1 - t0 ).count();
+
+	printf( "Embree scene (%d triangles) built in %s.\n", geometry.no_triangles(), TimeToString( build_time_ ).c_str() );
+
+	return true;
+}
+
+void EmbreeScene::Update()
+{
+	if ( scene_ == nullptr ) return;
+
+	RTCGeometry mesh = rtcGetGeometry( scene_, geometry_id_ );
+	rtcUpdateGeometryBuffer( mesh, RTC_BUFFER_TYPE_VERTEX, 0 );
+	rtcCommitGeometry( mesh );
+	rtcCommitScene( scene_ );
+}
+
+bool EmbreeScene::Intersect( Ray & ray, RayHit & hit ) const
+{
+	if ( scene_ == nullptr ) return false;
+
+	RTCIntersectContext context;
+	rtcInitIntersectContext( &context );
+
+	RTCRayHit ray_hit;
+	ray_hit.ray.org_x = ray.origin.x;
+	ray_hit.ray.org_y = ray.origin.y;
+	ray_hit.ray.org_z = ray.origin.z;
+	ray_hit.ray.tnear = ray.t_near;
+	ray_hit.ray.dir_x = ray.direction.x;
+	ray_hit.ray.dir_y = ray.direction.y;
+	ray_hit.ray.dir_z = ray.direction.z;
+	ray_hit.ray.time = 0.0f;
+	ray_hit.ray.tfar = ray.t_far;
+	ray_hit.ray.mask = 0xffffffff;
+	ray_hit.ray.id = 0;
+	ray_hit.ray.flags = 0;
+	ray_hit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	ray_hit.hit.primID = RTC_INVALID_GEOMETRY_ID;
+	ray_hit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+
+	rtcIntersect1( scene_, &context, &ray_hit );
+
+	if ( ray_hit.hit.geomID == RTC_INVALID_GEOMETRY_ID ) return false;
+
+	// Embree barycentrics follow the same convention as rtGetTriangleBarycentrics
+	ray.t_far = ray_hit.ray.tfar;
+	hit.triangle_id = static_cast<int>( ray_hit.hit.primID );
+	hit.u = ray_hit.hit.u;
+	hit.v = ray_hit.hit.v;
+
+	return true;
+}
+
+bool EmbreeScene::Occluded( const Ray & ray ) const
+{
+	if ( scene_ == nullptr ) return false;
+
+	RTCIntersectContext context;
+	rtcInitIntersectContext( &context );
+
+	RTCRay rtc_ray;
+	rtc_ray.org_x = ray.origin.x;
+	rtc_ray.org_y = ray.origin.y;
+	rtc_ray.org_z = ray.origin.z;
+	rtc_ray.tnear = ray.t_near;
+	rtc_ray.dir_x = ray.direction.x;
+	rtc_ray.dir_y = ray.direction.y;
+	rtc_ray.dir_z = ray.direction.z;
+	rtc_ray.time = 0.0f;
+	rtc_ray.tfar = ray.t_far;
+	rtc_ray.mask = 0xffffffff;
+	rtc_ray.id = 0;
+	rtc_ray.flags = 0;
+
+	rtcOccluded1( scene_, &context, &rtc_ray );
+
+	// tfar is set to -inf when an occluder is found
+	return rtc_ray.tfar < 0.0f;
+}
+
+void EmbreeScene::Release()
+{
+	if ( scene_ != nullptr )
+	{
+		rtcReleaseScene( scene_ );
+		scene_ = nullptr;
+	}
+
+	if ( device_ != nullptr )
+	{
+		rtcReleaseDevice( device_ );
+		device_ = nullptr;
+	}
+}
+
+#else
+
+EmbreeScene::~EmbreeScene()
+{
+}
+
+bool EmbreeScene::Build( const SceneGeometry & geometry )
+{
+	geometry_ = &geometry;
+	printf( "Embree backend is not available, define USE_EMBREE to enable it.\n" );
+
+	return false;
+}
+
+void EmbreeScene::Update()
+{
+}
+
+bool EmbreeScene::Intersect( Ray & ray, RayHit & hit ) const
+{
+	return false;
+}
+
+bool EmbreeScene::Occluded( const Ray & ray ) const
+{
+	return false;
+}
+
+void EmbreeScene::Release()
+{
+}
+
+#endif
+
+bool EmbreeScene::is_valid() const
+{
+	return scene_ != nullptr;
+}
+
+double EmbreeScene::build_time() const
+{
+	return build_time_;
+}
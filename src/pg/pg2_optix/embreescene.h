@@ -0,0 +1,50 @@
+#ifndef EMBREE_SCENE_H_
+#define EMBREE_SCENE_H_
+
+#include "ray.h"
+#include "scenegeometry.h"
+
+struct RTCDeviceTy;
+struct RTCSceneTy;
+
+/*! \class EmbreeScene
+\brief Optional Intel Embree 3 counterpart of Bvh with the same queries.
+
+Embree reads vertices and triangles directly from SceneGeometry through shared buffers,
+Vertex3f and Triangle3ui match RTC_FORMAT_FLOAT3 and RTC_FORMAT_UINT3. The class is always
+available, without USE_EMBREE it just reports that the backend is missing and finds no hits.
+*/
+class EmbreeScene
+{
+public:
+	~EmbreeScene();
+
+	/* builds the Embree scene over the geometry buffers, returns false if Embree is not available */
+	bool Build( const SceneGeometry & geometry );
+
+	/* recommits the scene after vertex positions have changed */
+	void Update();
+
+	/* the same semantics as Bvh::Intersect */
+	bool Intersect( Ray & ray, RayHit & hit ) const;
+
+	/* the same semantics as Bvh::Occluded */
+	bool Occluded( const Ray & ray ) const;
+
+	bool is_valid() const;
+
+	/* wall time of the last build in seconds */
+	double build_time() const;
+
+private:
+	void Release();
+
+	const SceneGeometry * geometry_{ nullptr };
+
+	RTCDeviceTy * device_{ nullptr };
+	RTCSceneTy * scene_{ nullptr };
+	unsigned int geometry_id_{ 0 };
+	double build_time_{ 0.0 };
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "pch.h"
+#include "gbuffer.h"
+#include "scenegeometry.h"
+#include "rng.h"
+#include "mymath.h"
+
+namespace
+{
+	template <class T> void Allocate( std::vector<T> & output, const bool requested, const size_t size, const T miss )
+	{
+		if ( requested ) output.resize( size, miss );
+		else std::vector<T>().swap( output );
+	}
+
+	/* distinct colors of consecutive ids */
+	unsigned int IdColor( const unsigned int id )
+	{
+		return PcgHash( id ) | ( 255u << 24 );
+	}
+}
+
+bool GBuffer::has( const Aov aov ) const
+{
+	return ( outputs & aov_bit( aov ) ) != 0;
+}
+
+void GBuffer::resize( const int width, const int height )
+{
+	this->width = width;
+	this->height = height;
+	const size_t no_pixels = size_t( width ) * height;
+
+	Allocate( depth, has( Aov::DEPTH ), no_pixels, 0.0f );
+	Allocate( normal, has( Aov::NORMAL ), no_pixels, 0u );
+	Allocate( albedo, has( Aov::ALBEDO ), no_pixels, 0xffffffffu );
+	Allocate( material, has( Aov::MATERIAL ), no_pixels, kNoMaterial );
+	Allocate( primitive, has( Aov::PRIMITIVE ), no_pixels, -1 );
+}
+
+void GBuffer::Write( const int pixel, const SceneGeometry & geometry, const int triangle_id, const float u, const float v, const float t,
+	const Vector3 & shading_normal )
+{
+	const bool hit = triangle_id >= 0;
+
+	if ( has( Aov::DEPTH ) ) depth[pixel] = ( hit ) ? t : 0.0f;
+	if ( has( Aov::NORMAL ) ) normal[pixel] = ( hit ) ? EncodeOctahedral( shading_normal.x, shading_normal.y, shading_normal.z ) : 0u;
+	if ( has( Aov::PRIMITIVE ) ) primitive[pixel] = triangle_id;
+
+	if ( has( Aov::ALBEDO ) )
+	{
+		if ( hit )
+		{
+			const Color3f a = geometry.albedo( triangle_id, u, v );
+			albedo[pixel] = PackRgba8( a.r, a.g, a.b );
+		}
+		else
+		{
+			albedo[pixel] = 0xffffffffu;
+		}
+	}
+
+	if ( has( Aov::MATERIAL ) )
+	{
+		material[pixel] = ( hit ) ? static_cast<unsigned short>( geometry.material( triangle_id )->materialIndex ) : kNoMaterial;
+	}
+}
+
+Vector3 GBuffer::decoded_normal( const int pixel ) const
+{
+	const unsigned int bits = normal[pixel];
+	const float u = max( short( bits & 0xffff ) / 32767.0f, -1.0f );
+	const float v = max( short( bits >> 16 ) / 32767.0f, -1.0f );
+
+	Vector3 n( u, v, 1.0f - fabsf( u ) - fabsf( v ) );
+
+	if ( n.z < 0.0f )
+	{
+		n.x = ( 1.0f - fabsf( v ) ) * ( ( u >= 0.0f ) ? 1.0f : -1.0f );
+		n.y = ( 1.0f - fabsf( u ) ) * ( ( v >= 0.0f ) ? 1.0f : -1.0f );
+	}
+
+	n.Normalize();
+
+	return n;
+}
+
+Color3f GBuffer::decoded_albedo( const int pixel ) const
+{
+	const unsigned int bits = albedo[pixel];
+
+	return Color3f( ( bits & 0xff ) / 255.0f, ( ( bits >> 8 ) & 0xff ) / 255.0f, ( ( bits >> 16 ) & 0xff ) / 255.0f );
+}
+
+void GBuffer::Visualize( const Aov aov, BYTE * buffer ) const
+{
+	if ( !has( aov ) ) return;
+
+	const int no_pixels = width * height;
+	unsigned int * rgba = reinterpret_cast<unsigned int *>( buffer );
+
+	// the farthest hit is black and the camera white
+	float max_depth = 0.0f;
+	if ( aov == Aov::DEPTH ) for ( const float t : depth ) max_depth = max( max_depth, t );
+
+	for ( int p = 0; p < no_pixels; ++p )
+	{
+		switch ( aov )
+		{
+		case Aov::DEPTH:
+			{
+				const float grey = ( depth[p] > 0.0f ) ? 1.0f - depth[p] / max_depth : 0.0f;
+				rgba[p] = PackRgba8( grey, grey, grey );
+			}
+			break;
+
+		case Aov::NORMAL:
+			{
+				const Vector3 n = decoded_normal( p );
+				rgba[p] = PackRgba8( n.x * 0.5f + 0.5f, n.y * 0.5f + 0.5f, n.z * 0.5f + 0.5f );
+			}
+			break;
+
+		case Aov::ALBEDO:
+			rgba[p] = albedo[p];
+			break;
+
+		case Aov::MATERIAL:
+			rgba[p] = ( material[p] != kNoMaterial ) ? IdColor( material[p] ) : PackRgba8( 0.0f, 0.0f, 0.0f );
+			break;
+
+		case Aov::PRIMITIVE:
+			rgba[p] = ( primitive[p] >= 0 ) ? IdColor( primitive[p] ) : PackRgba8( 0.0f, 0.0f, 0.0f );
+			break;
+		}
+	}
+}
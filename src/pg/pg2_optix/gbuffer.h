@@ -0,0 +1,97 @@
+#ifndef G_BUFFER_H_
+#define G_BUFFER_H_
+
+// included by optixtutorial.cu as well so that both backends encode outputs the same way
+#ifdef __CUDACC__
+#define GBUFFER_FUNC __host__ __device__ __forceinline__
+#else
+#define GBUFFER_FUNC inline
+#endif
+
+/* auxiliary outputs of primary hits, the bits of the values form the aov_outputs context variable */
+enum class Aov : int { DEPTH = 0, NORMAL = 1, ALBEDO = 2, MATERIAL = 3, PRIMITIVE = 4 };
+
+static const int kNoAovs = 5;
+static const unsigned short kNoMaterial = 0xffff; /*!< Material index of pixels whose rays missed the scene. */
+
+GBUFFER_FUNC unsigned int aov_bit( const Aov aov )
+{
+	return 1u << int( aov );
+}
+
+/* unit vector mapped onto the octahedron and its unfolded square stored as two 16-bit signed normalized integers */
+GBUFFER_FUNC unsigned int EncodeOctahedral( const float x, const float y, const float z )
+{
+	const float l1 = fabsf( x ) + fabsf( y ) + fabsf( z );
+	if ( l1 == 0.0f ) return 0;
+
+	float u = x / l1;
+	float v = y / l1;
+
+	if ( z < 0.0f )
+	{
+		// the lower half folds over the diagonals
+		const float folded_u = ( 1.0f - fabsf( v ) ) * ( ( u >= 0.0f ) ? 1.0f : -1.0f );
+		v = ( 1.0f - fabsf( u ) ) * ( ( v >= 0.0f ) ? 1.0f : -1.0f );
+		u = folded_u;
+	}
+
+	const int su = int( floorf( u * 32767.0f + 0.5f ) );
+	const int sv = int( floorf( v * 32767.0f + 0.5f ) );
+
+	return ( unsigned int )( su & 0xffff ) | ( ( unsigned int )( sv & 0xffff ) << 16 );
+}
+
+/* color clamped into <0, 1> as RGBA bytes with the alpha of 255, the byte order of output_buffer */
+GBUFFER_FUNC unsigned int PackRgba8( const float r, const float g, const float b )
+{
+	const unsigned int r8 = ( unsigned int )( fminf( fmaxf( r, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+	const unsigned int g8 = ( unsigned int )( fminf( fmaxf( g, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+	const unsigned int b8 = ( unsigned int )( fminf( fmaxf( b, 0.0f ), 1.0f ) * 255.0f + 0.5f );
+
+	return r8 | ( g8 << 8 ) | ( b8 << 16 ) | ( 255u << 24 );
+}
+
+#ifndef __CUDACC__
+#include "structs.h"
+
+class SceneGeometry;
+
+/*! \struct GBuffer
+\brief Auxiliary outputs (AOVs) of the primary hits of a frame, one element per pixel in the scanline order.
+
+Written by the CPU tracers and read back from the OptiX launch along with the color. Only the
+outputs whose bits are set in outputs are allocated, the others stay empty, and each one is
+kept in a compact format: 4 bytes per pixel for the depth, the octahedral normal, the RGBA8
+albedo and the primitive id and 2 bytes for the material index. Pixels of rays which missed
+the scene have zero depth, the +z normal, white albedo, kNoMaterial and the primitive id -1.
+*/
+struct GBuffer
+{
+	unsigned int outputs{ 0 }; /*!< Bits of the requested outputs, see aov_bit. */
+	int width{ 0 };
+	int height{ 0 };
+	std::vector<float> depth; /*!< Distance of the hit from the camera. */
+	std::vector<unsigned int> normal; /*!< Shading normal in world space facing the camera, see EncodeOctahedral. */
+	std::vector<unsigned int> albedo; /*!< Diffuse color of the hit including its texture, see PackRgba8. */
+	std::vector<unsigned short> material; /*!< Material::materialIndex of the hit triangle. */
+	std::vector<int> primitive; /*!< Index of the hit triangle, i.e. rtGetPrimitiveIndex. */
+
+	bool has( const Aov aov ) const;
+
+	/* allocates the requested outputs for the frame size and releases the others */
+	void resize( const int width, const int height );
+
+	/* stores the requested outputs of the pixel, a negative triangle id marks a miss */
+	void Write( const int pixel, const SceneGeometry & geometry, const int triangle_id, const float u, const float v, const float t,
+		const Vector3 & shading_normal );
+
+	Vector3 decoded_normal( const int pixel ) const;
+	Color3f decoded_albedo( const int pixel ) const;
+
+	/* draws the output into the RGBA buffer for debugging, depth in grey, normals and albedo as colors and ids in random colors */
+	void Visualize( const Aov aov, BYTE * buffer ) const;
+};
+#endif
+
+#endif
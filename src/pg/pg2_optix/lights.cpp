@@ -0,0 +1,250 @@
+#include "pch.h"
+#include "lights.h"
+#include "mymath.h"
+#include "utils.h"
+
+const Vector3 LightList::kDefaultLightPosition( 100.0f, 100.0f, 200.0f ); // the point light of attribute_program
+
+void AliasTable::Build( const std::vector<float> & weights )
+{
+	const int n = static_cast<int>( weights.size() );
+	double sum = 0.0;
+	for ( const float w : weights ) sum += w;
+
+	probability_.assign( n, 1.0f );
+	alias_.resize( n );
+	pdf_.resize( n );
+
+	if ( sum <= 0.0 )
+	{
+		probability_.clear();
+		alias_.clear();
+		pdf_.clear();
+
+		return;
+	}
+
+	// weights scaled so that the average bin holds one
+	std::vector<double> scaled( n );
+	std::vector<int> small, large;
+
+	for ( int i = 0; i < n; ++i )
+	{
+		pdf_[i] = float( weights[i] / sum );
+		scaled[i] = weights[i] * n / sum;
+		alias_[i] = i;
+		( ( scaled[i] < 1.0 ) ? small : large ).push_back( i );
+	}
+
+	while ( !small.empty() && !large.empty() )
+	{
+		const int s = small.back();
+		small.pop_back();
+		const int l = large.back();
+
+		// the rest of the underfull bin is taken from the overfull one
+		probability_[s] = float( scaled[s] );
+		alias_[s] = l;
+		scaled[l] -= 1.0 - scaled[s];
+
+		if ( scaled[l] < 1.0 )
+		{
+			large.pop_back();
+			small.push_back( l );
+		}
+	}
+
+	// bins left in either list are full up to rounding errors
+	for ( const int i : small ) probability_[i] = 1.0f;
+	for ( const int i : large ) probability_[i] = 1.0f;
+}
+
+int AliasTable::Sample( const float u ) const
+{
+	const int n = size();
+	const float x = u * n;
+	const int i = min( int( x ), n - 1 );
+
+	return ( x - i < probability_[i] ) ? i : alias_[i];
+}
+
+float AliasTable::pdf( const int i ) const
+{
+	return pdf_[i];
+}
+
+int AliasTable::size() const
+{
+	return static_cast<int>( probability_.size() );
+}
+
+const std::vector<float> & AliasTable::probabilities() const
+{
+	return probability_;
+}
+
+const std::vector<int> & AliasTable::aliases() const
+{
+	return alias_;
+}
+
+void LightList::Build( const SceneGeometry & geometry )
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	geometry_ = &geometry;
+	triangles_.clear();
+	emission_.clear();
+	area_.clear();
+
+	std::vector<float> weights;
+	std::vector<LightTree::Light> tree_lights;
+	power_ = 0.0f;
+
+	for ( int i = 0; i < geometry.no_triangles(); ++i )
+	{
+		const Color3f emission = geometry.material( i )->emission();
+		const float area = 0.5f * ( geometry.position( i, 1 ) - geometry.position( i, 0 ) ).CrossProduct(
+			geometry.position( i, 2 ) - geometry.position( i, 0 ) ).L2Norm();
+
+		// emitted power of a two-sided Lambertian emitter up to the constant factor 2 pi
+		const float power = Luminance( emission ) * area;
+		if ( power <= 0.0f ) continue;
+
+		triangles_.push_back( i );
+		emission_.push_back( emission );
+		area_.push_back( area );
+		weights.push_back( power );
+		tree_lights.push_back( { { geometry.position( i, 0 ), geometry.position( i, 1 ), geometry.position( i, 2 ) },
+			normal( no_lights() - 1 ), power } );
+		power_ += power;
+	}
+
+	table_.Build( weights );
+	tree_.Build( tree_lights );
+
+	if ( no_lights() > 0 )
+	{
+		printf( "Light list (%d emissive triangles, tree depth %d) built in %s.\n", no_lights(), tree_.depth(),
+			TimeToString( std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count() ).c_str() );
+	}
+}
+
+int LightList::no_lights() const
+{
+	return static_cast<int>( triangles_.size() );
+}
+
+LightSample LightList::Sample( const Vector3 & point, const Vector3 & normal, RandomStream & rng, const LightSampling sampling ) const
+{
+	if ( no_lights() == 0 ) return DefaultLight( point );
+
+	// all three numbers are drawn so that the next light point starts at the same dimension in both modes
+	const float w = rng.next();
+	const float u = rng.next();
+	const float v = rng.next();
+
+	if ( sampling == LightSampling::TREE )
+	{
+		float probability;
+		const int i = tree_.Sample( point, normal, w, probability );
+		if ( i < 0 ) return LightSample();
+
+		return ConnectLight( point, this->point( i, u, v ), this->normal( i ), emission_[i], probability / area_[i] );
+	}
+
+	const int i = table_.Sample( w );
+
+	return ConnectLight( point, this->point( i, u, v ), this->normal( i ), emission_[i], pdf( i ) );
+}
+
+LightSample LightList::DefaultLight( const Vector3 & point )
+{
+	LightSample sample;
+	sample.direction = kDefaultLightPosition - point;
+	sample.direction.Normalize();
+	sample.radiance = Color3f( 1.0f, 1.0f, 1.0f );
+
+	return sample;
+}
+
+float LightList::pdf( const int i ) const
+{
+	return table_.pdf( i ) / area_[i];
+}
+
+int LightList::triangle_id( const int i ) const
+{
+	return triangles_[i];
+}
+
+const Color3f & LightList::emission( const int i ) const
+{
+	return emission_[i];
+}
+
+const AliasTable & LightList::table() const
+{
+	return table_;
+}
+
+const LightTree & LightList::tree() const
+{
+	return tree_;
+}
+
+float LightList::power() const
+{
+	return power_;
+}
+
+Vector3 LightList::point( const int i, const float u, const float v ) const
+{
+	// uniform barycentrics by the square root mapping
+	const float su = sqrtf( u );
+	const float b1 = 1.0f - su;
+	const float b2 = v * su;
+
+	const int t = triangles_[i];
+
+	return geometry_->position( t, 0 ) * ( 1.0f - b1 - b2 ) + geometry_->position( t, 1 ) * b1 + geometry_->position( t, 2 ) * b2;
+}
+
+Vector3 LightList::normal( const int i ) const
+{
+	const int t = triangles_[i];
+	Vector3 n = ( geometry_->position( t, 1 ) - geometry_->position( t, 0 ) ).CrossProduct(
+		geometry_->position( t, 2 ) - geometry_->position( t, 0 ) );
+	n.Normalize();
+
+	return n;
+}
+
+float LightList::area( const int i ) const
+{
+	return area_[i];
+}
+
+float Luminance( const Color3f & c )
+{
+	return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
+LightSample ConnectLight( const Vector3 & point, const Vector3 & light_point, const Vector3 & light_normal, const Color3f & emission,
+	const float pdf )
+{
+	LightSample sample;
+	sample.direction = light_point - point;
+	const float distance_sqr = sample.direction.SqrL2Norm();
+	sample.distance = sqrtf( distance_sqr );
+
+	if ( sample.distance <= 0.0f || pdf <= 0.0f ) return sample;
+
+	sample.direction *= 1.0f / sample.distance;
+
+	// emitters are two-sided
+	const float cos_light = fabsf( light_normal.DotProduct( sample.direction ) );
+	sample.radiance = emission * ( cos_light / ( distance_sqr * pdf * float( M_PI ) ) );
+
+	return sample;
+}
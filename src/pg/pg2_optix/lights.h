@@ -0,0 +1,113 @@
+#ifndef LIGHTS_H_
+#define LIGHTS_H_
+
+#include "rng.h"
+#include "lighttree.h"
+
+static const unsigned int kLightDimension = 1u << 16; /*!< First dimension of the random numbers of light samples, far beyond those of AO rays. */
+static const int kMaxLightSamples = 64; /*!< Upper bound of light points per shading point and frame. */
+
+#ifndef __CUDACC__
+#include "scenegeometry.h"
+
+/*! \class AliasTable
+\brief Discrete distribution sampled in constant time (Walker, 1977, built by the method of Vose, 1991).
+
+Each of the n bins holds the probability of keeping its own index and the alias taken
+otherwise, the bins are filled by pairing an underfull entry with an overfull one so the
+table is built in O(n) and a sample costs one uniform number, one lookup and one comparison.
+*/
+class AliasTable
+{
+public:
+	/* the distribution proportional to non-negative weights, all zero weights give an empty table */
+	void Build( const std::vector<float> & weights );
+
+	/* index drawn with its probability by a single uniform number u in <0, 1) */
+	int Sample( const float u ) const;
+
+	/* probability of drawing the index */
+	float pdf( const int i ) const;
+
+	int size() const;
+
+	const std::vector<float> & probabilities() const;
+	const std::vector<int> & aliases() const;
+
+private:
+	std::vector<float> probability_; // of keeping the index of the bin
+	std::vector<int> alias_; // index taken otherwise
+	std::vector<float> pdf_;
+};
+
+/* a point on a light seen from the shading point */
+struct LightSample
+{
+	Vector3 direction; /*!< Unit vector from the shading point towards the light. */
+	float distance{ 0.0f }; /*!< Distance of the point on the light, zero for the default point light which casts no shadows. */
+	Color3f radiance; /*!< Emitted radiance times the cosine at the light over the squared distance, the pdf and pi, i.e. the factor of the diffuse color and the cosine at the shading point. */
+};
+
+/*! \class LightList
+\brief Emissive triangles of the scene, the alias table of their power and their light tree.
+
+Triangles whose material has a nonzero emission (Ke) become area lights, each one is drawn
+either with the probability proportional to its power, i.e. the luminance of the emission
+times the area, or by the light tree with the probability proportional to its importance for
+the shading point, and a point is then chosen uniformly on it. Scenes without emitters fall
+back to the point light at kDefaultLightPosition the shaders have always used.
+*/
+class LightList
+{
+public:
+	static const Vector3 kDefaultLightPosition;
+
+	/* collects emissive triangles, call whenever the geometry changes */
+	void Build( const SceneGeometry & geometry );
+
+	int no_lights() const;
+
+	/* a light point for the shading point with the unit normal drawn by three numbers of the stream, zero radiance if the tree finds no light reaching the point */
+	LightSample Sample( const Vector3 & point, const Vector3 & normal, RandomStream & rng, const LightSampling sampling ) const;
+
+	/* the point light at kDefaultLightPosition with unit radiance */
+	static LightSample DefaultLight( const Vector3 & point );
+
+	/* probability density of the light point with respect to the area when lights are drawn by their power */
+	float pdf( const int i ) const;
+
+	int triangle_id( const int i ) const;
+	const Color3f & emission( const int i ) const;
+	const AliasTable & table() const;
+	const LightTree & tree() const;
+
+	/* sum of the power of all lights */
+	float power() const;
+
+	/* point on the light by two uniform numbers, the same mapping as the device uses */
+	Vector3 point( const int i, const float u, const float v ) const;
+
+	/* geometric unit normal of the light */
+	Vector3 normal( const int i ) const;
+
+	float area( const int i ) const;
+
+private:
+	const SceneGeometry * geometry_{ nullptr };
+	std::vector<int> triangles_;
+	std::vector<Color3f> emission_;
+	std::vector<float> area_;
+	AliasTable table_;
+	LightTree tree_;
+	float power_{ 0.0f };
+};
+
+/* luminance of a linear RGB color */
+float Luminance( const Color3f & c );
+
+/* sample of the light point with the given area density as seen from the shading point */
+LightSample ConnectLight( const Vector3 & point, const Vector3 & light_point, const Vector3 & light_normal, const Color3f & emission,
+	const float pdf );
+#endif
+
+#endif
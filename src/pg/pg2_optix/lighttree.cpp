@@ -0,0 +1,246 @@
+#include "pch.h"
+#include "lighttree.h"
+#include "aabb.h"
+#include "mymath.h"
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	const int kNoBins = 12;
+
+	/* two-sided orientation cone, i.e. the axis bounds lines rather than directions */
+	struct Cone
+	{
+		Vector3 axis;
+		float theta_o{ -1.0f }; // negative for an empty cone
+
+		void merge( Vector3 n, float theta )
+		{
+			if ( theta_o < 0.0f )
+			{
+				axis = n;
+				theta_o = theta;
+
+				return;
+			}
+
+			// the other side of the line is as good as this one
+			if ( axis.DotProduct( n ) < 0.0f ) n = -n;
+
+			Vector3 a = axis;
+			float theta_a = theta_o;
+
+			if ( theta > theta_a )
+			{
+				std::swap( a, n );
+				std::swap( theta_a, theta );
+			}
+
+			const float theta_d = acosf( min( a.DotProduct( n ), 1.0f ) );
+
+			// the wider cone already contains the other one
+			if ( theta_d + theta <= theta_a )
+			{
+				axis = a;
+				theta_o = theta_a;
+
+				return;
+			}
+
+			theta_o = 0.5f * ( theta_a + theta_d + theta );
+
+			if ( theta_o >= kLightTreeHalfPi )
+			{
+				axis = a;
+				theta_o = kLightTreeHalfPi; // any line is within pi/2 of the axis
+
+				return;
+			}
+
+			// the axis rotated from a towards n so that both cones touch the new one
+			const float theta_r = theta_o - theta_a;
+			Vector3 ortho = n - a * a.DotProduct( n );
+			ortho.Normalize();
+			axis = a * cosf( theta_r ) + ortho * sinf( theta_r );
+			axis.Normalize();
+		}
+
+		/* solid angle measure of the cone including the emission of pi/2 beyond its spread */
+		float measure() const
+		{
+			const float theta_w = min( theta_o + kLightTreeHalfPi, float( M_PI ) );
+
+			return float( 2.0 * M_PI ) * ( 1.0f - cosf( theta_o ) ) + kLightTreeHalfPi * ( 2.0f * theta_w * sinf( theta_o ) -
+				cosf( theta_o - 2.0f * theta_w ) - 2.0f * theta_o * sinf( theta_o ) + cosf( theta_o ) );
+		}
+	};
+
+	/* bounds, orientation and power of a set of lights */
+	struct Cluster
+	{
+		AABB bounds;
+		Cone cone;
+		float power{ 0.0f };
+
+		void merge( const LightTree::Light & light )
+		{
+			for ( const Vector3 & v : light.vertices ) bounds.merge( v );
+			cone.merge( light.normal, 0.0f );
+			power += light.power;
+		}
+
+		void merge( const Cluster & c )
+		{
+			if ( c.cone.theta_o < 0.0f ) return;
+
+			bounds.merge( c.bounds );
+			cone.merge( c.cone.axis, c.cone.theta_o );
+			power += c.power;
+		}
+
+		/* the surface area orientation heuristic of the cluster without its regularization */
+		float cost() const
+		{
+			return ( cone.theta_o < 0.0f ) ? 0.0f : power * bounds.area() * cone.measure();
+		}
+	};
+
+	Vector3 centroid( const LightTree::Light & light )
+	{
+		return ( light.vertices[0] + light.vertices[1] + light.vertices[2] ) / 3.0f;
+	}
+}
+
+void LightTree::Build( const std::vector<Light> & lights )
+{
+	const int n = static_cast<int>( lights.size() );
+
+	nodes_.clear();
+	indices_.resize( n );
+	std::iota( indices_.begin(), indices_.end(), 0 );
+	depth_ = 0;
+
+	if ( n == 0 ) return;
+
+	nodes_.reserve( 2 * n - 1 );
+	nodes_.emplace_back();
+	depth_ = Build( lights, 0, n, 0 );
+}
+
+int LightTree::Build( const std::vector<Light> & lights, const int first, const int last, const int node )
+{
+	Cluster cluster;
+	AABB centroid_bounds;
+
+	for ( int i = first; i < last; ++i )
+	{
+		cluster.merge( lights[indices_[i]] );
+		centroid_bounds.merge( centroid( lights[indices_[i]] ) );
+	}
+
+	LightTreeNode & n = nodes_[node];
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		n.bounds_min[i] = cluster.bounds.lower.data[i];
+		n.bounds_max[i] = cluster.bounds.upper.data[i];
+		n.axis[i] = cluster.cone.axis.data[i];
+	}
+
+	n.cos_theta_o = cosf( cluster.cone.theta_o );
+	n.power = cluster.power;
+	n.right = -1;
+	n.light = ( last - first == 1 ) ? indices_[first] : -1;
+
+	if ( last - first == 1 ) return 1;
+
+	// binned SAOH over all three axes, long thin boxes are regularized towards their longest axis
+	const Vector3 extent = cluster.bounds.extent();
+	const float max_extent = max( extent.x, max( extent.y, extent.z ) );
+	float best_cost = FLT_MAX;
+	int best_axis = -1;
+	int best_bin = 0;
+
+	for ( int axis = 0; axis < 3; ++axis )
+	{
+		const float c_min = centroid_bounds.lower.data[axis];
+		const float c_extent = centroid_bounds.upper.data[axis] - c_min;
+		if ( c_extent <= 0.0f ) continue;
+
+		const float k = kNoBins * ( 1.0f - 1e-4f ) / c_extent;
+		Cluster bins[kNoBins];
+
+		for ( int i = first; i < last; ++i )
+		{
+			const Light & light = lights[indices_[i]];
+			bins[min( kNoBins - 1, int( k * ( centroid( light ).data[axis] - c_min ) ) )].merge( light );
+		}
+
+		Cluster right[kNoBins];
+		for ( int b = kNoBins - 1; b > 0; --b )
+		{
+			right[b] = bins[b];
+			if ( b + 1 < kNoBins ) right[b].merge( right[b + 1] );
+		}
+
+		const float regularization = max_extent / max( extent.data[axis], 1e-12f );
+		Cluster left;
+
+		for ( int b = 1; b < kNoBins; ++b )
+		{
+			left.merge( bins[b - 1] );
+			if ( left.cone.theta_o < 0.0f || right[b].cone.theta_o < 0.0f ) continue;
+
+			const float cost = regularization * ( left.cost() + right[b].cost() );
+
+			if ( cost < best_cost )
+			{
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = b;
+			}
+		}
+	}
+
+	int middle = ( first + last ) / 2; // coincident centroids are split by count
+
+	if ( best_axis >= 0 )
+	{
+		const float c_min = centroid_bounds.lower.data[best_axis];
+		const float k = kNoBins * ( 1.0f - 1e-4f ) / ( centroid_bounds.upper.data[best_axis] - c_min );
+
+		middle = static_cast<int>( std::partition( indices_.begin() + first, indices_.begin() + last, [&]( const int i )
+		{
+			return min( kNoBins - 1, int( k * ( centroid( lights[i] ).data[best_axis] - c_min ) ) ) < best_bin;
+		} ) - indices_.begin() );
+	}
+
+	const int left = static_cast<int>( nodes_.size() );
+	nodes_.emplace_back();
+	const int left_depth = Build( lights, first, middle, left );
+
+	const int right = static_cast<int>( nodes_.size() );
+	nodes_.emplace_back();
+	nodes_[node].right = right;
+	const int right_depth = Build( lights, middle, last, right );
+
+	return 1 + max( left_depth, right_depth );
+}
+
+int LightTree::Sample( const Vector3 & point, const Vector3 & normal, const float u, float & probability ) const
+{
+	if ( nodes_.empty() ) return -1;
+
+	return SampleLightTree( nodes_, point.data, normal.data, u, probability );
+}
+
+const std::vector<LightTreeNode> & LightTree::nodes() const
+{
+	return nodes_;
+}
+
+int LightTree::depth() const
+{
+	return depth_;
+}
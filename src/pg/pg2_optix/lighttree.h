@@ -0,0 +1,157 @@
+#ifndef LIGHT_TREE_H_
+#define LIGHT_TREE_H_
+
+// included by optixtutorial.cu as well so that both backends walk the tree the same way
+#ifdef __CUDACC__
+#define LIGHTS_FUNC __host__ __device__ __forceinline__
+#else
+#define LIGHTS_FUNC inline
+#endif
+
+/* how light points are chosen among the emitters, the values are shared with the light_sampling context variable */
+enum class LightSampling : int { POWER = 0, TREE = 1 };
+
+static const float kLightTreeHalfPi = 1.57079633f;
+
+/*! \struct LightTreeNode
+\brief Node of the light tree in the depth-first order, the left child follows its parent.
+
+The orientation cone bounds the lines of the normals of the emitters below the node, i.e.
+the emitters are two-sided and a cone never needs a spread beyond pi/2. Emission of each
+point spreads over the hemisphere on either side of the normal.
+*/
+struct LightTreeNode
+{
+	float bounds_min[3];
+	float bounds_max[3];
+	float axis[3]; /*!< Unit axis of the orientation cone. */
+	float cos_theta_o; /*!< Cosine of the largest angle between the axis and the line of a normal below the node. */
+	float power; /*!< Sum of the power of the emitters below the node. */
+	int right; /*!< Index of the right child of an interior node. */
+	int light; /*!< Index of the light in LightList of a leaf, -1 for interior nodes. */
+};
+
+/* cosine of max(0, theta - delta) given by the cosines and the sine of delta, the trigonometric functions are avoided */
+LIGHTS_FUNC float ReducedCosine( const float cos_theta, const float cos_delta, const float sin_delta )
+{
+	if ( cos_theta >= cos_delta ) return 1.0f;
+
+	const float sin_theta = sqrtf( fmaxf( 0.0f, 1.0f - cos_theta * cos_theta ) );
+
+	return cos_theta * cos_delta + sin_theta * sin_delta;
+}
+
+/* upper bound of the contribution of the emitters below the node to the point with the unit normal (Conty Estevez and Kulla, Importance Sampling of Many Lights with Adaptive Tree Splitting, 2018) */
+LIGHTS_FUNC float LightImportance( const LightTreeNode & node, const float point[3], const float normal[3] )
+{
+	float d[3], extent_sqr = 0.0f, distance_sqr = 0.0f;
+
+	for ( int i = 0; i < 3; ++i )
+	{
+		d[i] = 0.5f * ( node.bounds_min[i] + node.bounds_max[i] ) - point[i];
+		extent_sqr += ( node.bounds_max[i] - node.bounds_min[i] ) * ( node.bounds_max[i] - node.bounds_min[i] );
+		distance_sqr += d[i] * d[i];
+	}
+
+	// points inside the bounding sphere may see the emitters from any direction
+	const float radius_sqr = 0.25f * extent_sqr;
+	if ( distance_sqr <= radius_sqr ) return node.power / fmaxf( radius_sqr, 1e-12f );
+
+	const float distance = sqrtf( distance_sqr );
+	const float sin_u = sqrtf( radius_sqr ) / distance; // half-angle of the bounding sphere
+	const float cos_u = sqrtf( fmaxf( 0.0f, 1.0f - sin_u * sin_u ) );
+	const float cos_axis = fminf( fabsf( node.axis[0] * d[0] + node.axis[1] * d[1] + node.axis[2] * d[2] ) / distance, 1.0f );
+	const float cos_normal = fmaxf( -1.0f, fminf( ( normal[0] * d[0] + normal[1] * d[1] + normal[2] * d[2] ) / distance, 1.0f ) );
+	const float sin_o = sqrtf( fmaxf( 0.0f, 1.0f - node.cos_theta_o * node.cos_theta_o ) );
+
+	// the angles reduced by the cone and the bounding sphere, beyond pi/2 no point emits towards or receives from the other
+	const float cos_light = ReducedCosine( ReducedCosine( cos_axis, node.cos_theta_o, sin_o ), cos_u, sin_u );
+	const float cos_point = ReducedCosine( cos_normal, cos_u, sin_u );
+	if ( cos_light <= 0.0f || cos_point <= 0.0f ) return 0.0f;
+
+	return node.power * cos_light * cos_point / distance_sqr;
+}
+
+/* descends from the root choosing children by their importance with the single uniform number u, returns the light and its probability or -1 if no light reaches the point */
+template <class Nodes>
+LIGHTS_FUNC int SampleLightTree( Nodes & nodes, const float point[3], const float normal[3], float u, float & probability )
+{
+	int node = 0;
+	probability = 1.0f;
+
+	while ( nodes[node].light < 0 )
+	{
+		const int left = node + 1;
+		const int right = nodes[node].right;
+		const float importance_left = LightImportance( nodes[left], point, normal );
+		const float importance_right = LightImportance( nodes[right], point, normal );
+		const float sum = importance_left + importance_right;
+
+		if ( !( sum > 0.0f ) ) return -1;
+
+		// u is rescaled into the chosen interval and reused by the next level
+		const float p = importance_left / sum;
+
+		if ( u < p )
+		{
+			u = u / p;
+			probability *= p;
+			node = left;
+		}
+		else
+		{
+			u = ( u - p ) / ( 1.0f - p );
+			probability *= 1.0f - p;
+			node = right;
+		}
+
+		u = fminf( u, 0.99999994f );
+	}
+
+	return nodes[node].light;
+}
+
+#ifndef __CUDACC__
+#include "vector3.h"
+
+/*! \class LightTree
+\brief Binary tree over emitters sampled stochastically per shading point.
+
+Every node bounds the positions, the orientations and the power of the emitters below it.
+A light is drawn by descending from the root and choosing each child with the probability
+proportional to its importance for the shading point, so nearby emitters facing the point
+are preferred over distant or turned away ones, which the power alone does not see. The
+tree is split by the surface area orientation heuristic over binned centroids.
+*/
+class LightTree
+{
+public:
+	/* an emitter of the tree, the normal is its geometric unit normal */
+	struct Light
+	{
+		Vector3 vertices[3];
+		Vector3 normal;
+		float power;
+	};
+
+	/* builds the tree over the lights, their order gives the indices the leaves hold */
+	void Build( const std::vector<Light> & lights );
+
+	/* index of the light drawn for the point with its probability, -1 if no light reaches the point */
+	int Sample( const Vector3 & point, const Vector3 & normal, const float u, float & probability ) const;
+
+	const std::vector<LightTreeNode> & nodes() const;
+
+	int depth() const;
+
+private:
+	/* the subtree of lights [first, last) of indices_ starting at the node, returns the depth of the subtree */
+	int Build( const std::vector<Light> & lights, const int first, const int last, const int node );
+
+	std::vector<LightTreeNode> nodes_;
+	std::vector<int> indices_;
+	int depth_{ 0 };
+};
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "mymath.h"
+#include "utils.h"
 
 unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned long long mix )
 {
@@ -14,3 +15,96 @@ unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned l
 
 	return mix ^ ( mix << 37 );
 }
+
+Vector3 SampleHemisphere( const Vector3 & normal, const float random_x, const float random_y )
+{
+	const float r = 2.0f * sqrtf( random_y * ( 1.0f - random_y ) );
+	Vector3 omega_i( r * cosf( 2.0f * float( M_PI ) * random_x ), r * sinf( 2.0f * float( M_PI ) * random_x ), 1.0f - 2.0f * random_y );
+
+	if ( omega_i.DotProduct( normal ) < 0.0f )
+	{
+		omega_i *= -1.0f;
+	}
+
+	return omega_i;
+}
+
+Vector3 SampleCosineHemisphere( const Vector3 & normal, const float random_x, const float random_y )
+{
+	// a uniform disk sample lifted onto the hemisphere (Malley's method)
+	const float r = sqrtf( random_x );
+	const float phi = 2.0f * float( M_PI ) * random_y;
+	const float z = sqrtf( max( 0.0f, 1.0f - random_x ) );
+
+	// tangent frame of the normal (Duff et al., Building an Orthonormal Basis, Revisited, 2017)
+	const float sign = copysignf( 1.0f, normal.z );
+	const float a = -1.0f / ( sign + normal.z );
+	const float b = normal.x * normal.y * a;
+	const Vector3 tangent( 1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x );
+	const Vector3 bitangent( b, sign + normal.y * normal.y * a, -normal.y );
+
+	return tangent * ( r * cosf( phi ) ) + bitangent * ( r * sinf( phi ) ) + normal * z;
+}
+
+namespace
+{
+	/* spreads the lower 10 bits so that there are two zero bits between each pair of them */
+	inline unsigned int SpreadBits3( unsigned int x )
+	{
+		x &= 0x3ff;
+		x = ( x | ( x << 16 ) ) & 0x30000ff;
+		x = ( x | ( x << 8 ) ) & 0x300f00f;
+		x = ( x | ( x << 4 ) ) & 0x30c30c3;
+		x = ( x | ( x << 2 ) ) & 0x9249249;
+
+		return x;
+	}
+
+	/* spreads the lower 16 bits so that there is a zero bit between each pair of them */
+	inline unsigned int SpreadBits2( unsigned int x )
+	{
+		x &= 0xffff;
+		x = ( x | ( x << 8 ) ) & 0x00ff00ff;
+		x = ( x | ( x << 4 ) ) & 0x0f0f0f0f;
+		x = ( x | ( x << 2 ) ) & 0x33333333;
+		x = ( x | ( x << 1 ) ) & 0x55555555;
+
+		return x;
+	}
+}
+
+unsigned int Morton3( const unsigned int x, const unsigned int y, const unsigned int z )
+{
+	return SpreadBits3( x ) | ( SpreadBits3( y ) << 1 ) | ( SpreadBits3( z ) << 2 );
+}
+
+unsigned int Morton2( const unsigned int x, const unsigned int y )
+{
+	return SpreadBits2( x ) | ( SpreadBits2( y ) << 1 );
+}
+
+unsigned int Hilbert2( const unsigned int n, unsigned int x, unsigned int y )
+{
+	unsigned int d = 0;
+
+	for ( unsigned int s = n / 2; s > 0; s /= 2 )
+	{
+		const unsigned int rx = ( x & s ) ? 1 : 0;
+		const unsigned int ry = ( y & s ) ? 1 : 0;
+		d += s * s * ( ( 3 * rx ) ^ ry );
+
+		// rotate the quadrant so that the curve continues in the canonical orientation
+		if ( ry == 0 )
+		{
+			if ( rx == 1 )
+			{
+				x = n - 1 - x;
+				y = n - 1 - y;
+			}
+
+			utils::swap( x, y );
+		}
+	}
+
+	return d;
+}
@@ -52,6 +52,21 @@ inline Vector3 reflect( const Vector3 & v, const Vector3 & n )
 	return ( 2.0f*( v.DotProduct( n ) ) )*n - v;
 }
 
+/* uniform sphere sample flipped into the hemisphere around the normal, see SampleHemisphere in optixtutorial.cu */
+Vector3 SampleHemisphere( const Vector3 & normal, const float random_x, const float random_y );
+
+/* cosine-weighted hemisphere sample around the unit normal, the pdf is cos( theta ) / pi, see SampleCosineHemisphere in optixtutorial.cu */
+Vector3 SampleCosineHemisphere( const Vector3 & normal, const float random_x, const float random_y );
+
+/* interleaves the lower 10 bits of the coordinates into a 30 bit Morton code */
+unsigned int Morton3( const unsigned int x, const unsigned int y, const unsigned int z );
+
+/* interleaves the lower 16 bits of the coordinates into a 32 bit Morton code */
+unsigned int Morton2( const unsigned int x, const unsigned int y );
+
+/* distance of the cell (x, y) along the Hilbert curve filling the n x n grid, n is a power of two */
+unsigned int Hilbert2( const unsigned int n, unsigned int x, unsigned int y );
+
 unsigned long long QuickHash( const BYTE * data, const size_t length, unsigned long long mix = 0 );
 
 #endif
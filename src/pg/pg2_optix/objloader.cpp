@@ -23,7 +23,7 @@ bool MaterialExists( std::vector<Material *> & materials, char * material_name )
 }
 
 Texture * TextureProxy(const std::string & full_name, std::map<std::string, Texture*> & already_loaded_textures,
-	const int flip = -1, const bool single_channel = false )
+	const TextureStorage texture_storage, const bool linearize, const int flip = -1, const bool single_channel = false )
 {
 	std::map<std::string, Texture*>::iterator already_loaded_texture = already_loaded_textures.find(full_name);
 	Texture * texture = NULL;
@@ -35,6 +35,9 @@ Texture * TextureProxy(const std::string & full_name, std::map<std::string, Text
 	{
 		texture = new Texture( full_name.c_str() );// , flip, single_channel);
 		already_loaded_textures[full_name] = texture;
+
+		// a texture shared by several slots keeps the conversion of the first one, the others look up the bytes
+		if ( texture_storage != TextureStorage::BYTES ) texture->Convert( texture_storage, linearize );
 	}
 
 	return texture;
@@ -46,8 +49,9 @@ Soubor \a file_name se mus
 \param file_name nzev MTL souboru vetn ppony.
 \param path cesta k zadanmu souboru.
 \param materials pole materil, do kterho se budou ukldat naten materily.
+\param texture_storage texels of loaded textures, color maps are converted into the linear space.
 */
-int LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials )
+int LoadMTL( const char * file_name, const char * path, std::vector<Material *> & materials, const TextureStorage texture_storage )
 {
 	// oteven soouboru
 	FILE * file = fopen( file_name, "rt" );
@@ -156,37 +160,37 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kDiffuseMapSlot, TextureProxy( full_name, already_loaded_textures ) );
+					material->set_texture( Material::kDiffuseMapSlot, TextureProxy( full_name, already_loaded_textures, texture_storage, true ) );
 				}
 				else if ( strstr( tmp, "map_Ks" ) == tmp ) // specular map
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kSpecularMapSlot, TextureProxy( full_name, already_loaded_textures ) );
+					material->set_texture( Material::kSpecularMapSlot, TextureProxy( full_name, already_loaded_textures, texture_storage, true ) );
 				}
 				else if ( strstr( tmp, "map_bump" ) == tmp ) // normal map
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture( Material::kNormalMapSlot, TextureProxy( full_name, already_loaded_textures ) );
+					material->set_texture( Material::kNormalMapSlot, TextureProxy( full_name, already_loaded_textures, texture_storage, false ) );
 				}
 				else if ( strstr( tmp, "map_D" ) == tmp ) // opacity map
 				{					
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string(path).append(image_file_name);
-					material->set_texture( Material::kOpacityMapSlot, TextureProxy( full_name, already_loaded_textures, -1, true ) );
+					material->set_texture( Material::kOpacityMapSlot, TextureProxy( full_name, already_loaded_textures, texture_storage, false, -1, true ) );
 				}
 				else if ( strstr( tmp, "map_Pr" ) == tmp ) // roughness map
 				{
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kRoughnessMapSlot, TextureProxy( full_name, already_loaded_textures, -1, true ) );
+					material->set_texture( Material::kRoughnessMapSlot, TextureProxy( full_name, already_loaded_textures, texture_storage, false, -1, true ) );
 				}
 				else if ( strstr( tmp, "map_Pm" ) == tmp ) // metallicness map
 				{
 					sscanf( tmp, "%*s %s", image_file_name );
 					std::string full_name = std::string( path ).append( image_file_name );
-					material->set_texture( Material::kMetallicnessMapSlot, TextureProxy( full_name, already_loaded_textures, -1, true ) );
+					material->set_texture( Material::kMetallicnessMapSlot, TextureProxy( full_name, already_loaded_textures, texture_storage, false, -1, true ) );
 				}
 				else if ( strstr( tmp, "shader" ) == tmp ) // used shader
 				{
@@ -230,7 +234,7 @@ int LoadMTL( const char * file_name, const char * path, std::vector<Material *>
 }
 
 int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
-	const bool flip_yz , const Vector3 default_color )
+	const bool flip_yz , const Vector3 default_color, const TextureStorage texture_storage )
 {
 	// oteven soouboru
 	FILE * file = fopen( file_name, "rt" );
@@ -308,7 +312,7 @@ int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vec
 
 	for ( int i = 0; i < static_cast<int>( material_libraries.size() ); ++i )
 	{		
-		LoadMTL( material_libraries[i].c_str(), path, materials );
+		LoadMTL( material_libraries[i].c_str(), path, materials, texture_storage );
 	}
 
 	std::vector<Vector3> vertices; // cel jeden soubor
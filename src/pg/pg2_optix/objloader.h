@@ -3,6 +3,7 @@
 
 #include "vector3.h"
 #include "surface.h"
+#include "texture.h"
 
 /*! \fn int LoadOBJ( const char * file_name, Vector3 & default_color, std::vector<Surface *> & surfaces, std::vector<Material *> & materials )
 \brief Nate geometrii z OBJ souboru \a file_name.
@@ -10,8 +11,10 @@
 \param surfaces pole ploch, do kterho se budou ukldat naten plochy.
 \param materials pole materil, do kterho se budou ukldat naten materily.
 \param default_color vchoz barva vertexu.
+\param texture_storage texels of loaded textures, see LoadMTL.
 */
 int LoadOBJ( const char * file_name, std::vector<Surface *> & surfaces, std::vector<Material *> & materials,
-	const bool flip_yz = false, const Vector3 default_color = Vector3( 0.5f, 0.5f, 0.5f ) );
+	const bool flip_yz = false, const Vector3 default_color = Vector3( 0.5f, 0.5f, 0.5f ),
+	const TextureStorage texture_storage = TextureStorage::BYTES );
 
 #endif
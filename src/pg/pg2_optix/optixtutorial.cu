@@ -5,17 +5,36 @@ struct TriangleAttributes
 	optix::float3 normal;
 	optix::float2 texcoord;
 	optix::float3 intersectionPoint;
-	optix::float3 vectorToLight;
+	int primitive;
 };
 
 rtBuffer<optix::float3, 1> normal_buffer;
 rtBuffer<optix::float2, 1> texcoord_buffer;
 rtBuffer<optix::uchar4, 2> output_buffer;
+rtBuffer<optix::float4, 2> color_buffer; // unclamped colors the producer averages
+rtBuffer<optix::float2, 2> blue_noise_buffer;
+rtBuffer<optix::uchar1, 1> material_buffer;
+
+// auxiliary outputs, see GBuffer, buffers which are not requested by aov_outputs hold a single element
+rtBuffer<float, 2> aov_depth_buffer;
+rtBuffer<unsigned int, 2> aov_normal_buffer;
+rtBuffer<unsigned int, 2> aov_albedo_buffer;
+rtBuffer<unsigned short, 2> aov_material_buffer;
+rtBuffer<int, 2> aov_primitive_buffer;
+
+// emissive triangles of LightList, buffers of scenes without emitters hold a single element
+rtBuffer<optix::float3, 1> light_vertices_buffer;
+rtBuffer<optix::float3, 1> light_emission_buffer;
+rtBuffer<float, 1> light_probability_buffer;
+rtBuffer<int, 1> light_alias_buffer;
+rtBuffer<float, 1> light_pdf_buffer;
+rtBuffer<LightTreeNode, 1> light_tree_buffer;
 
 rtDeclareVariable(optix::float3, diffuse, , "diffuse");
 rtDeclareVariable(optix::float3, specular, , "specular");
 rtDeclareVariable(optix::float3, ambient, , "ambient");
 rtDeclareVariable(float, shininess, , "shininess");
+rtDeclareVariable(optix::float3, emission, , "emission");
 
 rtDeclareVariable(int, tex_diffuse_id, , "diffuse texture id");
 
@@ -27,14 +46,26 @@ rtDeclareVariable(PerRayData_shadow, shadow_ray_data, rtPayload, );
 rtDeclareVariable( float2, barycentrics, attribute rtTriangleBarycentrics, );
 rtDeclareVariable(TriangleAttributes, attribs, attribute attributes, "Triangle attributes");
 rtDeclareVariable(optix::Ray, ray, rtCurrentRay, );
+rtDeclareVariable(float, t_hit, rtIntersectionDistance, );
 
 rtDeclareVariable(optix::float3, view_from, , );
 rtDeclareVariable(optix::Matrix3x3, M_c_w, , "camera to worldspace transformation matrix" );
 rtDeclareVariable(float, focal_length, , "focal length in pixels" );
+rtDeclareVariable(float, ao_radius, , "maximal distance of occluders, tmax of AO rays" );
+rtDeclareVariable(unsigned int, sample_index, , "index of the frame sample, keys random numbers together with the pixel" );
+rtDeclareVariable(int, sampler, , "SamplerType of AO rays" );
+rtDeclareVariable(int, cosine_sampling, , "AO rays follow the cosine-weighted hemisphere" );
+rtDeclareVariable(int, ao_samples, , "number of AO rays per pixel" );
+rtDeclareVariable(float, ao_adaptive_threshold, , "standard error at which a pixel stops tracing AO rays, zero traces all of them" );
+rtDeclareVariable(int, ao_adaptive_batch, , "AO rays traced between error estimates" );
+rtDeclareVariable(unsigned int, aov_outputs, , "bits of the requested auxiliary outputs" );
+rtDeclareVariable(int, no_lights, , "number of emissive triangles, zero falls back to the default point light" );
+rtDeclareVariable(int, light_samples, , "light points per pixel" );
+rtDeclareVariable(float, light_scale, , "factor of the emission of all lights" );
+rtDeclareVariable(int, light_sampling, , "LightSampling of light points" );
 
 RT_PROGRAM void attribute_program(void)
 {
-	const optix::float3 lightPossition = optix::make_float3(100, 100, 200);
 	const optix::float2 barycentrics = rtGetTriangleBarycentrics();
 	const unsigned int index = rtGetPrimitiveIndex();
 	const optix::float3 n0 = normal_buffer[index * 3 + 0];
@@ -56,7 +87,10 @@ RT_PROGRAM void attribute_program(void)
 		ray.origin.y + ray.tmax * ray.direction.y,
 		ray.origin.z + ray.tmax * ray.direction.z);
 
-	attribs.vectorToLight = lightPossition - attribs.intersectionPoint;
+	// the ray and the buffers are in the space of the surface instance, shading works in world space
+	attribs.normal = optix::normalize(rtTransformNormal(RT_OBJECT_TO_WORLD, attribs.normal));
+	attribs.intersectionPoint = rtTransformPoint(RT_OBJECT_TO_WORLD, attribs.intersectionPoint);
+	attribs.primitive = index;
 }
 
 RT_PROGRAM void primary_ray( void )
@@ -69,45 +103,38 @@ RT_PROGRAM void primary_ray( void )
 	optix::Ray ray(view_from, d_w, 0, 0.01f);
 
 	PerRayData_radiance prd;
-	curand_init(launch_index.x + launch_dim.x * launch_index.y, 0, 0, &prd.state);
+	prd.pixel = launch_index.x + launch_dim.x * launch_index.y;
 	rtTrace( top_object, ray, prd );
 
 	// access to buffers within OptiX programs uses a simple array syntax	
 	output_buffer[launch_index] = optix::make_uchar4( prd.result.x*255.0f, prd.result.y*255.0f, prd.result.z*255.0f, 255 );
+	color_buffer[launch_index] = optix::make_float4( prd.result, 1.0f );
 }
 
 RT_PROGRAM void closest_hit_Phong( void )
 {
-	optix::float3 amb_occ = ambient_occlusion(ray_data.state);
-	float ligth = optix::dot(optix::normalize(attribs.vectorToLight), attribs.normal);
-
-	optix::float3 lr = 2 * (ligth)* attribs.normal - optix::normalize(attribs.vectorToLight);
-	float shade = shadow_ray(attribs.vectorToLight);
-	
-	optix::float3 res = ambient + (getDiffuseColor() * ligth) + specular * pow(optix::dot(-ray.direction, lr), shininess);
-
-	ray_data.result = res * amb_occ;
+	optix::float3 amb_occ = ambient_occlusion(ray_data.pixel);
+	optix::float3 diff = getDiffuseColor();
+	optix::float3 res = ambient + direct_light(diff, true);
 
+	ray_data.result = res * amb_occ + emission * light_scale;
+	store_aovs(diff);
 }
 
 RT_PROGRAM void closest_hit_Normal(void)
 {
-	optix::float3 amb = ambient_occlusion(ray_data.state);
-	ray_data.result = attribs.normal * amb * 0.5f;
-
+	optix::float3 amb = ambient_occlusion(ray_data.pixel);
+	ray_data.result = attribs.normal * amb * 0.5f + emission * light_scale;
+	store_aovs(optix::make_float3(1.0f, 1.0f, 1.0f));
 }
 
 RT_PROGRAM void closest_hit_Lambert(void)
 {
 	optix::float3 diff = getDiffuseColor();
-	float ligth = optix::dot(optix::normalize(attribs.vectorToLight), attribs.normal);
-
-	optix::float3 lr = 2 * (ligth)* attribs.normal - optix::normalize(attribs.vectorToLight);
-	optix::float3 res = optix::fmaxf(0, ligth) * diff;
-	float shade = shadow_ray(attribs.vectorToLight);
-	optix::float3 amb = ambient_occlusion(ray_data.state);
-	ray_data.result = res *amb;
-
+	optix::float3 res = direct_light(diff, false);
+	optix::float3 amb = ambient_occlusion(ray_data.pixel);
+	ray_data.result = res * amb + emission * light_scale;
+	store_aovs(diff);
 }
 
 RT_PROGRAM void any_hit(void)
@@ -121,31 +148,167 @@ RT_PROGRAM void shader_hit(void)
 	rtTerminateRay();
 }
 
-__device__ optix::float3 ambient_occlusion(curandState_t state)
+/* a point on one of the lights, the same numbers and mapping as LightList::Sample, zero distance for the default point light and zero radiance if the tree finds no light */
+__device__ void sample_light(RandomStream & rng, optix::float3 & direction, float & distance, optix::float3 & radiance)
 {
+	if (no_lights == 0) {
+		direction = optix::normalize(optix::make_float3(100, 100, 200) - attribs.intersectionPoint);
+		distance = 0;
+		radiance = optix::make_float3(1, 1, 1);
+		return;
+	}
+
+	const float w = rng.next();
+	const float u = rng.next();
+	const float v = rng.next();
+	direction = optix::make_float3(0, 0, 0);
+	distance = 0;
+	radiance = optix::make_float3(0, 0, 0);
+
+	int i;
+	float pdf;
+
+	if (light_sampling == int(LightSampling::TREE)) {
+		const float p[3] = { attribs.intersectionPoint.x, attribs.intersectionPoint.y, attribs.intersectionPoint.z };
+		const float n[3] = { attribs.normal.x, attribs.normal.y, attribs.normal.z };
+		i = SampleLightTree(light_tree_buffer, p, n, w, pdf);
+		if (i < 0) return;
+	}
+	else {
+		// alias table
+		const float x = w * no_lights;
+		i = min(int(x), no_lights - 1);
+		if (x - i >= light_probability_buffer[i]) i = light_alias_buffer[i];
+	}
+
+	// uniform point on the triangle
+	const float su = sqrtf(u);
+	const float b1 = 1 - su;
+	const float b2 = v * su;
+
+	const optix::float3 p0 = light_vertices_buffer[i * 3 + 0];
+	const optix::float3 p1 = light_vertices_buffer[i * 3 + 1];
+	const optix::float3 p2 = light_vertices_buffer[i * 3 + 2];
+	const optix::float3 cross = optix::cross(p1 - p0, p2 - p0);
+	const optix::float3 light_normal = optix::normalize(cross);
+
+	// the probability of the tree over the area
+	pdf = (light_sampling == int(LightSampling::TREE)) ? pdf / (0.5f * L2Norm(cross)) : light_pdf_buffer[i];
+
+	direction = p0 * (1 - b1 - b2) + p1 * b1 + p2 * b2 - attribs.intersectionPoint;
+	const float distance_sqr = optix::dot(direction, direction);
+	distance = sqrtf(distance_sqr);
+
+	if (distance <= 0) return;
+
+	direction /= distance;
+
+	// emitters are two-sided
+	const float cos_light = fabsf(optix::dot(light_normal, direction));
+	radiance = light_emission_buffer[i] * (cos_light / (distance_sqr * pdf * CUDART_PI_F));
+}
+
+/* direct light of light_samples points including their shadow rays, see CpuTracer::Shade */
+__device__ optix::float3 direct_light(const optix::float3 & diff, const bool phong)
+{
+	RandomStream rng(ray_data.pixel, sample_index, kLightDimension);
+	const int n = (no_lights > 0) ? light_samples : 1;
 	optix::float3 sum = optix::make_float3(0, 0, 0);
-	int N = 32;
-	for (int i = 0; i < N; i++)
+
+	for (int i = 0; i < n; i++)
 	{
-		float randomX = (float)curand_uniform(&state);
-		float randomY = (float)curand_uniform(&state);
+		optix::float3 dir, radiance;
+		float distance;
+		sample_light(rng, dir, distance, radiance);
+
+		const float ligth = optix::dot(dir, attribs.normal);
+		if (ligth <= 0 || (radiance.x == 0 && radiance.y == 0 && radiance.z == 0)) continue;
+		if (distance > 0 && shadow_ray(dir, distance - 0.01f) == 0) continue;
+
+		if (phong) {
+			optix::float3 lr = 2 * ligth * attribs.normal - dir;
+			sum += (diff * ligth + specular * powf(fmaxf(0, optix::dot(-ray.direction, lr)), shininess)) * radiance;
+		}
+		else {
+			sum += diff * ligth * radiance;
+		}
+	}
 
-		optix::float3 omegai = SampleHemisphere(attribs.normal, randomX,randomY);
-		float pdf = 1.0f/ (2* CUDART_PI_F);
+	return sum * (light_scale / n);
+}
 
-		float shade = shadow_ray(omegai);
+__device__ optix::float3 ambient_occlusion(const unsigned int pixel)
+{
+	// the same points as CpuTracer::AmbientOcclusion draws for this pixel
+	const optix::float2 offset = (sampler == int(SamplerType::BLUE_NOISE)) ?
+		blue_noise_buffer[optix::make_uint2(launch_index.x % kBlueNoiseSize, launch_index.y % kBlueNoiseSize)] : optix::make_float2(0, 0);
+	PixelSampler ao_sampler(SamplerType(sampler), pixel, sample_index, ao_samples, offset.x, offset.y);
 
-		optix::float3 whiteColor = optix::make_float3(1, 1, 1);
-		
-		sum += diffuse * shade * (optix::dot(attribs.normal, omegai) / pdf);
+	optix::float3 sum = optix::make_float3(0, 0, 0);
+	float sum_s = 0, half_sum_s = 0; // the adaptive stop, see CpuTracer::AmbientOcclusion
+	int next_check = ao_adaptive_batch;
+	const float scale = fmaxf(diffuse.x, fmaxf(diffuse.y, diffuse.z)) / CUDART_PI_F;
+	int N = ao_samples;
+	int i = 0;
+	for (; i < N; i++)
+	{
+		if (ao_adaptive_threshold > 0) {
+			if (i == next_check / 2) half_sum_s = sum_s;
+			if (i == next_check) {
+				const float error = (fabsf(2 * half_sum_s - sum_s) / i + 0.5f * CUDART_PI_F / i) * scale;
+				if (error <= ao_adaptive_threshold) break;
+				half_sum_s = sum_s;
+				next_check *= 2;
+			}
+		}
+
+		float randomX, randomY;
+		ao_sampler.next(randomX, randomY);
+
+		optix::float3 omegai;
+		float weight; // cosine over pdf
+
+		if (cosine_sampling) {
+			omegai = SampleCosineHemisphere(attribs.normal, randomX, randomY);
+			weight = CUDART_PI_F;
+		}
+		else {
+			omegai = SampleHemisphere(attribs.normal, randomX, randomY);
+			float pdf = 1.0f / (2 * CUDART_PI_F);
+			weight = optix::dot(attribs.normal, omegai) / pdf;
+		}
+
+		float shade = shadow_ray(omegai, ao_radius);
+
+		sum += diffuse * shade * weight;
+		sum_s += shade * weight;
 	}
-	return sum/N;
+	return sum/i;
 }
 
 /* may access variables declared with the rtPayload semantic in the same way as closest-hit and any-hit programs */
 RT_PROGRAM void miss_program( void )
 {
 	ray_data.result = optix::make_float3( 0.0f, 0.0f, 0.0f );
+
+	// the same values as GBuffer::Write stores for misses
+	if (aov_outputs & aov_bit(Aov::DEPTH)) aov_depth_buffer[launch_index] = 0.0f;
+	if (aov_outputs & aov_bit(Aov::NORMAL)) aov_normal_buffer[launch_index] = 0;
+	if (aov_outputs & aov_bit(Aov::ALBEDO)) aov_albedo_buffer[launch_index] = 0xffffffffu;
+	if (aov_outputs & aov_bit(Aov::MATERIAL)) aov_material_buffer[launch_index] = kNoMaterial;
+	if (aov_outputs & aov_bit(Aov::PRIMITIVE)) aov_primitive_buffer[launch_index] = -1;
+}
+
+/* writes the requested outputs of the primary hit, only primary rays run closest hit programs */
+__device__ void store_aovs(const optix::float3 & albedo)
+{
+	if (aov_outputs == 0) return;
+
+	if (aov_outputs & aov_bit(Aov::DEPTH)) aov_depth_buffer[launch_index] = t_hit;
+	if (aov_outputs & aov_bit(Aov::NORMAL)) aov_normal_buffer[launch_index] = EncodeOctahedral(attribs.normal.x, attribs.normal.y, attribs.normal.z);
+	if (aov_outputs & aov_bit(Aov::ALBEDO)) aov_albedo_buffer[launch_index] = PackRgba8(albedo.x, albedo.y, albedo.z);
+	if (aov_outputs & aov_bit(Aov::MATERIAL)) aov_material_buffer[launch_index] = material_buffer[attribs.primitive].x;
+	if (aov_outputs & aov_bit(Aov::PRIMITIVE)) aov_primitive_buffer[launch_index] = attribs.primitive;
 }
 
 RT_PROGRAM void exception( void )
@@ -154,6 +317,7 @@ RT_PROGRAM void exception( void )
 	rtPrintf( "Exception 0x%X at (%d, %d)\n", code, launch_index.x, launch_index.y );
 	rtPrintExceptionDetails();
 	output_buffer[launch_index] = uchar4{ 255, 0, 255, 0 };
+	color_buffer[launch_index] = optix::make_float4( 1.0f, 0.0f, 1.0f, 0.0f );
 }
 
 __device__ optix::float3 getDiffuseColor()
@@ -170,11 +334,9 @@ __device__ optix::float3 getDiffuseColor()
 	return color;
 }
 
-__device__ float shadow_ray(optix::float3 dir)
+__device__ float shadow_ray(optix::float3 dir, float tmax)
 {
-	float L = L2Norm(attribs.vectorToLight);
-
-	optix::Ray ray(attribs.intersectionPoint, dir, 1, 0.01f);
+	optix::Ray ray(attribs.intersectionPoint, dir, 1, 0.01f, tmax);
 
 	PerRayData_shadow shadow_prd;
 	shadow_prd.visible = 1.0f;
@@ -203,3 +365,19 @@ __device__ optix::float3 SampleHemisphere(optix::float3 normal, float randomX, f
 	return omegaI;
 }
 
+__device__ optix::float3 SampleCosineHemisphere(optix::float3 normal, float randomX, float randomY)
+{
+	// the same mapping and tangent frame as SampleCosineHemisphere in mymath.cpp
+	const float r = sqrtf(randomX);
+	const float phi = 2 * CUDART_PI_F * randomY;
+	const float z = sqrtf(fmaxf(0.0f, 1 - randomX));
+
+	const float sign = copysignf(1.0f, normal.z);
+	const float a = -1.0f / (sign + normal.z);
+	const float b = normal.x * normal.y * a;
+	const optix::float3 tangent = optix::make_float3(1 + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+	const optix::float3 bitangent = optix::make_float3(b, sign + normal.y * normal.y * a, -normal.y);
+
+	return tangent * (r * cosf(phi)) + bitangent * (r * sinf(phi)) + normal * z;
+}
+
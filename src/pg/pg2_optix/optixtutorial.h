@@ -1,20 +1,26 @@
 #include <optix_world.h>
-#include <curand_kernel.h>
 #include "math_constants.h"
+#include "sampler.h"
+#include "gbuffer.h"
+#include "lights.h"
 
 __device__ optix::float3 getDiffuseColor();
-__device__ float shadow_ray(optix::float3 dir);
+__device__ float shadow_ray(optix::float3 dir, float tmax);
 __device__ optix::float3 SampleHemisphere(optix::float3 normal, float randomX, float randomY);
+__device__ optix::float3 SampleCosineHemisphere(optix::float3 normal, float randomX, float randomY);
 __device__ float L2Norm(optix::float3 q);
-__device__ optix::float3 ambient_occlusion(curandState_t state);
+__device__ optix::float3 ambient_occlusion(const unsigned int pixel);
 __device__ optix::float3 orthogonal(const optix::float3 & v);
+__device__ void store_aovs(const optix::float3 & albedo);
+__device__ void sample_light(RandomStream & rng, optix::float3 & direction, float & distance, optix::float3 & radiance);
+__device__ optix::float3 direct_light(const optix::float3 & diff, const bool phong);
 
 struct PerRayData_radiance
 {
 	optix::float3 result;
 	float  importance;
 	int depth;
-	curandState_t state;
+	unsigned int pixel;
 };
 
 struct PerRayData_shadow
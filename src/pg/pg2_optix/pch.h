@@ -10,11 +10,13 @@
 #include <string>
 #include <chrono>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 #include <atomic>
 #include <tchar.h>
 #include <vector>
 #include <map>
+#include <memory>
 #include <random>
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -32,4 +34,10 @@
 #define DIRECTINPUT_VERSION 0x0800
 #include <dinput.h>
 
+// Intel Embree 3 (optional CPU backend), define USE_EMBREE and place the library into libs/embree to enable it
+#ifdef USE_EMBREE
+#include <embree3/rtcore.h>
+#include <embree3/rtcore_ray.h>
+#endif
+
 #endif //PCH_H
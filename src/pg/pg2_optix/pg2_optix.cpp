@@ -1,10 +1,31 @@
 #include "pch.h"
 #include "tutorials.h"
+#include "benchmarks.h"
 
 int main()
 {
 	printf( "PG2, (c)2019 Tomas Fabian\n\n" );
 
 	//return tutorial_1();
+	//return benchmark_occlusion( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_sbvh( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_refit( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_quantized( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_ray_sorting( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_tiles( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_embree( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_two_level( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_triangle_layouts( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_isa( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_ao_radius( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_queries( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_rng( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_samplers( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_adaptive( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_denoiser( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_aovs( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_lights( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_shading( "../../../data/6887_allied_avenger_gi.obj" );
+	//return benchmark_textures( "../../../data/3069bp13.jpg" );
 	return tutorial_2( "../../../data/6887_allied_avenger_gi.obj" );
 }
@@ -0,0 +1,134 @@
+#include "pch.h"
+#include "ray.h"
+#include "mymath.h"
+
+unsigned long long Ray::sort_key( const AABB & bounds ) const
+{
+	const int octant = ( ( direction.x < 0.0f ) ? 1 : 0 ) | ( ( direction.y < 0.0f ) ? 2 : 0 ) | ( ( direction.z < 0.0f ) ? 4 : 0 );
+
+	// 1024 cells along each axis of the bounds
+	unsigned int cell[3];
+
+	for ( int a = 0; a < 3; ++a )
+	{
+		const float extent = bounds.upper.data[a] - bounds.lower.data[a];
+		const float x = ( extent > 0.0f ) ? ( origin.data[a] - bounds.lower.data[a] ) / extent : 0.0f;
+		cell[a] = static_cast<unsigned int>( clamp( x, 0.0f, 1.0f ) * 1023.0f );
+	}
+
+	return ( static_cast<unsigned long long>( octant ) << 30 ) | Morton3( cell[0], cell[1], cell[2] );
+}
+
+int RayPacket::add( const Vector3 & direction, const float t_far )
+{
+	assert( no_rays < kSize );
+
+	const int i = no_rays++;
+
+	dir_x[i] = direction.x;
+	dir_y[i] = direction.y;
+	dir_z[i] = direction.z;
+
+	inv_x[i] = 1.0f / direction.x;
+	inv_y[i] = 1.0f / direction.y;
+	inv_z[i] = 1.0f / direction.z;
+
+	this->t_far[i] = t_far;
+	triangle_id[i] = -1;
+	u[i] = 0.0f;
+	v[i] = 0.0f;
+
+	return i;
+}
+
+void RayPacket::set_frustum( const Vector3 & d0, const Vector3 & d1, const Vector3 & d2, const Vector3 & d3 )
+{
+	const Vector3 d[4] = { d0, d1, d2, d3 };
+	const Vector3 center = d0 + d1 + d2 + d3;
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		frustum[i] = d[i].CrossProduct( d[( i + 1 ) % 4] );
+
+		// orient the plane so that the interior of the packet lies on its positive side
+		if ( frustum[i].DotProduct( center ) < 0.0f )
+		{
+			frustum[i] = -frustum[i];
+		}
+	}
+
+	has_frustum = true;
+}
+
+Ray RayPacket::ray( const int i ) const
+{
+	return Ray( origin, Vector3( dir_x[i], dir_y[i], dir_z[i] ), t_near, t_far[i] );
+}
+
+RayHit RayPacket::hit( const int i ) const
+{
+	RayHit hit;
+	hit.triangle_id = triangle_id[i];
+	hit.u = u[i];
+	hit.v = v[i];
+
+	return hit;
+}
+
+int RayStream::size() const
+{
+	return static_cast<int>( pixel.size() );
+}
+
+void RayStream::resize( const int n )
+{
+	origin_x.resize( n );
+	origin_y.resize( n );
+	origin_z.resize( n );
+	dir_x.resize( n );
+	dir_y.resize( n );
+	dir_z.resize( n );
+	t_far.assign( n, FLT_MAX );
+	triangle_id.assign( n, -1 );
+	u.assign( n, 0.0f );
+	v.assign( n, 0.0f );
+	pixel.resize( n );
+}
+
+void RayStream::set( const int i, const Vector3 & origin, const Vector3 & direction, const int pixel, const float t_far )
+{
+	origin_x[i] = origin.x;
+	origin_y[i] = origin.y;
+	origin_z[i] = origin.z;
+
+	dir_x[i] = direction.x;
+	dir_y[i] = direction.y;
+	dir_z[i] = direction.z;
+
+	this->t_far[i] = t_far;
+	triangle_id[i] = -1;
+	this->pixel[i] = pixel;
+}
+
+void RayStream::set_hit( const int i, const float t, const RayHit & hit )
+{
+	t_far[i] = t;
+	triangle_id[i] = hit.triangle_id;
+	u[i] = hit.u;
+	v[i] = hit.v;
+}
+
+Ray RayStream::ray( const int i ) const
+{
+	return Ray( Vector3( origin_x[i], origin_y[i], origin_z[i] ), Vector3( dir_x[i], dir_y[i], dir_z[i] ), t_near, t_far[i] );
+}
+
+RayHit RayStream::hit( const int i ) const
+{
+	RayHit hit;
+	hit.triangle_id = triangle_id[i];
+	hit.u = u[i];
+	hit.v = v[i];
+
+	return hit;
+}
@@ -0,0 +1,118 @@
+#ifndef RAY_H_
+#define RAY_H_
+
+#include <float.h>
+#include "vector3.h"
+#include "aabb.h"
+#include "simdkernels.h"
+
+/*! \struct Ray
+\brief A ray used by the CPU backend.
+
+Mirrors optix::Ray, i.e. after a successful closest hit query t_far holds the distance
+to the nearest intersection (the same way as rtCurrentRay.tmax does on the device).
+*/
+struct Ray
+{
+	Vector3 origin; /*!< Ray origin. */
+	Vector3 direction; /*!< Ray direction, not necessarily normalized. */
+	float t_near{ 0.01f }; /*!< Lower bound of the valid interval. */
+	float t_far{ FLT_MAX }; /*!< Upper bound of the valid interval. */
+
+	Ray() { }
+	Ray( const Vector3 & origin, const Vector3 & direction, const float t_near = 0.01f, const float t_far = FLT_MAX ) :
+		origin( origin ), direction( direction ), t_near( t_near ), t_far( t_far ) { }
+
+	Vector3 point( const float t ) const
+	{
+		return Vector3( origin.x + t * direction.x, origin.y + t * direction.y, origin.z + t * direction.z );
+	}
+
+	Vector3 inv_direction() const
+	{
+		return Vector3( 1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z );
+	}
+
+	/* orders rays by the direction octant first and then by the Morton code of the origin cell within bounds */
+	unsigned long long sort_key( const AABB & bounds ) const;
+};
+
+/*! \struct RayHit
+\brief Result of the closest hit query.
+
+Barycentrics follow rtGetTriangleBarycentrics, i.e. u is the weight of the second and v the weight
+of the third triangle vertex.
+*/
+struct RayHit
+{
+	int triangle_id{ -1 }; /*!< Index of the hit triangle or -1 for a miss. */
+	float u{ 0.0f };
+	float v{ 0.0f };
+
+	bool is_valid() const
+	{
+		return triangle_id >= 0;
+	}
+};
+
+typedef unsigned long long RayMask; // one bit per ray of a packet, the masks of SimdKernels
+
+/*! \struct RayPacket
+\brief Coherent bundle of rays sharing a common origin stored as SoA.
+
+A packet is traced at once against the BVH. Nodes are culled against the frustum spanned by
+the corner rays of the packet before any per-ray test is made. The per-ray arrays are the
+PacketLanes base the SIMD kernels work on.
+*/
+struct RayPacket : public PacketLanes
+{
+	Vector3 origin; /*!< Common origin of all rays. */
+
+	bool has_frustum{ false };
+	Vector3 frustum[4]; /*!< Inward normals of the side planes, all planes pass through the origin. */
+
+	/* appends a ray with the common origin, returns its index within the packet */
+	int add( const Vector3 & direction, const float t_far = FLT_MAX );
+
+	/* builds frustum planes from four corner directions given in the cyclic order */
+	void set_frustum( const Vector3 & d0, const Vector3 & d1, const Vector3 & d2, const Vector3 & d3 );
+
+	Ray ray( const int i ) const;
+	RayHit hit( const int i ) const;
+};
+
+/*! \struct RayStream
+\brief Arbitrary number of rays and their hits stored as SoA, the queues of the wavefront pipeline.
+*/
+struct RayStream
+{
+	float t_near{ 0.01f };
+
+	std::vector<float> origin_x;
+	std::vector<float> origin_y;
+	std::vector<float> origin_z;
+
+	std::vector<float> dir_x;
+	std::vector<float> dir_y;
+	std::vector<float> dir_z;
+
+	std::vector<float> t_far;
+	std::vector<int> triangle_id;
+	std::vector<float> u;
+	std::vector<float> v;
+
+	std::vector<int> pixel; /*!< Index of the pixel the ray contributes to. */
+
+	int size() const;
+
+	/* keeps the allocated memory, all rays are reset to misses */
+	void resize( const int n );
+
+	void set( const int i, const Vector3 & origin, const Vector3 & direction, const int pixel, const float t_far = FLT_MAX );
+	void set_hit( const int i, const float t, const RayHit & hit );
+
+	Ray ray( const int i ) const;
+	RayHit hit( const int i ) const;
+};
+
+#endif
@@ -1,11 +1,28 @@
 #include "pch.h"
 #include "raytracer.h"
+#include "simdkernels.h"
 #include "objloader.h"
 #include "tutorials.h"
 #include "mymath.h"
 #include "omp.h"
 #include "utils.h"
 
+namespace
+{
+	/* widgets until PopDisabled are drawn faded and ignore the input while the option they set has no effect */
+	void PushDisabled( const bool disabled )
+	{
+		ImGui::PushItemFlag( ImGuiItemFlags_Disabled, disabled );
+		ImGui::PushStyleVar( ImGuiStyleVar_Alpha, ImGui::GetStyle().Alpha * ( ( disabled ) ? 0.5f : 1.0f ) );
+	}
+
+	void PopDisabled()
+	{
+		ImGui::PopStyleVar();
+		ImGui::PopItemFlag();
+	}
+}
+
 void Raytracer::error_handler(RTresult code)
 {
 	if (code != RT_SUCCESS)
@@ -43,6 +60,13 @@ int Raytracer::InitDeviceAndScene()
 	error_handler(rtBufferSetSize2D(outputBuffer, width(), height()));
 	error_handler(rtVariableSetObject(output, outputBuffer));
 
+	RTvariable color;
+	error_handler(rtContextDeclareVariable(context, "color_buffer", &color));
+	error_handler(rtBufferCreate(context, RT_BUFFER_OUTPUT, &colorBuffer));
+	error_handler(rtBufferSetFormat(colorBuffer, RT_FORMAT_FLOAT4));
+	error_handler(rtBufferSetSize2D(colorBuffer, width(), height()));
+	error_handler(rtVariableSetObject(color, colorBuffer));
+
 	RTprogram primary_ray;
 	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "primary_ray", &primary_ray));
 	error_handler(rtContextSetRayGenerationProgram(context, 0, primary_ray));
@@ -59,6 +83,69 @@ int Raytracer::InitDeviceAndScene()
 	rtVariableSet1f(focal_length, camera.focalLength());
 	rtVariableSetMatrix3x3fv(M_c_w, 0, camera.M_c_w().data());
 
+	error_handler(rtContextDeclareVariable(context, "ao_radius", &ao_radius));
+	rtVariableSet1f(ao_radius, RT_DEFAULT_MAX);
+
+	error_handler(rtContextDeclareVariable(context, "sample_index", &sample_index));
+	rtVariableSet1ui(sample_index, 0);
+
+	// AO sampling options follow the CPU tracer, see get_image
+	error_handler(rtContextDeclareVariable(context, "sampler", &sampler));
+	error_handler(rtContextDeclareVariable(context, "cosine_sampling", &cosine_sampling));
+	error_handler(rtContextDeclareVariable(context, "ao_samples", &ao_samples));
+	error_handler(rtContextDeclareVariable(context, "ao_adaptive_threshold", &ao_adaptive_threshold));
+	error_handler(rtContextDeclareVariable(context, "ao_adaptive_batch", &ao_adaptive_batch));
+
+	// auxiliary outputs in the formats of GBuffer, allocated once they are requested
+	const char * aov_names[kNoAovs] = { "aov_depth_buffer", "aov_normal_buffer", "aov_albedo_buffer", "aov_material_buffer", "aov_primitive_buffer" };
+	const RTformat aov_formats[kNoAovs] = { RT_FORMAT_FLOAT, RT_FORMAT_UNSIGNED_INT, RT_FORMAT_UNSIGNED_INT, RT_FORMAT_UNSIGNED_SHORT, RT_FORMAT_INT };
+
+	for (int i = 0; i < kNoAovs; ++i) {
+		RTvariable aov;
+		error_handler(rtContextDeclareVariable(context, aov_names[i], &aov));
+		error_handler(rtBufferCreate(context, RT_BUFFER_OUTPUT, &aov_buffers_[i]));
+		error_handler(rtBufferSetFormat(aov_buffers_[i], aov_formats[i]));
+		error_handler(rtBufferSetSize2D(aov_buffers_[i], 1, 1));
+		error_handler(rtVariableSetObject(aov, aov_buffers_[i]));
+	}
+
+	error_handler(rtContextDeclareVariable(context, "aov_outputs", &aov_outputs));
+	rtVariableSet1ui(aov_outputs, 0);
+
+	// light list in the layout of sample_light, filled by UploadLights once a scene is loaded
+	const char * light_names[6] = { "light_vertices_buffer", "light_emission_buffer", "light_probability_buffer", "light_alias_buffer", "light_pdf_buffer",
+		"light_tree_buffer" };
+	const RTformat light_formats[6] = { RT_FORMAT_FLOAT3, RT_FORMAT_FLOAT3, RT_FORMAT_FLOAT, RT_FORMAT_INT, RT_FORMAT_FLOAT, RT_FORMAT_USER };
+
+	for (int i = 0; i < 6; ++i) {
+		RTvariable light;
+		error_handler(rtContextDeclareVariable(context, light_names[i], &light));
+		error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &light_buffers_[i]));
+		error_handler(rtBufferSetFormat(light_buffers_[i], light_formats[i]));
+		if (light_formats[i] == RT_FORMAT_USER) error_handler(rtBufferSetElementSize(light_buffers_[i], sizeof(LightTreeNode)));
+		error_handler(rtBufferSetSize1D(light_buffers_[i], 1));
+		error_handler(rtVariableSetObject(light, light_buffers_[i]));
+	}
+
+	error_handler(rtContextDeclareVariable(context, "no_lights", &no_lights));
+	rtVariableSet1i(no_lights, 0);
+	error_handler(rtContextDeclareVariable(context, "light_samples", &light_samples));
+	error_handler(rtContextDeclareVariable(context, "light_scale", &light_scale));
+	error_handler(rtContextDeclareVariable(context, "light_sampling", &light_sampling));
+
+	RTbuffer blue_noise_buffer;
+	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &blue_noise_buffer));
+	error_handler(rtBufferSetFormat(blue_noise_buffer, RT_FORMAT_FLOAT2));
+	error_handler(rtBufferSetSize2D(blue_noise_buffer, kBlueNoiseSize, kBlueNoiseSize));
+	float * blue_noise_data = nullptr;
+	error_handler(rtBufferMap(blue_noise_buffer, (void**)(&blue_noise_data)));
+	memcpy(blue_noise_data, blue_noise_mask(), sizeof(float) * 2 * kBlueNoiseSize * kBlueNoiseSize);
+	error_handler(rtBufferUnmap(blue_noise_buffer));
+
+	RTvariable blue_noise;
+	error_handler(rtContextDeclareVariable(context, "blue_noise_buffer", &blue_noise));
+	error_handler(rtVariableSetObject(blue_noise, blue_noise_buffer));
+
 	RTprogram exception;
 	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "exception", &exception));
 	error_handler(rtContextSetExceptionProgram(context, 0, exception));
@@ -90,21 +177,239 @@ int Raytracer::initGraph() {
 
 int Raytracer::get_image(BYTE * buffer) {
 	camera.updateFov(fov);
+
+	const float ao_tmax = (ao_radius_ > 0.0f) ? ao_radius_ : RT_DEFAULT_MAX;
+
+	// frames accumulated by the producer continue the sample sequence
+	const unsigned int sample = no_frames();
+
+	UpdateScene();
+	frame_colors_.resize(width() * height());
+
+	// only the outputs somebody reads are written
+	gbuffer_.outputs = post_process_outputs();
+
+	if (cpu_backend_) {
+		std::shared_lock<std::shared_timed_mutex> lock(scene_mutex_);
+		cpu_tracer_.sample_index = sample;
+		wavefront_tracer_.sample_index = sample;
+		cpu_tracer_.ao_radius = ao_tmax;
+		wavefront_tracer_.ao_radius = ao_tmax;
+		wavefront_tracer_.no_ao_samples = cpu_tracer_.no_ao_samples;
+		wavefront_tracer_.sampler = cpu_tracer_.sampler;
+		wavefront_tracer_.cosine_sampling = cpu_tracer_.cosine_sampling;
+		wavefront_tracer_.no_light_samples = cpu_tracer_.no_light_samples;
+		wavefront_tracer_.light_scale = cpu_tracer_.light_scale;
+		wavefront_tracer_.light_sampling = cpu_tracer_.light_sampling;
+		wavefront_tracer_.shader_sorting = cpu_tracer_.shader_sorting;
+		wavefront_tracer_.two_level = cpu_tracer_.two_level;
+		GBuffer * gbuffer = (gbuffer_.outputs != 0) ? &gbuffer_ : nullptr;
+		if (wavefront_) wavefront_tracer_.Render(camera, buffer, width(), height(), gbuffer, frame_colors_.data());
+		else cpu_tracer_.Render(camera, buffer, width(), height(), gbuffer, frame_colors_.data());
+	}
+	else {
+		LaunchDevice(buffer, ao_tmax, sample);
+	}
+
+	return S_OK;
+}
+
+void Raytracer::PostProcess(BYTE * buffer)
+{
+	// the average is denoised with the guides of the last frame, the frames themselves are accumulated unfiltered
+	if (denoise_) denoiser_.Run(buffer, gbuffer_);
+	if (debug_view_ > 0) gbuffer_.Visualize(Aov(debug_view_ - 1), buffer);
+}
+
+bool Raytracer::post_process_changed()
+{
+	// filters of the displayed image only, the accumulated frames do not depend on them
+	const float floats[] = { denoiser_.sigma_color, denoiser_.sigma_normal, denoiser_.sigma_depth };
+	const int ints[] = { denoise_, denoiser_.no_passes, debug_view_ };
+
+	const unsigned long long hash = QuickHash(reinterpret_cast<const BYTE *>(ints), sizeof(ints),
+		QuickHash(reinterpret_cast<const BYTE *>(floats), sizeof(floats)));
+	const bool changed = hash != post_process_hash_;
+	post_process_hash_ = hash;
+
+	return changed;
+}
+
+bool Raytracer::post_process_ready() const
+{
+	return (gbuffer_.outputs & post_process_outputs()) == post_process_outputs();
+}
+
+unsigned int Raytracer::post_process_outputs() const
+{
+	return ((denoise_) ? Denoiser::kGuides : 0) | ((debug_view_ > 0) ? aov_bit(Aov(debug_view_ - 1)) : 0);
+}
+
+const Color3f * Raytracer::frame_colors() const
+{
+	return frame_colors_.data();
+}
+
+void Raytracer::LaunchDevice(BYTE * buffer, const float ao_tmax, const unsigned int sample)
+{
 	rtVariableSet3f(view_from, camera.view_from().x, camera.view_from().y, camera.view_from().z);
 	rtVariableSet1f(focal_length, camera.focalLength());
 	rtVariableSetMatrix3x3fv(M_c_w, 0, camera.M_c_w().data());
+	rtVariableSet1f(ao_radius, ao_tmax);
+	rtVariableSet1ui(sample_index, sample);
+	rtVariableSet1i(sampler, int(cpu_tracer_.sampler));
+	rtVariableSet1i(cosine_sampling, cpu_tracer_.cosine_sampling);
+	rtVariableSet1i(ao_samples, min(max(cpu_tracer_.no_ao_samples, 1), CpuTracer::kMaxAOSamples));
+	rtVariableSet1f(ao_adaptive_threshold, (cpu_tracer_.adaptive_sampling) ? cpu_tracer_.adaptive_threshold : 0.0f);
+	rtVariableSet1i(ao_adaptive_batch, cpu_tracer_.ao_batch());
+	rtVariableSet1i(light_samples, min(max(cpu_tracer_.no_light_samples, 1), kMaxLightSamples));
+	rtVariableSet1f(light_scale, cpu_tracer_.light_scale);
+	rtVariableSet1i(light_sampling, int(cpu_tracer_.light_sampling));
+	ResizeAovBuffers(gbuffer_.outputs);
+	rtVariableSet1ui(aov_outputs, gbuffer_.outputs);
 
 	error_handler(rtContextLaunch2D(context, 0, width(), height()));
 	optix::uchar4 * data = nullptr;
 	error_handler(rtBufferMap(outputBuffer, (void**)(&data)));
 	memcpy(buffer, data, sizeof(optix::uchar4) * width() * height());
 	error_handler(rtBufferUnmap(outputBuffer));
-	return S_OK;
+	const optix::float4 * colors = nullptr;
+	error_handler(rtBufferMap(colorBuffer, (void**)(&colors)));
+	for (int i = 0; i < width() * height(); ++i) frame_colors_[i] = Color3f(colors[i].x, colors[i].y, colors[i].z);
+	error_handler(rtBufferUnmap(colorBuffer));
+	ReadAovBuffers();
+}
+
+void Raytracer::ResizeAovBuffers(const unsigned int outputs)
+{
+	if (outputs == aov_buffer_outputs_ && width() == aov_buffer_width_ && height() == aov_buffer_height_) return;
+
+	for (int i = 0; i < kNoAovs; ++i) {
+		const bool requested = (outputs & aov_bit(Aov(i))) != 0;
+		error_handler(rtBufferSetSize2D(aov_buffers_[i], (requested) ? width() : 1, (requested) ? height() : 1));
+	}
+
+	aov_buffer_outputs_ = outputs;
+	aov_buffer_width_ = width();
+	aov_buffer_height_ = height();
+}
+
+void Raytracer::ReadAovBuffers()
+{
+	gbuffer_.resize(width(), height());
+
+	void * outputs[kNoAovs] = { gbuffer_.depth.data(), gbuffer_.normal.data(), gbuffer_.albedo.data(), gbuffer_.material.data(),
+		gbuffer_.primitive.data() };
+	const size_t element_sizes[kNoAovs] = { sizeof(float), sizeof(unsigned int), sizeof(unsigned int), sizeof(unsigned short), sizeof(int) };
+
+	for (int i = 0; i < kNoAovs; ++i) {
+		if (!gbuffer_.has(Aov(i))) continue;
+
+		void * data = nullptr;
+		error_handler(rtBufferMap(aov_buffers_[i], &data));
+		memcpy(outputs[i], data, element_sizes[i] * width() * height());
+		error_handler(rtBufferUnmap(aov_buffers_[i]));
+	}
+}
+
+void Raytracer::UploadLights()
+{
+	// world space positions of the emitters, uploaded again by UpdateScene after an emitter moved
+	const int n = lights_.no_lights();
+	const std::vector<LightTreeNode> & nodes = lights_.tree().nodes();
+
+	for (int i = 0; i < 5; ++i) {
+		error_handler(rtBufferSetSize1D(light_buffers_[i], max(n, 1) * ((i == 0) ? 3 : 1)));
+	}
+
+	error_handler(rtBufferSetSize1D(light_buffers_[5], max(static_cast<int>(nodes.size()), 1)));
+
+	rtVariableSet1i(no_lights, n);
+	if (n == 0) return;
+
+	optix::float3 * vertices = nullptr;
+	optix::float3 * emission = nullptr;
+	float * probability = nullptr;
+	int * alias = nullptr;
+	float * pdf = nullptr;
+	LightTreeNode * tree = nullptr;
+
+	error_handler(rtBufferMap(light_buffers_[0], (void**)(&vertices)));
+	error_handler(rtBufferMap(light_buffers_[1], (void**)(&emission)));
+	error_handler(rtBufferMap(light_buffers_[2], (void**)(&probability)));
+	error_handler(rtBufferMap(light_buffers_[3], (void**)(&alias)));
+	error_handler(rtBufferMap(light_buffers_[4], (void**)(&pdf)));
+	error_handler(rtBufferMap(light_buffers_[5], (void**)(&tree)));
+
+	for (int i = 0; i < n; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			const Vector3 & position = geometry_.position(lights_.triangle_id(i), j);
+			vertices[i * 3 + j] = optix::make_float3(position.x, position.y, position.z);
+		}
+
+		const Color3f & e = lights_.emission(i);
+		emission[i] = optix::make_float3(e.r, e.g, e.b);
+		probability[i] = lights_.table().probabilities()[i];
+		alias[i] = lights_.table().aliases()[i];
+		pdf[i] = lights_.pdf(i);
+	}
+
+	memcpy(tree, nodes.data(), sizeof(LightTreeNode) * nodes.size());
+
+	for (int i = 0; i < 6; ++i) {
+		error_handler(rtBufferUnmap(light_buffers_[i]));
+	}
+}
+
+bool Raytracer::view_changed()
+{
+	// everything the image depends on, the UI thread may change any of it between frames
+	const float floats[] = { camera.view_from().x, camera.view_from().y, camera.view_from().z, camera.view_at().x, camera.view_at().y,
+		camera.view_at().z, camera.basis_y.x, camera.basis_y.y, camera.basis_y.z, fov, ao_radius_, cpu_tracer_.adaptive_threshold,
+		cpu_tracer_.light_scale };
+	const int ints[] = { scene_version_.load(), cpu_backend_, wavefront_, unify_normals_, cpu_tracer_.two_level, cpu_tracer_.use_embree,
+		cpu_tracer_.no_ao_samples, int(cpu_tracer_.sampler), cpu_tracer_.cosine_sampling, cpu_tracer_.adaptive_sampling,
+		cpu_tracer_.adaptive_batch, cpu_tracer_.no_light_samples, int(cpu_tracer_.light_sampling) };
+
+	const unsigned long long hash = QuickHash(reinterpret_cast<const BYTE *>(ints), sizeof(ints),
+		QuickHash(reinterpret_cast<const BYTE *>(floats), sizeof(floats)));
+	const bool changed = hash != view_hash_;
+	view_hash_ = hash;
+
+	return changed;
 }
 
 void Raytracer::LoadScene( const std::string file_name )
 {
-	const int no_surfaces = LoadOBJ( file_name.c_str(), surfaces_, materials_ );
+	const int no_surfaces = LoadOBJ( file_name.c_str(), surfaces_, materials_, false, Vector3( 0.5f, 0.5f, 0.5f ), texture_storage_ );
+
+	// the same triangles for the CPU backend
+	std::unique_lock<std::shared_timed_mutex> lock(scene_mutex_);
+	geometry_.Build(surfaces_);
+	bvh_settings_.spatial_splits = true; // the same builder as the Sbvh acceleration below
+	bvh_.Build(geometry_, bvh_settings_, Bvh::cache_file_name(file_name, geometry_, bvh_settings_));
+	cpu_tracer_.set_scene(&geometry_, &bvh_.bvh());
+	wavefront_tracer_.set_scene(&geometry_, &bvh_.bvh());
+	// the two-level BVH is built by UpdateScene once it is traced so that a cached flat BVH gets the scene rendered without any build
+	two_level_built_ = false;
+	two_level_traced_ = false;
+	flat_bvh_stale_ = false;
+	surface_transforms_.clear();
+	device_transforms_stale_ = false;
+	device_lights_stale_ = false;
+	cpu_tracer_.set_two_level(&two_level_bvh_);
+	wavefront_tracer_.set_two_level(&two_level_bvh_);
+	embree_.Build(geometry_); // optional reference backend sharing the same buffers
+	cpu_tracer_.set_embree(&embree_);
+	scene_query_.set_scene(&geometry_, &bvh_, &scene_mutex_);
+	scene_query_.set_two_level(nullptr);
+	lights_.Build(geometry_);
+	cpu_tracer_.set_lights(&lights_);
+	wavefront_tracer_.set_lights(&lights_);
+	++scene_version_;
+	lock.unlock();
+
+	UploadLights();
 	
 	int no_triangles = 0;
 
@@ -113,10 +418,6 @@ void Raytracer::LoadScene( const std::string file_name )
 		no_triangles += surface->no_triangles();
 	}
 
-	RTgeometrytriangles geometry_triangles;
-	error_handler(rtGeometryTrianglesCreate(context, &geometry_triangles));
-	error_handler(rtGeometryTrianglesSetPrimitiveCount(geometry_triangles, no_triangles));
-
 	RTbuffer vertex_buffer;
 	error_handler(rtBufferCreate(context, RT_BUFFER_INPUT, &vertex_buffer));
 	error_handler(rtBufferSetFormat(vertex_buffer, RT_FORMAT_FLOAT3));
@@ -199,22 +500,12 @@ void Raytracer::LoadScene( const std::string file_name )
 	rtVariableSetObject(materialIndices, material_buffer);
 	rtBufferValidate(vertex_buffer);
 
-	error_handler(rtGeometryTrianglesSetMaterialCount(geometry_triangles, materials_.size()));
-	error_handler(rtGeometryTrianglesSetMaterialIndices(geometry_triangles, material_buffer, 0, sizeof(optix::uchar1), RT_FORMAT_UNSIGNED_BYTE));
-	error_handler(rtGeometryTrianglesSetVertices(geometry_triangles, no_triangles * 3, vertex_buffer, 0, sizeof(optix::float3), RT_FORMAT_FLOAT3));
-
 	RTprogram attribute_program;
 	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "attribute_program", &attribute_program));
 	error_handler(rtProgramValidate(attribute_program));
-	error_handler(rtGeometryTrianglesSetAttributeProgram(geometry_triangles, attribute_program));
 
-	error_handler(rtGeometryTrianglesValidate(geometry_triangles));
-
-	// geometry instance
-	RTgeometryinstance geometry_instance;
-	error_handler(rtGeometryInstanceCreate(context, &geometry_instance));
-	error_handler(rtGeometryInstanceSetGeometryTriangles(geometry_instance, geometry_triangles));
-	error_handler(rtGeometryInstanceSetMaterialCount(geometry_instance, materials_.size()));
+	// materials shared by the instances of all surfaces
+	std::vector<RTmaterial> rt_materials(materials_.size());
 
 	/*RTprogram any_hit;
 	error_handler(rtProgramCreateFromPTXFile(context, "optixtutorial.ptx", "any_hit", &any_hit));*/
@@ -255,6 +546,7 @@ void Raytracer::LoadScene( const std::string file_name )
 		error_handler(createAndSetMaterialColorVariable(rtMaterial, "specular", material->specular()));
 		error_handler(createAndSetMaterialColorVariable(rtMaterial, "ambient", material->ambient()));
 		error_handler(createAndSetMaterialScalarVariable(rtMaterial, "shininess", material->shininess));
+		error_handler(createAndSetMaterialColorVariable(rtMaterial, "emission", material->emission()));
 
 		RTvariable tex_diffuse_id;
 		rtMaterialDeclareVariable(rtMaterial, "tex_diffuse_id", &tex_diffuse_id);
@@ -298,29 +590,184 @@ void Raytracer::LoadScene( const std::string file_name )
 
 		error_handler(rtMaterialValidate(rtMaterial));
 
-		error_handler(rtGeometryInstanceSetMaterial(geometry_instance, material->materialIndex, rtMaterial));
+		rt_materials[material->materialIndex] = rtMaterial;
 	}
-	error_handler(rtGeometryInstanceValidate(geometry_instance));
 
+	// one geometry group per surface under a transform, moving a surface rebuilds only the top level, see MoveSurface
+	std::vector<RTtransform> instances;
+	device_transforms_.clear();
+	int first = 0;
+
+	for (auto surface : surfaces_) {
+		const int n = surface->no_triangles();
+		if (n == 0) continue;
+
+		// the triangles of the surface are a range of the shared buffers, programs see the primitive indices of the whole scene
+		RTgeometrytriangles geometry_triangles;
+		error_handler(rtGeometryTrianglesCreate(context, &geometry_triangles));
+		error_handler(rtGeometryTrianglesSetPrimitiveCount(geometry_triangles, n));
+		error_handler(rtGeometryTrianglesSetPrimitiveIndexOffset(geometry_triangles, first));
+		error_handler(rtGeometryTrianglesSetMaterialCount(geometry_triangles, materials_.size()));
+		error_handler(rtGeometryTrianglesSetMaterialIndices(geometry_triangles, material_buffer, first * sizeof(optix::uchar1), sizeof(optix::uchar1), RT_FORMAT_UNSIGNED_BYTE));
+		error_handler(rtGeometryTrianglesSetVertices(geometry_triangles, n * 3, vertex_buffer, first * 3 * sizeof(optix::float3), sizeof(optix::float3), RT_FORMAT_FLOAT3));
+		error_handler(rtGeometryTrianglesSetAttributeProgram(geometry_triangles, attribute_program));
+		error_handler(rtGeometryTrianglesValidate(geometry_triangles));
+
+		// geometry instance
+		RTgeometryinstance geometry_instance;
+		error_handler(rtGeometryInstanceCreate(context, &geometry_instance));
+		error_handler(rtGeometryInstanceSetGeometryTriangles(geometry_instance, geometry_triangles));
+		error_handler(rtGeometryInstanceSetMaterialCount(geometry_instance, materials_.size()));
+
+		for (int i = 0; i < static_cast<int>(rt_materials.size()); ++i) {
+			error_handler(rtGeometryInstanceSetMaterial(geometry_instance, i, rt_materials[i]));
+		}
 
-	// acceleration structure
-	RTacceleration sbvh;
-	error_handler(rtAccelerationCreate(context, &sbvh));
-	error_handler(rtAccelerationSetBuilder(sbvh, "Sbvh"));
-	//error_handler( rtAccelerationSetProperty( sbvh, "vertex_buffer_name", "vertex_buffer" ) );
-	error_handler(rtAccelerationValidate(sbvh));
+		error_handler(rtGeometryInstanceValidate(geometry_instance));
+
+		// acceleration structure of the surface, built once
+		RTacceleration sbvh;
+		error_handler(rtAccelerationCreate(context, &sbvh));
+		error_handler(rtAccelerationSetBuilder(sbvh, "Sbvh"));
+		error_handler(rtAccelerationValidate(sbvh));
+
+		// geometry group
+		RTgeometrygroup geometry_group;
+		error_handler(rtGeometryGroupCreate(context, &geometry_group));
+		error_handler(rtGeometryGroupSetAcceleration(geometry_group, sbvh));
+		error_handler(rtGeometryGroupSetChildCount(geometry_group, 1));
+		error_handler(rtGeometryGroupSetChild(geometry_group, 0, geometry_instance));
+		error_handler(rtGeometryGroupValidate(geometry_group));
+
+		// instance placed by MoveSurface, the buffers keep the loaded positions
+		const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+		RTtransform transform;
+		error_handler(rtTransformCreate(context, &transform));
+		error_handler(rtTransformSetChild(transform, geometry_group));
+		error_handler(rtTransformSetMatrix(transform, 0, identity, nullptr));
+		error_handler(rtTransformValidate(transform));
+
+		device_transforms_[surface] = transform;
+		instances.push_back(transform);
+		first += n;
+	}
+
+	// top level over the instances, a cheap builder as it is rebuilt whenever a surface moves
+	error_handler(rtAccelerationCreate(context, &top_acceleration_));
+	error_handler(rtAccelerationSetBuilder(top_acceleration_, "Bvh"));
+	error_handler(rtAccelerationValidate(top_acceleration_));
 
-	// geometry group
-	RTgeometrygroup geometry_group;
-	error_handler(rtGeometryGroupCreate(context, &geometry_group));
-	error_handler(rtGeometryGroupSetAcceleration(geometry_group, sbvh));
-	error_handler(rtGeometryGroupSetChildCount(geometry_group, 1));
-	error_handler(rtGeometryGroupSetChild(geometry_group, 0, geometry_instance));
-	error_handler(rtGeometryGroupValidate(geometry_group));
+	RTgroup top_group;
+	error_handler(rtGroupCreate(context, &top_group));
+	error_handler(rtGroupSetAcceleration(top_group, top_acceleration_));
+	error_handler(rtGroupSetChildCount(top_group, static_cast<unsigned int>(instances.size())));
+
+	for (int i = 0; i < static_cast<int>(instances.size()); ++i) {
+		error_handler(rtGroupSetChild(top_group, i, instances[i]));
+	}
+
+	error_handler(rtGroupValidate(top_group));
 
 	RTvariable top_object;
 	error_handler(rtContextDeclareVariable(context, "top_object", &top_object));
-	error_handler(rtVariableSetObject(top_object, geometry_group));
+	error_handler(rtVariableSetObject(top_object, top_group));
+}
+
+void Raytracer::MoveSurface( Surface * surface, const Matrix3x3 & rotation, const Vector3 & translation )
+{
+	// OptiX is driven by the producer only, UpdateScene places the device instance before the next frame
+	std::unique_lock<std::shared_timed_mutex> lock(scene_mutex_);
+	surface_transforms_[surface] = SurfaceTransform{ rotation, translation };
+	device_transforms_stale_ = true;
+	geometry_.SetTransform(surface, rotation, translation); // shaders read the moved vertices with either BVH
+
+	// the top level is rebuilt in any case, the whole scene is refitted only if the flat BVH is traced
+	if (two_level_built_) {
+		two_level_bvh_.SetTransform(surface, rotation, translation);
+		two_level_bvh_.Update();
+	}
+
+	if (two_level_traced_) {
+		flat_bvh_stale_ = true;
+	}
+	else {
+		bvh_.Update();
+		embree_.Update();
+		cpu_tracer_.set_scene(&geometry_, &bvh_.bvh());
+		wavefront_tracer_.set_scene(&geometry_, &bvh_.bvh());
+	}
+
+	// emitters move with their surfaces, other surfaces leave the lights as they are
+	if (!surface->get_material()->emission().is_zero()) {
+		lights_.Build(geometry_);
+		device_lights_stale_ = true;
+	}
+
+	++scene_version_;
+}
+
+void Raytracer::UpdateScene()
+{
+	const bool two_level = cpu_tracer_.two_level;
+
+	{
+		std::shared_lock<std::shared_timed_mutex> lock(scene_mutex_);
+		if (two_level == two_level_traced_ && !device_transforms_stale_ && !device_lights_stale_) return;
+	}
+
+	std::unique_lock<std::shared_timed_mutex> lock(scene_mutex_);
+
+	if (two_level && !two_level_built_) {
+		two_level_bvh_.Build(surfaces_, bvh_settings_);
+
+		for (const auto & transform : surface_transforms_) {
+			two_level_bvh_.SetTransform(transform.first, transform.second.rotation, transform.second.translation);
+		}
+
+		two_level_bvh_.Update();
+		two_level_built_ = true;
+	}
+
+	if (!two_level && flat_bvh_stale_) {
+		bvh_.Update();
+		embree_.Update();
+		cpu_tracer_.set_scene(&geometry_, &bvh_.bvh());
+		wavefront_tracer_.set_scene(&geometry_, &bvh_.bvh());
+		flat_bvh_stale_ = false;
+	}
+
+	// queries traverse the same BVH as the frames
+	scene_query_.set_two_level((two_level) ? &two_level_bvh_ : nullptr);
+	two_level_traced_ = two_level;
+
+	// OptiX instances get the same rigid transforms, the surfaces keep their own acceleration structures
+	if (device_transforms_stale_) {
+		for (const auto & transform : surface_transforms_) {
+			auto it = device_transforms_.find(transform.first);
+			if (it == device_transforms_.end()) continue;
+
+			const Matrix3x3 & r = transform.second.rotation;
+			const Vector3 & t = transform.second.translation;
+			const float matrix[16] = { r.get(0, 0), r.get(0, 1), r.get(0, 2), t.x,
+				r.get(1, 0), r.get(1, 1), r.get(1, 2), t.y,
+				r.get(2, 0), r.get(2, 1), r.get(2, 2), t.z,
+				0.0f, 0.0f, 0.0f, 1.0f };
+			error_handler(rtTransformSetMatrix(it->second, 0, matrix, nullptr));
+		}
+
+		error_handler(rtAccelerationMarkDirty(top_acceleration_));
+		device_transforms_stale_ = false;
+	}
+
+	if (device_lights_stale_) {
+		UploadLights();
+		device_lights_stale_ = false;
+	}
+}
+
+const SceneQuery & Raytracer::scene_query() const
+{
+	return scene_query_;
 }
 
 int Raytracer::Ui()
@@ -335,6 +782,136 @@ int Raytracer::Ui()
 	ImGui::Separator();
 	ImGui::Checkbox( "Vsync", &vsync_ );
 	ImGui::Checkbox( "Unify normals", &unify_normals_ );	
+	ImGui::Checkbox( "CPU backend", &cpu_backend_ );
+	// instances and Embree trace single rays only
+	PushDisabled( cpu_tracer_.two_level || cpu_tracer_.use_embree );
+	ImGui::Checkbox( "Packet traversal", &cpu_tracer_.packet_traversal );
+	PopDisabled();
+	ImGui::Checkbox( "Sort AO rays", &cpu_tracer_.ray_sorting );
+	ImGui::Checkbox( "Sort hits by material", &cpu_tracer_.shader_sorting );
+	ImGui::Checkbox( "Wavefront pipeline", &wavefront_ );
+	ImGui::Checkbox( "Two-level BVH", &cpu_tracer_.two_level );
+	ImGui::SliderFloat( "AO radius", &ao_radius_, 0.0f, 200.0f, ( ao_radius_ > 0.0f ) ? "%.1f" : "unbounded" );
+	ImGui::SliderInt( "AO samples", &cpu_tracer_.no_ao_samples, 1, CpuTracer::kMaxAOSamples );
+
+	int sampler_type = int( cpu_tracer_.sampler );
+	if ( ImGui::Combo( "AO sampler", &sampler_type, "Random\0Sobol (Owen)\0Blue noise\0" ) )
+	{
+		cpu_tracer_.sampler = SamplerType( sampler_type );
+	}
+
+	ImGui::Checkbox( "Cosine-weighted AO", &cpu_tracer_.cosine_sampling );
+
+	// the wavefront tracer always traces all AO rays
+	PushDisabled( cpu_backend_ && wavefront_ );
+	ImGui::Checkbox( "Adaptive AO", &cpu_tracer_.adaptive_sampling );
+	ImGui::SliderFloat( "AO error threshold", &cpu_tracer_.adaptive_threshold, 0.001f, 0.2f, "%.3f" );
+
+	// the batch is a power of two, the slider picks its exponent
+	int batch_exponent = 1;
+	int max_batch_exponent = 1;
+	while ( ( 1 << batch_exponent ) < cpu_tracer_.ao_batch() ) ++batch_exponent;
+	while ( ( 2 << max_batch_exponent ) <= CpuTracer::kMaxAOSamples ) ++max_batch_exponent;
+
+	char batch_text[32];
+	sprintf( batch_text, "%d rays", 1 << batch_exponent );
+	if ( ImGui::SliderInt( "AO batch", &batch_exponent, 1, max_batch_exponent, batch_text ) )
+	{
+		cpu_tracer_.adaptive_batch = 1 << batch_exponent;
+	}
+	PopDisabled();
+
+	if ( cpu_backend_ && !wavefront_ ) ImGui::Text( "AO rays = %lld", cpu_tracer_.no_ao_rays() );
+	if ( cpu_backend_ && !wavefront_ ) ImGui::Text( "Shading = %0.1f ms (all threads)", cpu_tracer_.shading_time() * 1e+3 );
+	ImGui::Separator();
+	ImGui::Text( "Lights = %d", lights_.no_lights() );
+	ImGui::SliderInt( "Light samples", &cpu_tracer_.no_light_samples, 1, kMaxLightSamples );
+	ImGui::SliderFloat( "Light intensity", &cpu_tracer_.light_scale, 0.0f, 10.0f, "%.2f" );
+
+	int light_sampling = int( cpu_tracer_.light_sampling );
+	if ( ImGui::Combo( "Light sampling", &light_sampling, "Power (alias table)\0Light tree\0" ) )
+	{
+		cpu_tracer_.light_sampling = LightSampling( light_sampling );
+	}
+	ImGui::Separator();
+	ImGui::Combo( "View", &debug_view_, "Color\0Depth\0Normal\0Albedo\0Material\0Primitive\0" );
+	ImGui::Checkbox( "Denoise", &denoise_ );
+	ImGui::SliderInt( "Denoiser passes", &denoiser_.no_passes, 1, 8 );
+	ImGui::SliderFloat( "Sigma color", &denoiser_.sigma_color, 1.0f, 64.0f, "%.1f" );
+	ImGui::SliderFloat( "Sigma normal", &denoiser_.sigma_normal, 0.01f, 1.0f, "%.2f" );
+	ImGui::SliderFloat( "Sigma depth", &denoiser_.sigma_depth, 0.001f, 0.1f, "%.3f" );
+	if ( denoise_ ) ImGui::Text( "Denoiser = %0.1f ms, noise = %0.3f", denoiser_.time() * 1e+3, denoiser_.noise() );
+	ImGui::Separator();
+	ImGui::Checkbox( "Accumulate", &accumulate_ );
+	// adaptive pixels stop early, the CPU tracer gives the AO rays of the last frame per pixel and OptiX only the upper bound
+	const int max_spp = no_frames() * min( max( cpu_tracer_.no_ao_samples, 1 ), CpuTracer::kMaxAOSamples );
+	const float error = ( no_frames() > 1 ) ? accumulation_error() : 0.0f;
+	if ( !cpu_tracer_.adaptive_sampling || ( cpu_backend_ && wavefront_ ) )
+	{
+		ImGui::Text( "Frames = %d (%d AO spp), error = %0.2f", no_frames(), max_spp, error );
+	}
+	else if ( cpu_backend_ )
+	{
+		ImGui::Text( "Frames = %d (%0.1f AO spp), error = %0.2f", no_frames(),
+			no_frames() * double( cpu_tracer_.no_ao_rays() ) / ( width() * height() ), error );
+	}
+	else
+	{
+		ImGui::Text( "Frames = %d (at most %d AO spp), error = %0.2f", no_frames(), max_spp, error );
+	}
+	ImGui::SliderInt( "Max frames", &max_frames_, 0, 1024, ( max_frames_ > 0 ) ? "%d" : "unlimited" );
+	ImGui::SliderFloat( "Convergence threshold", &convergence_threshold_, 0.0f, 2.0f, ( convergence_threshold_ > 0.0f ) ? "%.2f" : "off" );
+	ImGui::Separator();
+
+	// rigid placement of a single surface relative to its loaded position, see MoveSurface
+	if ( !surfaces_.empty() )
+	{
+		surface_poses_.resize( surfaces_.size() );
+		ImGui::SliderInt( "Surface", &moved_surface_, 0, static_cast<int>( surfaces_.size() ) - 1 );
+		moved_surface_ = min( max( moved_surface_, 0 ), static_cast<int>( surfaces_.size() ) - 1 );
+
+		SurfacePose & pose = surface_poses_[moved_surface_];
+		bool moved = ImGui::SliderFloat( "Surface rotation", &pose.angle, -180.0f, 180.0f, "%.0f deg" );
+		if ( ImGui::SliderFloat3( "Surface offset", pose.offset, -100.0f, 100.0f, "%.1f" ) ) moved = true;
+
+		if ( moved )
+		{
+			const float alpha = deg2rad( pose.angle );
+			const Matrix3x3 rotation( cosf( alpha ), -sinf( alpha ), 0.0f,
+				sinf( alpha ), cosf( alpha ), 0.0f,
+				0.0f, 0.0f, 1.0f );
+			MoveSurface( surfaces_[moved_surface_], rotation, Vector3( pose.offset[0], pose.offset[1], pose.offset[2] ) );
+		}
+
+		ImGui::Separator();
+	}
+
+	// Embree follows the flat BVH, moved surfaces reach it only once the two-level BVH is switched off
+	PushDisabled( cpu_tracer_.two_level );
+	if ( embree_.is_valid() ) ImGui::Checkbox( "Embree", &cpu_tracer_.use_embree );
+	PopDisabled();
+	ImGui::SliderInt( "Tile size", &cpu_tracer_.tile_size, CpuTracer::kBlockSize, 128 );
+
+	int tile_order = int( cpu_tracer_.scheduler.order );
+	if ( ImGui::Combo( "Tile order", &tile_order, "Scanline\0Morton\0Hilbert\0" ) )
+	{
+		cpu_tracer_.scheduler.order = TileOrder( tile_order );
+	}
+
+	// A/B switch of the SIMD kernels, levels the CPU does not support are refused
+	int isa = int( isa_level() );
+	if ( ImGui::Combo( "ISA", &isa, "SSE4.2\0AVX2\0AVX-512\0" ) )
+	{
+		set_isa_level( IsaLevel( isa ) );
+	}
+
+	const std::vector<TileScheduler::ThreadStats> & thread_stats = cpu_tracer_.scheduler.stats();
+
+	for ( int i = 0; i < static_cast<int>( thread_stats.size() ); ++i )
+	{
+		ImGui::Text( "Thread %d: busy %0.1f ms, idle %0.1f ms, %d tiles, %d steals", i, thread_stats[i].busy_time * 1e+3,
+			thread_stats[i].idle_time * 1e+3, thread_stats[i].no_tiles, thread_stats[i].no_steals );
+	}
 
 	ImGui::SliderFloat( "gamma", &gamma_, 0.1f, 5.0f );
 	ImGui::SliderFloat("fov", &fov, 0.1f, 5.0f);
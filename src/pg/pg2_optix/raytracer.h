@@ -2,6 +2,14 @@
 #include "simpleguidx11.h"
 #include "surface.h"
 #include "camera.h"
+#include "scenegeometry.h"
+#include "dynamicbvh.h"
+#include "cputracer.h"
+#include "embreescene.h"
+#include "twolevelbvh.h"
+#include "wavefronttracer.h"
+#include "scenequery.h"
+#include "denoiser.h"
 
 /*! \class Raytracer
 \brief General ray tracer class.
@@ -19,9 +27,20 @@ public:
 	int InitDeviceAndScene();
 	int initGraph();
 	int get_image(BYTE * buffer) override;
+	const Color3f * frame_colors() const override;
+	void PostProcess(BYTE * buffer) override;
+	bool post_process_changed() override;
+	bool post_process_ready() const override;
+	bool view_changed() override;
 	int ReleaseDeviceAndScene();
 
 	void LoadScene( const std::string file_name );
+
+	/* moves the surface rigidly, while the two-level BVH is traced only its instance moves and the flat BVH is refitted once it is traced again, the OptiX instance follows before the next frame */
+	void MoveSurface( Surface * surface, const Matrix3x3 & rotation, const Vector3 & translation );
+
+	/* batched pick and visibility queries over the CPU copy of the scene, safe to call from other threads while rendering */
+	const SceneQuery & scene_query() const;
 	int Ui();
 
 private:	
@@ -30,14 +49,98 @@ private:
 	
 	RTcontext context = {0};
 	RTbuffer outputBuffer = { 0 };
+	RTbuffer colorBuffer = { 0 }; // linear colors of the launch, read back into frame_colors_
 	RTvariable focal_length;
 	RTvariable view_from;
 	RTvariable M_c_w;
+	RTvariable ao_radius;
+	RTvariable sample_index;
+	RTvariable sampler;
+	RTvariable cosine_sampling;
+	RTvariable ao_samples;
+	RTvariable ao_adaptive_threshold;
+	RTvariable ao_adaptive_batch;
+	RTvariable aov_outputs;
+	RTbuffer aov_buffers_[kNoAovs] = { 0 }; // indexed by Aov
+	unsigned int aov_buffer_outputs_{ 0 }; // outputs the AOV buffers are allocated for
+	int aov_buffer_width_{ 0 };
+	int aov_buffer_height_{ 0 };
+	RTvariable no_lights;
+	RTvariable light_samples;
+	RTvariable light_scale;
+	RTvariable light_sampling;
+	RTbuffer light_buffers_[6] = { 0 }; // vertices, emission, alias probability, alias, area pdf and tree nodes of lights_
+	std::map<Surface *, RTtransform> device_transforms_; // instances of the surfaces in the top-level group
+	RTacceleration top_acceleration_{ 0 }; // of the top-level group, marked dirty whenever a surface moves
 
 	Camera camera;
 	float fov;
 
 	bool unify_normals_{ true };
+	float ao_radius_{ 0.0f }; // tmax of AO rays in both backends, zero means unbounded
+	TextureStorage texture_storage_{ TextureStorage::FLOAT16 }; // texels the CPU backend filters, OptiX is given the original bytes
+
+	// CPU backend
+	SceneGeometry geometry_;
+	DynamicBvh bvh_;
+	TwoLevelBvh two_level_bvh_;
+	LightList lights_; // emissive triangles shared by all backends
+	EmbreeScene embree_;
+	CpuTracer cpu_tracer_;
+	WavefrontTracer wavefront_tracer_;
+	bool cpu_backend_{ false };
+	SceneQuery scene_query_;
+	std::shared_timed_mutex scene_mutex_; // frames and queries read the CPU scene shared, loading and moving surfaces are exclusive
+	bool wavefront_{ false };
+	std::vector<Color3f> frame_colors_; // linear colors of the last frame of either backend, the producer averages these
+	GBuffer gbuffer_; // auxiliary outputs of the last frame of either backend, only those the denoiser and the debug view need
+	Denoiser denoiser_;
+	bool denoise_{ false };
+	int debug_view_{ 0 }; // zero shows the color, otherwise the output Aov( debug_view_ - 1 )
+	std::atomic<int> scene_version_{ 0 }; // incremented whenever the geometry changes
+	unsigned long long view_hash_{ 0 }; // hash of the state the last frame was rendered with
+	unsigned long long post_process_hash_{ 0 }; // hash of the denoiser and debug view settings the displayed image was filtered with
+
+	struct SurfaceTransform
+	{
+		Matrix3x3 rotation;
+		Vector3 translation;
+	};
+
+	struct SurfacePose
+	{
+		float angle{ 0.0f }; // rotation about the z axis in degrees
+		float offset[3] = { 0.0f, 0.0f, 0.0f };
+	};
+
+	BvhSettings bvh_settings_; // of the flat BVH and the meshes of the two-level BVH
+	std::map<Surface *, SurfaceTransform> surface_transforms_; // surfaces moved since loading, the others keep their loaded positions
+	bool two_level_built_{ false }; // the two-level BVH is built by the first frame which traces it
+	bool two_level_traced_{ false }; // the structures are up to date for tracing the two-level BVH rather than the flat one
+	bool flat_bvh_stale_{ false }; // surfaces moved while the two-level BVH was traced, the flat BVH and Embree miss them
+	bool device_transforms_stale_{ false }; // surfaces moved since the last frame, their OptiX instances are not placed yet
+	bool device_lights_stale_{ false }; // an emitter moved since the last frame, the light buffers of the device miss it
+	int moved_surface_{ 0 }; // surface placed in the UI
+	std::vector<SurfacePose> surface_poses_; // placements of surfaces set in the UI
+
 	void error_handler(RTresult code);
 
+	/* renders the frame by OptiX, the requested outputs are read back into gbuffer_ */
+	void LaunchDevice(BYTE * buffer, const float ao_tmax, const unsigned int sample);
+
+	/* sizes the buffers of the requested outputs to the frame and shrinks the others to a single element */
+	void ResizeAovBuffers(const unsigned int outputs);
+
+	/* copies the requested outputs of the last launch into gbuffer_ */
+	void ReadAovBuffers();
+
+	/* bits of the outputs the denoiser and the debug view read, see aov_bit */
+	unsigned int post_process_outputs() const;
+
+	/* copies lights_ into the light buffers of the device */
+	void UploadLights();
+
+	/* builds the two-level BVH when it is traced for the first time, refits the flat BVH after surfaces moved while it was not traced and places the moved OptiX instances, call before each frame from the thread driving OptiX */
+	void UpdateScene();
+
 };
@@ -0,0 +1,51 @@
+#ifndef RNG_H_
+#define RNG_H_
+
+// included by optixtutorial.cu as well so that both backends draw the same numbers
+#ifdef __CUDACC__
+#define RNG_FUNC __host__ __device__ __forceinline__
+#else
+#define RNG_FUNC inline
+#endif
+
+/* PCG hash of a single 32-bit word (Jarzynski and Olano, Hash Functions for GPU Rendering, 2020) */
+RNG_FUNC unsigned int PcgHash( const unsigned int v )
+{
+	const unsigned int state = v * 747796405u + 2891336453u;
+	const unsigned int word = ( ( state >> ( ( state >> 28u ) + 4u ) ) ^ state ) * 277803737u;
+
+	return ( word >> 22u ) ^ word;
+}
+
+/* maps the upper 24 bits to a float in <0, 1) */
+RNG_FUNC float ToUnitFloat( const unsigned int bits )
+{
+	return ( bits >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+/*! \struct RandomStream
+\brief Counter-based random numbers keyed by the pixel, the sample index and the dimension.
+
+There is no state besides the key and the counter, the n-th number of a pixel and sample is
+always the same no matter which thread draws it or in which order the pixels are visited, so
+frames do not depend on the number of threads or the tile schedule. A stream costs a single
+hash per number and nothing to set up, unlike curand_init of XORWOW.
+*/
+struct RandomStream
+{
+	unsigned int key; /*!< Hash of the pixel and the sample index. */
+	unsigned int dimension; /*!< Index of the next number. */
+
+	RNG_FUNC RandomStream( const unsigned int pixel, const unsigned int sample, const unsigned int first_dimension = 0 ) :
+		key( PcgHash( PcgHash( pixel ) + sample ) ), dimension( first_dimension )
+	{
+	}
+
+	/* uniform number in <0, 1) of the current dimension, moves to the next one */
+	RNG_FUNC float next()
+	{
+		return ToUnitFloat( PcgHash( key + dimension++ ) );
+	}
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "sampler.h"
+#include "mymath.h"
+#include "utils.h"
+#include <algorithm>
+
+namespace
+{
+	const int kNoMaskPixels = kBlueNoiseSize * kBlueNoiseSize;
+
+	/*! \class VoidAndCluster
+	\brief Ranks pixels of a toroidal mask by the void-and-cluster method (Ulichney, 1993).
+
+	The energy of a pixel is the sum of Gaussians centered at all set pixels, the tightest cluster
+	is the set pixel of the highest energy and the largest void the empty one of the lowest.
+	Filling voids until the mask is full ranks every pixel, the ranks divided by the number of
+	pixels form the blue-noise mask.
+	*/
+	class VoidAndCluster
+	{
+	public:
+		explicit VoidAndCluster( const unsigned int seed )
+		{
+			const float sigma = 1.5f;
+
+			for ( int y = 0; y < kBlueNoiseSize; ++y )
+			{
+				for ( int x = 0; x < kBlueNoiseSize; ++x )
+				{
+					// toroidal distance so that the mask tiles seamlessly
+					const int dx = min( x, kBlueNoiseSize - x );
+					const int dy = min( y, kBlueNoiseSize - y );
+					kernel_[x + y * kBlueNoiseSize] = expf( -( dx * dx + dy * dy ) / ( 2.0f * sigma * sigma ) );
+				}
+			}
+
+			// initial pattern of random points
+			RandomStream rng( seed, 0 );
+
+			for ( int i = 0; i < kNoMaskPixels / 10; ++i )
+			{
+				const int p = min( int( rng.next() * kNoMaskPixels ), kNoMaskPixels - 1 );
+				if ( !set_[p] ) Toggle( p );
+			}
+
+			// spread the points by moving the tightest cluster into the largest void until it is the same pixel
+			for ( int i = 0; i < kNoMaskPixels; ++i )
+			{
+				const int cluster = Find( true );
+				Toggle( cluster );
+				const int void_pixel = Find( false );
+				Toggle( void_pixel );
+
+				if ( void_pixel == cluster ) break;
+			}
+		}
+
+		/* ranks of pixels scaled into <0, 1) */
+		void Rank( float * mask, const int stride )
+		{
+			const std::vector<bool> initial_set( set_, set_ + kNoMaskPixels );
+			const std::vector<float> initial_energy( energy_, energy_ + kNoMaskPixels );
+			const int no_points = static_cast<int>( std::count( initial_set.begin(), initial_set.end(), true ) );
+
+			// points of the initial pattern are ranked by removing the tightest clusters
+			for ( int rank = no_points - 1; rank >= 0; --rank )
+			{
+				const int cluster = Find( true );
+				Toggle( cluster );
+				mask[cluster * stride] = float( rank ) / kNoMaskPixels;
+			}
+
+			std::copy( initial_set.begin(), initial_set.end(), set_ );
+			std::copy( initial_energy.begin(), initial_energy.end(), energy_ );
+
+			// the rest by filling the largest voids
+			for ( int rank = no_points; rank < kNoMaskPixels; ++rank )
+			{
+				const int void_pixel = Find( false );
+				Toggle( void_pixel );
+				mask[void_pixel * stride] = float( rank ) / kNoMaskPixels;
+			}
+		}
+
+	private:
+		/* flips the pixel and updates energies of all pixels */
+		void Toggle( const int p )
+		{
+			set_[p] = !set_[p];
+			const float sign = ( set_[p] ) ? 1.0f : -1.0f;
+			const int px = p % kBlueNoiseSize;
+			const int py = p / kBlueNoiseSize;
+
+			for ( int y = 0; y < kBlueNoiseSize; ++y )
+			{
+				const int ky = ( y - py + kBlueNoiseSize ) % kBlueNoiseSize;
+
+				for ( int x = 0; x < kBlueNoiseSize; ++x )
+				{
+					energy_[x + y * kBlueNoiseSize] += sign * kernel_[( x - px + kBlueNoiseSize ) % kBlueNoiseSize + ky * kBlueNoiseSize];
+				}
+			}
+		}
+
+		/* the set pixel of the highest energy or the empty pixel of the lowest energy */
+		int Find( const bool set ) const
+		{
+			int best = -1;
+
+			for ( int p = 0; p < kNoMaskPixels; ++p )
+			{
+				if ( set_[p] != set ) continue;
+
+				if ( best < 0 || ( set ? energy_[p] > energy_[best] : energy_[p] < energy_[best] ) ) best = p;
+			}
+
+			return best;
+		}
+
+		float kernel_[kNoMaskPixels];
+		float energy_[kNoMaskPixels]{ };
+		bool set_[kNoMaskPixels]{ };
+	};
+
+	std::vector<float> mask;
+	std::once_flag mask_built;
+}
+
+const float * blue_noise_mask()
+{
+	std::call_once( mask_built, []()
+	{
+		auto t0 = std::chrono::high_resolution_clock::now();
+
+		// both channels from independent initial patterns
+		mask.resize( kNoMaskPixels * 2 );
+
+		for ( int channel = 0; channel < 2; ++channel )
+		{
+			std::unique_ptr<VoidAndCluster> ranks( new VoidAndCluster( channel + 1 ) );
+			ranks->Rank( mask.data() + channel, 2 );
+		}
+
+		printf( "Blue-noise mask (%dx%d) built in %s.\n", kBlueNoiseSize, kBlueNoiseSize,
+			TimeToString( std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count() ).c_str() );
+	} );
+
+	return mask.data();
+}
+
+Vector3 SampleAmbientOcclusion( const Vector3 & normal, PixelSampler & sampler, const bool cosine_weighted, float & weight )
+{
+	float random_x, random_y;
+	sampler.next( random_x, random_y );
+
+	if ( cosine_weighted )
+	{
+		weight = float( M_PI ); // the cosine cancels out
+
+		return SampleCosineHemisphere( normal, random_x, random_y );
+	}
+
+	const Vector3 omega_i = SampleHemisphere( normal, random_x, random_y );
+	weight = normal.DotProduct( omega_i ) * 2.0f * float( M_PI );
+
+	return omega_i;
+}
+
+PixelSampler pixel_sampler( const SamplerType type, const int x, const int y, const int width, const unsigned int sample,
+	const unsigned int no_samples )
+{
+	if ( type != SamplerType::BLUE_NOISE ) return PixelSampler( type, x + y * width, sample, no_samples );
+
+	const float * offset = &blue_noise_mask()[( x % kBlueNoiseSize + ( y % kBlueNoiseSize ) * kBlueNoiseSize ) * 2];
+
+	return PixelSampler( type, x + y * width, sample, no_samples, offset[0], offset[1] );
+}
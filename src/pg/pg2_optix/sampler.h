@@ -0,0 +1,120 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include "rng.h"
+
+/* sequence of 2D sample points of ambient occlusion, the values are shared with the sampler context variable */
+enum class SamplerType : int { RANDOM = 0, SOBOL = 1, BLUE_NOISE = 2 };
+
+static const int kBlueNoiseSize = 64; /*!< Side of the tiled blue-noise mask in pixels. */
+
+/* reverses the order of bits of a 32-bit word */
+RNG_FUNC unsigned int ReverseBits( unsigned int v )
+{
+#ifdef __CUDA_ARCH__
+	return __brev( v );
+#else
+	v = ( ( v >> 1 ) & 0x55555555u ) | ( ( v & 0x55555555u ) << 1 );
+	v = ( ( v >> 2 ) & 0x33333333u ) | ( ( v & 0x33333333u ) << 2 );
+	v = ( ( v >> 4 ) & 0x0f0f0f0fu ) | ( ( v & 0x0f0f0f0fu ) << 4 );
+	v = ( ( v >> 8 ) & 0x00ff00ffu ) | ( ( v & 0x00ff00ffu ) << 8 );
+
+	return ( v >> 16 ) | ( v << 16 );
+#endif
+}
+
+/* the first two dimensions of the Sobol sequence, i.e. the van der Corput sequence and its Pascal matrix counterpart */
+RNG_FUNC void Sobol2D( unsigned int index, unsigned int & x, unsigned int & y )
+{
+	x = ReverseBits( index );
+	y = 0;
+
+	for ( unsigned int v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1 )
+	{
+		if ( index & 1 ) y ^= v;
+	}
+}
+
+/* Owen scrambling of the bits from the most significant one, the hash of Burley, Practical Hash-based Owen Scrambling, 2020 */
+RNG_FUNC unsigned int OwenScramble( unsigned int x, const unsigned int seed )
+{
+	x = ReverseBits( x );
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+
+	return ReverseBits( x );
+}
+
+/*! \struct PixelSampler
+\brief Sample points of a single pixel drawn one after another.
+
+RANDOM draws independent pairs from RandomStream. SOBOL draws the shuffled Owen-scrambled
+Sobol (0,2)-sequence with a different scramble per pixel, so each pixel gets a stratified set
+of any power of two size and pixels stay decorrelated. BLUE_NOISE shares a single Sobol
+sequence among all pixels and shifts it toroidally by the value of a blue-noise mask, so the
+remaining error is pushed to high frequencies in screen space. Frame sample s continues the
+sequence at the point s * no_samples, accumulated frames thus keep the stratification.
+*/
+struct PixelSampler
+{
+	SamplerType type;
+	RandomStream rng;
+	unsigned int seed; /*!< Owen scramble seed of the pixel. */
+	unsigned int index; /*!< Index of the next point of the sequence. */
+	float offset_x, offset_y; /*!< Blue-noise shift of the pixel. */
+
+	RNG_FUNC PixelSampler( const SamplerType type, const unsigned int pixel, const unsigned int sample, const unsigned int no_samples,
+		const float offset_x = 0.0f, const float offset_y = 0.0f ) :
+		type( type ), rng( pixel, sample ), seed( PcgHash( pixel ^ 0x5bd1e995u ) ), index( sample * no_samples ),
+		offset_x( offset_x ), offset_y( offset_y )
+	{
+	}
+
+	/* the next point in <0, 1)^2 */
+	RNG_FUNC void next( float & u, float & v )
+	{
+		if ( type == SamplerType::RANDOM )
+		{
+			u = rng.next();
+			v = rng.next();
+
+			return;
+		}
+
+		unsigned int x, y;
+
+		if ( type == SamplerType::SOBOL )
+		{
+			Sobol2D( OwenScramble( index++, seed ), x, y );
+			u = ToUnitFloat( OwenScramble( x, PcgHash( seed + 1 ) ) );
+			v = ToUnitFloat( OwenScramble( y, PcgHash( seed + 2 ) ) );
+		}
+		else
+		{
+			Sobol2D( index++, x, y );
+			u = ToUnitFloat( x ) + offset_x;
+			v = ToUnitFloat( y ) + offset_y;
+			if ( u >= 1.0f ) u -= 1.0f;
+			if ( v >= 1.0f ) v -= 1.0f;
+		}
+	}
+};
+
+#ifndef __CUDACC__
+#include "vector3.h"
+
+/* direction of an AO ray around the unit normal and its cosine over pdf */
+Vector3 SampleAmbientOcclusion( const Vector3 & normal, PixelSampler & sampler, const bool cosine_weighted, float & weight );
+
+/* two channels of the tileable blue-noise mask of kBlueNoiseSize^2 pixels made by the void-and-cluster method, built on the first call */
+const float * blue_noise_mask();
+
+/* sampler of the pixel (x, y), the blue-noise shift is read from the tiled mask */
+PixelSampler pixel_sampler( const SamplerType type, const int x, const int y, const int width, const unsigned int sample,
+	const unsigned int no_samples );
+#endif
+
+#endif
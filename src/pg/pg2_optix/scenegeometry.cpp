@@ -0,0 +1,175 @@
+#include "pch.h"
+#include "scenegeometry.h"
+#include "mymath.h"
+
+void SceneGeometry::Build( std::vector<Surface *> & surfaces )
+{
+	int no_triangles = 0;
+
+	for ( auto surface : surfaces )
+	{
+		no_triangles += surface->no_triangles();
+	}
+
+	vertices_.clear();
+	triangles_.clear();
+	normals_.clear();
+	texcoords_.clear();
+	surfaces_.clear();
+	first_triangles_.clear();
+
+	// one spare vertex, Embree reads vertices with 16-byte loads directly from this buffer
+	vertices_.reserve( no_triangles * 3 + 1 );
+	triangles_.reserve( no_triangles );
+	normals_.reserve( no_triangles * 3 );
+	texcoords_.reserve( no_triangles * 3 );
+	surfaces_.reserve( no_triangles );
+
+	// surfaces loop
+	for ( auto surface : surfaces )
+	{
+		first_triangles_[surface] = static_cast<int>( triangles_.size() );
+
+		// triangles loop
+		for ( int i = 0; i < surface->no_triangles(); ++i )
+		{
+			Triangle & triangle = surface->get_triangle( i );
+
+			const unsigned int k = static_cast<unsigned int>( vertices_.size() );
+			triangles_.push_back( Triangle3ui{ k, k + 1, k + 2 } );
+			surfaces_.push_back( surface );
+
+			// vertices loop
+			for ( int j = 0; j < 3; ++j )
+			{
+				const Vertex & vertex = triangle.vertex( j );
+				vertices_.push_back( Vertex3f{ vertex.position.x, vertex.position.y, vertex.position.z } );
+				normals_.push_back( vertex.normal );
+				texcoords_.push_back( vertex.texture_coords[0] );
+			} // end of vertices loop
+		} // end of triangles loop
+	} // end of surfaces loop
+}
+
+void SceneGeometry::SetTransform( Surface * surface, const Matrix3x3 & rotation, const Vector3 & translation )
+{
+	auto it = first_triangles_.find( surface );
+	if ( it == first_triangles_.end() ) return;
+
+	const int first = it->second;
+
+	for ( int i = 0; i < surface->no_triangles(); ++i )
+	{
+		Triangle & triangle = surface->get_triangle( i );
+
+		for ( int j = 0; j < 3; ++j )
+		{
+			const Vertex & vertex = triangle.vertex( j );
+			const unsigned int k = ( first + i ) * 3 + j;
+			const Vector3 position = rotation * vertex.position + translation;
+
+			vertices_[k] = Vertex3f{ position.x, position.y, position.z };
+			normals_[k] = rotation * vertex.normal;
+		}
+	}
+}
+
+int SceneGeometry::no_triangles() const
+{
+	return static_cast<int>( triangles_.size() );
+}
+
+int SceneGeometry::no_vertices() const
+{
+	return static_cast<int>( vertices_.size() );
+}
+
+const Vertex3f * SceneGeometry::vertices() const
+{
+	return vertices_.data();
+}
+
+const Triangle3ui * SceneGeometry::triangles() const
+{
+	return triangles_.data();
+}
+
+Vector3 SceneGeometry::position( const int i, const int j ) const
+{
+	const Triangle3ui & t = triangles_[i];
+	const unsigned int indices[3] = { t.v0, t.v1, t.v2 };
+
+	return vertices_[indices[j]];
+}
+
+Vector3 SceneGeometry::normal( const int i, const float u, const float v ) const
+{
+	const Triangle3ui & t = triangles_[i];
+	Vector3 n = normals_[t.v1] * u + normals_[t.v2] * v + normals_[t.v0] * ( 1.0f - u - v );
+	n.Normalize();
+
+	return n;
+}
+
+Coord2f SceneGeometry::texcoord( const int i, const float u, const float v ) const
+{
+	const Triangle3ui & t = triangles_[i];
+	const Coord2f & t0 = texcoords_[t.v0];
+	const Coord2f & t1 = texcoords_[t.v1];
+	const Coord2f & t2 = texcoords_[t.v2];
+
+	return Coord2f{ t1.u * u + t2.u * v + t0.u * ( 1.0f - u - v ),
+		t1.v * u + t2.v * v + t0.v * ( 1.0f - u - v ) };
+}
+
+Color3f SceneGeometry::albedo( const int i, const float u, const float v ) const
+{
+	const Material * material = surfaces_[i]->get_material();
+	if ( material->shader() == Shader::NORMAL ) return Color3f( 1.0f, 1.0f, 1.0f );
+
+	const Coord2f tc = texcoord( i, u, v );
+	const Coord2f flipped_texcoord{ tc.u, 1.0f - tc.v };
+
+	return material->diffuse( &flipped_texcoord );
+}
+
+Surface * SceneGeometry::surface( const int i ) const
+{
+	return surfaces_[i];
+}
+
+Material * SceneGeometry::material( const int i ) const
+{
+	return surfaces_[i]->get_material();
+}
+
+AABB SceneGeometry::bounds( const int i ) const
+{
+	AABB b;
+
+	for ( int j = 0; j < 3; ++j )
+	{
+		b.merge( position( i, j ) );
+	}
+
+	return b;
+}
+
+AABB SceneGeometry::bounds() const
+{
+	AABB b;
+
+	for ( const Vertex3f & vertex : vertices_ )
+	{
+		b.merge( Vector3( vertex ) );
+	}
+
+	return b;
+}
+
+unsigned long long SceneGeometry::hash() const
+{
+	const unsigned long long h = QuickHash( reinterpret_cast<const BYTE *>( vertices_.data() ), vertices_.size() * sizeof( Vertex3f ) );
+
+	return QuickHash( reinterpret_cast<const BYTE *>( triangles_.data() ), triangles_.size() * sizeof( Triangle3ui ), h );
+}
@@ -0,0 +1,60 @@
+#ifndef SCENE_GEOMETRY_H_
+#define SCENE_GEOMETRY_H_
+
+#include "structs.h"
+#include "surface.h"
+#include "aabb.h"
+#include "matrix3x3.h"
+
+/*! \class SceneGeometry
+\brief Flattened triangle soup of all loaded surfaces used by the CPU backend.
+
+The layout is the same as the one uploaded into OptiX buffers in Raytracer::LoadScene,
+i.e. three consecutive vertices per triangle and the triangle index equals rtGetPrimitiveIndex.
+*/
+class SceneGeometry
+{
+public:
+	/* flattens all triangles of the given surfaces */
+	void Build( std::vector<Surface *> & surfaces );
+
+	/* places triangles of the surface by the rigid transform of its loaded vertices, the surface itself is left untouched */
+	void SetTransform( Surface * surface, const Matrix3x3 & rotation, const Vector3 & translation );
+
+	int no_triangles() const;
+	int no_vertices() const;
+
+	const Vertex3f * vertices() const;
+	const Triangle3ui * triangles() const;
+
+	/* position of the j-th vertex of the i-th triangle */
+	Vector3 position( const int i, const int j ) const;
+
+	/* shading normal interpolated with barycentrics (u, v) exactly as attribute_program does */
+	Vector3 normal( const int i, const float u, const float v ) const;
+
+	/* texture coordinates interpolated with barycentrics (u, v) */
+	Coord2f texcoord( const int i, const float u, const float v ) const;
+
+	/* diffuse color of the material at barycentrics (u, v) as the shaders read it, white for Shader::NORMAL */
+	Color3f albedo( const int i, const float u, const float v ) const;
+
+	Surface * surface( const int i ) const;
+	Material * material( const int i ) const;
+
+	AABB bounds( const int i ) const;
+	AABB bounds() const;
+
+	/* QuickHash of vertex positions and triangle indices, i.e. of everything the BVH depends on */
+	unsigned long long hash() const;
+
+private:
+	std::vector<Vertex3f> vertices_;
+	std::vector<Triangle3ui> triangles_;
+	std::vector<Vector3> normals_;
+	std::vector<Coord2f> texcoords_;
+	std::vector<Surface *> surfaces_; // owner of each triangle
+	std::map<const Surface *, int> first_triangles_; // triangles of a surface form a continuous range
+};
+
+#endif
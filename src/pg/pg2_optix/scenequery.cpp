@@ -0,0 +1,103 @@
+#include "pch.h"
+#include "scenequery.h"
+
+int QueryHits::size() const
+{
+	return static_cast<int>( t.size() );
+}
+
+void QueryHits::resize( const int n )
+{
+	t.assign( n, FLT_MAX );
+	triangle_id.assign( n, -1 );
+	u.assign( n, 0.0f );
+	v.assign( n, 0.0f );
+	surface.assign( n, nullptr );
+}
+
+void SceneQuery::set_scene( const SceneGeometry * geometry, const DynamicBvh * bvh, std::shared_timed_mutex * mutex )
+{
+	geometry_ = geometry;
+	bvh_ = bvh;
+	mutex_ = mutex;
+}
+
+void SceneQuery::set_two_level( const TwoLevelBvh * two_level_bvh )
+{
+	two_level_bvh_ = two_level_bvh;
+}
+
+void SceneQuery::Intersect( const RayStream & rays, QueryHits & hits ) const
+{
+	const int n = rays.size();
+	hits.resize( n );
+
+	if ( geometry_ == nullptr || bvh_ == nullptr ) return;
+
+	std::shared_lock<std::shared_timed_mutex> lock( *mutex_ );
+	const Bvh & bvh = bvh_->bvh();
+
+#pragma omp parallel for schedule( dynamic, 64 ) if ( n > 256 )
+	for ( int i = 0; i < n; ++i )
+	{
+		Ray ray = rays.ray( i );
+		RayHit hit;
+
+		if ( ( two_level_bvh_ != nullptr ) ? two_level_bvh_->Intersect( ray, hit ) : bvh.Intersect( ray, hit ) )
+		{
+			hits.t[i] = ray.t_far;
+			hits.triangle_id[i] = hit.triangle_id;
+			hits.u[i] = hit.u;
+			hits.v[i] = hit.v;
+			hits.surface[i] = geometry_->surface( hit.triangle_id );
+		}
+	}
+}
+
+void SceneQuery::Occluded( const RayStream & rays, std::vector<char> & occluded ) const
+{
+	const int n = rays.size();
+	occluded.assign( n, 0 );
+
+	if ( geometry_ == nullptr || bvh_ == nullptr ) return;
+
+	std::shared_lock<std::shared_timed_mutex> lock( *mutex_ );
+	const Bvh & bvh = bvh_->bvh();
+
+#pragma omp parallel for schedule( dynamic, 64 ) if ( n > 256 )
+	for ( int i = 0; i < n; ++i )
+	{
+		const bool blocked = ( two_level_bvh_ != nullptr ) ? two_level_bvh_->Occluded( rays.ray( i ) ) : bvh.Occluded( rays.ray( i ) );
+		occluded[i] = ( blocked ) ? 1 : 0;
+	}
+}
+
+void SceneQuery::Pick( Camera camera, const int width, const int height, const int * x, const int * y, const int n, QueryHits & hits ) const
+{
+	const Matrix3x3 M_c_w = camera.M_c_w();
+	const float focal_length = camera.focalLength();
+
+	RayStream rays;
+	rays.resize( n );
+
+	for ( int i = 0; i < n; ++i )
+	{
+		// CpuTracer::primary_direction
+		Vector3 d_w = M_c_w * Vector3( x[i] - width * 0.5f, height * 0.5f - y[i], -focal_length );
+		d_w.Normalize();
+
+		rays.set( i, camera.view_from(), d_w, x[i] + y[i] * width );
+	}
+
+	Intersect( rays, hits );
+}
+
+void SceneQuery::set_segment( RayStream & rays, const int i, const Vector3 & a, const Vector3 & b )
+{
+	// unit direction so that t_near keeps its meaning, the end point is excluded the same way as the origin
+	Vector3 d = b - a;
+	const float length = d.L2Norm();
+	d.Normalize();
+
+	rays.set( i, a, d, -1, length - rays.t_near );
+}
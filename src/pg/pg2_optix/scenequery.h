@@ -0,0 +1,57 @@
+#ifndef SCENE_QUERY_H_
+#define SCENE_QUERY_H_
+
+#include "dynamicbvh.h"
+#include "twolevelbvh.h"
+#include "camera.h"
+
+/*! \struct QueryHits
+\brief Results of a batch of closest hit queries stored as SoA, a miss has the triangle id -1.
+*/
+struct QueryHits
+{
+	std::vector<float> t; /*!< Hit distance along the ray direction. */
+	std::vector<int> triangle_id;
+	std::vector<float> u;
+	std::vector<float> v;
+	std::vector<Surface *> surface; /*!< Hit surface or nullptr, its material gives the shader. */
+
+	int size() const;
+	void resize( const int n );
+};
+
+/*! \class SceneQuery
+\brief Batched ray queries over the scene loaded into the CPU backend.
+
+Queries traverse the same BVH the renderer uses. They take the scene lock shared, so any
+number of query threads run concurrently with frames being rendered and only wait while
+the scene itself changes (loading, moving surfaces).
+*/
+class SceneQuery
+{
+public:
+	void set_scene( const SceneGeometry * geometry, const DynamicBvh * bvh, std::shared_timed_mutex * mutex );
+
+	/* queries traverse the two-level BVH instead of the flat one while it is set, the owner changes it under the exclusive lock */
+	void set_two_level( const TwoLevelBvh * two_level_bvh );
+
+	/* closest hits of all rays within <rays.t_near, rays.t_far[i]> */
+	void Intersect( const RayStream & rays, QueryHits & hits ) const;
+
+	/* any hit queries, occluded[i] is 1 if something blocks the i-th ray */
+	void Occluded( const RayStream & rays, std::vector<char> & occluded ) const;
+
+	/* closest hits of primary rays through the given pixels, the same rays as CpuTracer traces */
+	void Pick( Camera camera, const int width, const int height, const int * x, const int * y, const int n, QueryHits & hits ) const;
+
+	/* fills the i-th ray so that Occluded tests the visibility between points a and b */
+	static void set_segment( RayStream & rays, const int i, const Vector3 & a, const Vector3 & b );
+
+private:
+	const SceneGeometry * geometry_{ nullptr };
+	const DynamicBvh * bvh_{ nullptr };
+	const TwoLevelBvh * two_level_bvh_{ nullptr };
+	std::shared_timed_mutex * mutex_{ nullptr };
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "pch.h"
+#include "shadingbatch.h"
+
+Shader shading_kernel( const Shader shader )
+{
+	return ( shader == Shader::PHONG || shader == Shader::NORMAL ) ? shader : Shader::LAMBERT;
+}
+
+int shading_key( const Material & material )
+{
+	return ( int( shading_kernel( material.shader() ) ) << 16 ) | ( material.materialIndex & 0xffff );
+}
+
+void ShadingBuffer::resize( const int no_hits, const int no_lights )
+{
+	no_hits_ = no_hits;
+	no_lights_ = no_lights;
+
+	for ( int a = 0; a < NO_ARRAYS; ++a )
+	{
+		arrays_[a].resize( ( ( a < LIGHT_DIRECTION ) ? no_hits : no_hits * no_lights ) + kPadding );
+	}
+}
+
+void ShadingBuffer::set_hit( const int k, const Vector3 & normal, const Vector3 & direction, const Color3f & diffuse,
+	const Color3f & ambient_occlusion )
+{
+	for ( int c = 0; c < 3; ++c )
+	{
+		arrays_[NORMAL + c][k] = normal.data[c];
+		arrays_[DIRECTION + c][k] = direction.data[c];
+	}
+
+	arrays_[DIFFUSE + 0][k] = diffuse.r;
+	arrays_[DIFFUSE + 1][k] = diffuse.g;
+	arrays_[DIFFUSE + 2][k] = diffuse.b;
+	arrays_[AMBIENT_OCCLUSION + 0][k] = ambient_occlusion.r;
+	arrays_[AMBIENT_OCCLUSION + 1][k] = ambient_occlusion.g;
+	arrays_[AMBIENT_OCCLUSION + 2][k] = ambient_occlusion.b;
+}
+
+void ShadingBuffer::set_light( const int k, const int j, const Vector3 & direction, const Color3f & radiance )
+{
+	const int l = j * no_hits_ + k;
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		arrays_[LIGHT_DIRECTION + c][l] = direction.data[c];
+	}
+
+	arrays_[LIGHT_RADIANCE + 0][l] = radiance.r;
+	arrays_[LIGHT_RADIANCE + 1][l] = radiance.g;
+	arrays_[LIGHT_RADIANCE + 2][l] = radiance.b;
+}
+
+ShadingBatch ShadingBuffer::batch( const int first, const int last, const Material & material, const float light_scale ) const
+{
+	ShadingBatch batch;
+	const Shader shader = shading_kernel( material.shader() );
+	batch.model = ( shader == Shader::PHONG ) ? ShadingModel::PHONG : ( ( shader == Shader::NORMAL ) ? ShadingModel::NORMAL : ShadingModel::LAMBERT );
+	batch.no_hits = last - first;
+	batch.no_lights = no_lights_;
+	batch.light_stride = no_hits_;
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		batch.normal[c] = arrays_[NORMAL + c].data() + first;
+		batch.direction[c] = arrays_[DIRECTION + c].data() + first;
+		batch.diffuse[c] = arrays_[DIFFUSE + c].data() + first;
+		batch.ambient_occlusion[c] = arrays_[AMBIENT_OCCLUSION + c].data() + first;
+		batch.light_direction[c] = arrays_[LIGHT_DIRECTION + c].data() + first;
+		batch.light_radiance[c] = arrays_[LIGHT_RADIANCE + c].data() + first;
+	}
+
+	const Color3f ambient = material.ambient();
+	const Color3f specular = material.specular();
+	const Color3f emitted = material.emission() * light_scale;
+
+	batch.ambient[0] = ambient.r;
+	batch.ambient[1] = ambient.g;
+	batch.ambient[2] = ambient.b;
+	batch.specular[0] = specular.r;
+	batch.specular[1] = specular.g;
+	batch.specular[2] = specular.b;
+	batch.emitted[0] = emitted.r;
+	batch.emitted[1] = emitted.g;
+	batch.emitted[2] = emitted.b;
+
+	batch.shininess = material.shininess;
+	batch.light_weight = light_scale / no_lights_;
+
+	return batch;
+}
@@ -0,0 +1,43 @@
+#ifndef SHADING_BATCH_H_
+#define SHADING_BATCH_H_
+
+#include "material.h"
+#include "simdkernels.h"
+
+/* shader of the kernel the hits of the shader are resolved by, the shaders without their own one fall back to Lambert as in CpuTracer::Shade */
+Shader shading_kernel( const Shader shader );
+
+/* sort key of hits of the material, the kernel first and the material index next */
+int shading_key( const Material & material );
+
+/*! \class ShadingBuffer
+\brief Storage of the arrays of ShadingBatch for hits already sorted by shading_key.
+
+Hits are written at their position in the sorted order, a run of hits of the same material
+is then passed to the kernel as a single batch.
+*/
+class ShadingBuffer
+{
+public:
+	static const int kPadding = 16; /*!< Floats readable past the end of each array, the widest vector. */
+
+	/* room for the hits and their light points, the content is undefined */
+	void resize( const int no_hits, const int no_lights );
+
+	void set_hit( const int k, const Vector3 & normal, const Vector3 & direction, const Color3f & diffuse, const Color3f & ambient_occlusion );
+
+	/* the light point j of the hit k */
+	void set_light( const int k, const int j, const Vector3 & direction, const Color3f & radiance );
+
+	/* hits <first, last) which share the material */
+	ShadingBatch batch( const int first, const int last, const Material & material, const float light_scale ) const;
+
+private:
+	enum Array { NORMAL, DIRECTION = 3, DIFFUSE = 6, AMBIENT_OCCLUSION = 9, LIGHT_DIRECTION = 12, LIGHT_RADIANCE = 15, NO_ARRAYS = 18 };
+
+	std::vector<float> arrays_[NO_ARRAYS];
+	int no_hits_{ 0 };
+	int no_lights_{ 0 };
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "pch.h"
+#include "simdkernels.h"
+#include "structs.h"
+#include "mymath.h"
+#include <intrin.h>
+
+static_assert( sizeof( Color3f ) == 3 * sizeof( float ), "the kernels read and write arrays of Color3f as RGB triples" );
+
+namespace
+{
+	std::atomic<const SimdKernels *> active_kernels{ nullptr };
+	std::once_flag selection;
+
+	const SimdKernels & kernels( const IsaLevel level )
+	{
+		switch ( level )
+		{
+		case IsaLevel::AVX512: return simd_kernels_avx512();
+		case IsaLevel::AVX2: return simd_kernels_avx2();
+		default: return simd_kernels_sse42();
+		}
+	}
+
+	const SimdKernels * SelectKernels()
+	{
+		const IsaLevel detected = detected_isa_level();
+		IsaLevel level = detected;
+
+		const char * name = getenv( "PG2_ISA" );
+
+		if ( name != nullptr )
+		{
+			for ( const IsaLevel requested : { IsaLevel::SSE42, IsaLevel::AVX2, IsaLevel::AVX512 } )
+			{
+				if ( _stricmp( name, isa_name( requested ) ) == 0 ) level = min( requested, detected );
+			}
+		}
+
+		printf( "CPU supports %s, using %s kernels%s.\n", isa_name( detected ), isa_name( level ),
+			( name != nullptr ) ? " (PG2_ISA override)" : "" );
+
+		return &kernels( level );
+	}
+}
+
+IsaLevel detected_isa_level()
+{
+	int info[4] = { 0 };
+	__cpuid( info, 0 );
+	const int max_leaf = info[0];
+
+	__cpuid( info, 1 );
+	const bool osxsave = ( info[2] & ( 1 << 27 ) ) != 0;
+	const bool avx = ( info[2] & ( 1 << 28 ) ) != 0;
+	const bool fma = ( info[2] & ( 1 << 12 ) ) != 0;
+
+	// the OS has to save the ymm (bits 1 and 2) and zmm (bits 5 to 7) state on context switches
+	const unsigned long long xcr0 = ( osxsave ) ? _xgetbv( 0 ) : 0;
+	const bool ymm_state = ( xcr0 & 0x6 ) == 0x6;
+	const bool zmm_state = ( xcr0 & 0xe6 ) == 0xe6;
+
+	int leaf7[4] = { 0 };
+	if ( max_leaf >= 7 ) __cpuidex( leaf7, 7, 0 );
+
+	const bool avx2 = ( leaf7[1] & ( 1 << 5 ) ) != 0;
+	const bool avx512f = ( leaf7[1] & ( 1 << 16 ) ) != 0;
+
+	if ( avx && avx2 && fma && ymm_state && avx512f && zmm_state ) return IsaLevel::AVX512;
+	if ( avx && avx2 && fma && ymm_state ) return IsaLevel::AVX2;
+
+	return IsaLevel::SSE42;
+}
+
+IsaLevel isa_level()
+{
+	return simd_kernels().isa;
+}
+
+bool set_isa_level( const IsaLevel level )
+{
+	simd_kernels(); // the initial selection must not override this one
+
+	if ( level > detected_isa_level() )
+	{
+		printf( "%s kernels are not supported by this CPU.\n", isa_name( level ) );
+
+		return false;
+	}
+
+	active_kernels.store( &kernels( level ) );
+	printf( "Using %s kernels.\n", isa_name( level ) );
+
+	return true;
+}
+
+const char * isa_name( const IsaLevel level )
+{
+	switch ( level )
+	{
+	case IsaLevel::AVX512: return "AVX512";
+	case IsaLevel::AVX2: return "AVX2";
+	default: return "SSE42";
+	}
+}
+
+const SimdKernels & simd_kernels()
+{
+	std::call_once( selection, [] { active_kernels.store( SelectKernels() ); } );
+
+	return *active_kernels.load();
+}
@@ -0,0 +1,155 @@
+#ifndef SIMD_KERNELS_H_
+#define SIMD_KERNELS_H_
+
+// Plain data only. The units built with /arch include nothing but this header and the intrinsics, so
+// no inline function of another header is compiled with their instruction set, the linker keeps a
+// single copy of each inline function and might otherwise pick one that faults on older CPUs.
+
+/*! \enum IsaLevel
+\brief Instruction set levels the hot kernels are compiled for.
+*/
+enum class IsaLevel : char
+{
+	SSE42, /*!< 4 lanes, the baseline of every supported CPU. */
+	AVX2, /*!< 8 lanes. */
+	AVX512 /*!< 16 lanes with mask registers (AVX-512F). */
+};
+
+/*! \struct PacketLanes
+\brief Per-ray part of a RayPacket, the packet kernels read and update only these arrays.
+*/
+struct PacketLanes
+{
+	static const int kSize = 64; /*!< Maximal number of rays in a packet (8x8 pixel tile). */
+
+	int no_rays{ 0 };
+	float t_near{ 0.01f };
+
+	alignas( 32 ) float dir_x[kSize];
+	alignas( 32 ) float dir_y[kSize];
+	alignas( 32 ) float dir_z[kSize];
+
+	alignas( 32 ) float inv_x[kSize];
+	alignas( 32 ) float inv_y[kSize];
+	alignas( 32 ) float inv_z[kSize];
+
+	alignas( 32 ) float t_far[kSize];
+	alignas( 32 ) int triangle_id[kSize];
+	alignas( 32 ) float u[kSize];
+	alignas( 32 ) float v[kSize];
+};
+
+/*! \enum ShadingModel
+\brief Shaders with their own shading kernel, the others are shaded as LAMBERT, see shading_kernel.
+*/
+enum class ShadingModel : char
+{
+	LAMBERT,
+	PHONG,
+	NORMAL
+};
+
+/*! \struct ShadingBatch
+\brief Hits of a single material in the SoA layout shaded by SimdKernels::shade_batch.
+
+Arrays of hits hold a float per hit, arrays of light points hold no_lights rows of
+light_stride floats, i.e. the point j of the hit k is at j * light_stride + k. Skipped and
+occluded light points have zero radiance. All arrays stay readable a full vector past
+their last element so that the kernel does not need masked loads.
+*/
+struct ShadingBatch
+{
+	ShadingModel model;
+	int no_hits;
+	int no_lights; /*!< Light points per hit. */
+	int light_stride;
+
+	const float * normal[3]; /*!< Shading normal flipped towards the viewer. */
+	const float * direction[3]; /*!< Direction of the primary ray. */
+	const float * diffuse[3]; /*!< Diffuse color including the texture. */
+	const float * ambient_occlusion[3];
+	const float * light_direction[3];
+	const float * light_radiance[3]; /*!< LightSample::radiance. */
+
+	float ambient[3];
+	float specular[3];
+	float shininess;
+	float emitted[3]; /*!< Emission times the light scale. */
+	float light_weight; /*!< Light scale over the number of light points. */
+};
+
+/*! \struct TexelGrid
+\brief Converted texels of a texture as SimdKernels::sample_texels reads them.
+
+Rows of pitch texels start at 64 byte boundaries. The column at width and the row at height
+repeat the last column and the last row, so the right and the lower neighbour of every texel
+exist and bilinear lookups need no clamping of the second texel.
+*/
+struct TexelGrid
+{
+	const unsigned char * data;
+	bool halves; /*!< RGBA halves of TextureStorage::FLOAT16, RGBA floats otherwise. */
+	int width;
+	int height;
+	int pitch; /*!< Texels per row, a multiple of 8. */
+};
+
+/*! \struct SimdKernels
+\brief Table of kernels compiled for a single ISA level.
+
+Each ISA level has its own translation unit built with the matching /arch option from the
+same source in simdkernels.inl, the table is picked once at startup from cpuid. Packet kernels
+process PacketLanes in chunks of the vector width, the per-pixel kernels use 128-bit
+vectors on all levels and differ only by the instruction encoding. Vectors are passed as
+three floats and colors as RGB triples, i.e. arrays of Color3f.
+*/
+struct SimdKernels
+{
+	IsaLevel isa;
+
+	/* returns the subset of active rays of the packet which hit the box within <t_near, t_far>, the masks are RayMask */
+	unsigned long long ( *intersect_box )( const float lower[3], const float upper[3], const float origin[3], const PacketLanes & packet,
+		const unsigned long long mask );
+
+	/* Moller-Trumbore test of a single triangle against all active rays, closer hits update the packet, s = origin - p0,
+	q = s x e1 and q_e2 = q . e2 are shared by all rays of the packet and given by the caller */
+	void ( *intersect_triangle )( const float e1[3], const float e2[3], const float s[3], const float q[3], const float q_e2,
+		const int triangle_id, PacketLanes & packet, const unsigned long long mask );
+
+	/* clamps colors into <0, 1> and writes them as RGBA bytes with the alpha of 255 */
+	void ( *convert_colors )( const float * rgb, const int no_colors, unsigned char * rgba );
+
+	/* weighted sum of four BGR texels with 8 bits per channel, the result is scaled into <0, 1> */
+	void ( *blend_texels )( const unsigned char * const texels[4], const float weights[4], float rgb[3] );
+
+	/* a single pass of the edge-avoiding a-trous filter over rows <y0, y1), pixels are four floats, the taps are step pixels apart and
+	their B3-spline weights fall off with squared differences of colors and guides scaled by inv_sigmas[0..3] and inv_sigmas[4..7] */
+	void ( *filter_atrous )( const float * color, const float * guide, const int width, const int height, const int y0, const int y1,
+		const int step, const float * inv_sigmas, float * filtered );
+
+	/* colors of all hits of a batch of a single material, Phong, Lambert and Normal shaders vectorized over the hits */
+	void ( *shade_batch )( const ShadingBatch & batch, float * rgb );
+
+	/* bilinear lookups of the converted texels at no_lookups texture coordinates, the results are RGBA quadruples of floats */
+	void ( *sample_texels )( const TexelGrid & grid, const float * u, const float * v, const int no_lookups, float * rgba );
+};
+
+/* the highest ISA level supported by the CPU and the OS */
+IsaLevel detected_isa_level();
+
+/* level of the active kernels, on the first call it is detected or taken from the PG2_ISA environment variable (sse42, avx2 or avx512) */
+IsaLevel isa_level();
+
+/* switches the active kernels for A/B benchmarking, levels above the detected one are refused */
+bool set_isa_level( const IsaLevel level );
+
+const char * isa_name( const IsaLevel level );
+
+/* kernels of the active ISA level */
+const SimdKernels & simd_kernels();
+
+const SimdKernels & simd_kernels_sse42();
+const SimdKernels & simd_kernels_avx2();
+const SimdKernels & simd_kernels_avx512();
+
+#endif
@@ -0,0 +1,477 @@
+// Kernels shared by all ISA levels, included by simdkernels_*.cpp into an anonymous namespace which
+// defines the Simd wrapper of the target instruction set. Only plain data of simdkernels.h and
+// intrinsics are used, no function of another header is called from here:
+//   Float, Mask        vector of floats and the result of comparisons
+//   kWidth             number of lanes
+//   set1, load, store  broadcast, unaligned load and store of floats
+//   set1_int, load_int, store_int  the same for ints kept in float registers
+//   add, sub, mul, div, min, max, lt, gt, eq, select, bits and from_bits
+//   and_bits, or_bits, add_int, shift_left_int, shift_right_int  the same for ints kept in float registers
+//   int_to_float, round_to_int, truncate_to_int  conversions with the rounding to nearest or towards zero
+
+/* slab test of all active rays, operands of min and max are ordered so that NaNs are handled as by AABB::intersect */
+unsigned long long IntersectBox( const float lower[3], const float upper[3], const float origin[3], const PacketLanes & packet,
+	const unsigned long long mask )
+{
+	const Float lower_x = Simd::set1( lower[0] - origin[0] );
+	const Float lower_y = Simd::set1( lower[1] - origin[1] );
+	const Float lower_z = Simd::set1( lower[2] - origin[2] );
+	const Float upper_x = Simd::set1( upper[0] - origin[0] );
+	const Float upper_y = Simd::set1( upper[1] - origin[1] );
+	const Float upper_z = Simd::set1( upper[2] - origin[2] );
+	const Float t_near = Simd::set1( packet.t_near );
+	const unsigned int lanes = ( 1u << Simd::kWidth ) - 1;
+
+	unsigned long long result = 0;
+
+	for ( int i = 0; i < packet.no_rays; i += Simd::kWidth )
+	{
+		const unsigned int active = static_cast<unsigned int>( mask >> i ) & lanes;
+		if ( active == 0 ) continue;
+
+		Float t0 = t_near;
+		Float t1 = Simd::load( packet.t_far + i );
+
+		Float inv = Simd::load( packet.inv_x + i );
+		Float a = Simd::mul( lower_x, inv );
+		Float c = Simd::mul( upper_x, inv );
+		t0 = Simd::max( Simd::min( c, a ), t0 );
+		t1 = Simd::min( Simd::max( a, c ), t1 );
+
+		inv = Simd::load( packet.inv_y + i );
+		a = Simd::mul( lower_y, inv );
+		c = Simd::mul( upper_y, inv );
+		t0 = Simd::max( Simd::min( c, a ), t0 );
+		t1 = Simd::min( Simd::max( a, c ), t1 );
+
+		inv = Simd::load( packet.inv_z + i );
+		a = Simd::mul( lower_z, inv );
+		c = Simd::mul( upper_z, inv );
+		t0 = Simd::max( Simd::min( c, a ), t0 );
+		t1 = Simd::min( Simd::max( a, c ), t1 );
+
+		// t0 <= t1 is the negation of t0 > t1 for all but NaNs which fail both in the scalar code
+		const unsigned int hit = Simd::bits( Simd::lt( t0, t1 ) ) | Simd::bits( Simd::eq( t0, t1 ) );
+		result |= static_cast<unsigned long long>( hit & active ) << i;
+	}
+
+	return result;
+}
+
+/* the same operations in the same order as Bvh::IntersectTriangle so that packets and single rays find the same hits */
+void IntersectTriangle( const float e1[3], const float e2[3], const float s[3], const float q[3], const float q_e2, const int triangle_id,
+	PacketLanes & packet, const unsigned long long mask )
+{
+	// s, q and q_e2 are shared by all rays of the packet
+	const Float e1_x = Simd::set1( e1[0] ), e1_y = Simd::set1( e1[1] ), e1_z = Simd::set1( e1[2] );
+	const Float e2_x = Simd::set1( e2[0] ), e2_y = Simd::set1( e2[1] ), e2_z = Simd::set1( e2[2] );
+	const Float s_x = Simd::set1( s[0] ), s_y = Simd::set1( s[1] ), s_z = Simd::set1( s[2] );
+	const Float q_x = Simd::set1( q[0] ), q_y = Simd::set1( q[1] ), q_z = Simd::set1( q[2] );
+	const Float qe2 = Simd::set1( q_e2 );
+	const Float zero = Simd::set1( 0.0f );
+	const Float one = Simd::set1( 1.0f );
+	const Float t_near = Simd::set1( packet.t_near );
+	const Float id = Simd::set1_int( triangle_id );
+	const unsigned int lanes = ( 1u << Simd::kWidth ) - 1;
+
+	for ( int i = 0; i < packet.no_rays; i += Simd::kWidth )
+	{
+		const unsigned int active = static_cast<unsigned int>( mask >> i ) & lanes;
+		if ( active == 0 ) continue;
+
+		const Float d_x = Simd::load( packet.dir_x + i );
+		const Float d_y = Simd::load( packet.dir_y + i );
+		const Float d_z = Simd::load( packet.dir_z + i );
+
+		// p = d x e2
+		const Float p_x = Simd::sub( Simd::mul( d_y, e2_z ), Simd::mul( d_z, e2_y ) );
+		const Float p_y = Simd::sub( Simd::mul( d_z, e2_x ), Simd::mul( d_x, e2_z ) );
+		const Float p_z = Simd::sub( Simd::mul( d_x, e2_y ), Simd::mul( d_y, e2_x ) );
+
+		const Float det = Simd::add( Simd::add( Simd::mul( e1_x, p_x ), Simd::mul( e1_y, p_y ) ), Simd::mul( e1_z, p_z ) );
+		const Float inv_det = Simd::div( one, det );
+
+		const Float u = Simd::mul( Simd::add( Simd::add( Simd::mul( s_x, p_x ), Simd::mul( s_y, p_y ) ), Simd::mul( s_z, p_z ) ), inv_det );
+		const Float v = Simd::mul( Simd::add( Simd::add( Simd::mul( d_x, q_x ), Simd::mul( d_y, q_y ) ), Simd::mul( d_z, q_z ) ), inv_det );
+		const Float t = Simd::mul( qe2, inv_det );
+		const Float t_far = Simd::load( packet.t_far + i );
+
+		// rejections are collected as in the scalar code so that NaNs behave the same
+		const unsigned int rejected = Simd::bits( Simd::eq( det, zero ) ) | Simd::bits( Simd::lt( u, zero ) ) |
+			Simd::bits( Simd::gt( u, one ) ) | Simd::bits( Simd::lt( v, zero ) ) | Simd::bits( Simd::gt( Simd::add( u, v ), one ) );
+		const unsigned int accepted = active & ~rejected & Simd::bits( Simd::gt( t, t_near ) ) & Simd::bits( Simd::lt( t, t_far ) );
+
+		if ( accepted == 0 ) continue;
+
+		const Mask m = Simd::from_bits( accepted );
+		Simd::store( packet.t_far + i, Simd::select( m, t, t_far ) );
+		Simd::store( packet.u + i, Simd::select( m, u, Simd::load( packet.u + i ) ) );
+		Simd::store( packet.v + i, Simd::select( m, v, Simd::load( packet.v + i ) ) );
+		Simd::store_int( packet.triangle_id + i, Simd::select( m, id, Simd::load_int( packet.triangle_id + i ) ) );
+	}
+}
+
+void ConvertColors( const float * rgb, const int no_colors, unsigned char * rgba )
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 scale = _mm_set1_ps( 255.0f );
+
+	for ( int i = 0; i < no_colors; ++i )
+	{
+		// the alpha lane is one, i.e. 255 after scaling
+		__m128 c = _mm_setr_ps( rgb[i * 3], rgb[i * 3 + 1], rgb[i * 3 + 2], 1.0f );
+		c = _mm_min_ps( _mm_max_ps( c, zero ), one );
+
+		// truncation as the BYTE cast does
+		const __m128i c32 = _mm_cvttps_epi32( _mm_mul_ps( c, scale ) );
+		const __m128i c16 = _mm_packus_epi32( c32, c32 );
+		const int c8 = _mm_cvtsi128_si32( _mm_packus_epi16( c16, c16 ) );
+
+		memcpy( rgba + i * 4, &c8, 4 );
+	}
+}
+
+void BlendTexels( const unsigned char * const texels[4], const float weights[4], float rgb[3] )
+{
+	__m128 sum = _mm_setzero_ps();
+
+	for ( int i = 0; i < 4; ++i )
+	{
+		// BGR to RGB, only three bytes are read as the pixel may be the last one of the image
+		const __m128 texel = _mm_setr_ps( float( texels[i][2] ), float( texels[i][1] ), float( texels[i][0] ), 0.0f );
+		sum = _mm_add_ps( sum, _mm_mul_ps( texel, _mm_set1_ps( weights[i] ) ) );
+	}
+
+	sum = _mm_mul_ps( sum, _mm_set1_ps( 1.0f / 255.0f ) );
+
+	alignas( 16 ) float result[4];
+	_mm_store_ps( result, sum );
+
+	rgb[0] = result[0];
+	rgb[1] = result[1];
+	rgb[2] = result[2];
+}
+
+void FilterAtrous( const float * color, const float * guide, const int width, const int height, const int y0, const int y1,
+	const int step, const float * inv_sigmas, float * filtered )
+{
+	static const float kB3[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	const __m128 inv_sigma_color = _mm_loadu_ps( inv_sigmas );
+	const __m128 inv_sigma_guide = _mm_loadu_ps( inv_sigmas + 4 );
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps( 1.0f );
+	const __m128 eighth = _mm_set1_ps( 1.0f / 8.0f );
+
+	for ( int y = y0; y < y1; ++y )
+	{
+		for ( int x = 0; x < width; ++x )
+		{
+			const int p = ( x + y * width ) * 4;
+			const __m128 color_p = _mm_load_ps( color + p );
+			const __m128 guide_p = _mm_load_ps( guide + p );
+
+			__m128 sum = zero;
+			__m128 sum_weights = zero;
+
+			for ( int j = 0; j < 5; ++j )
+			{
+				const int qy = y + ( j - 2 ) * step;
+				if ( qy < 0 || qy >= height ) continue;
+
+				for ( int i = 0; i < 5; ++i )
+				{
+					const int qx = x + ( i - 2 ) * step;
+					if ( qx < 0 || qx >= width ) continue;
+
+					const int q = ( qx + qy * width ) * 4;
+					const __m128 color_q = _mm_load_ps( color + q );
+					const __m128 d_color = _mm_sub_ps( color_q, color_p );
+					const __m128 d_guide = _mm_sub_ps( _mm_load_ps( guide + q ), guide_p );
+
+					// all four lanes end up with the sum of the scaled squared differences
+					__m128 e = _mm_add_ps( _mm_mul_ps( _mm_mul_ps( d_color, d_color ), inv_sigma_color ),
+						_mm_mul_ps( _mm_mul_ps( d_guide, d_guide ), inv_sigma_guide ) );
+					e = _mm_add_ps( e, _mm_shuffle_ps( e, e, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+					e = _mm_add_ps( e, _mm_shuffle_ps( e, e, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+
+					// exp( -e ) approximated by ( 1 - e / 8 )^8 which reaches zero at e = 8
+					__m128 w = _mm_max_ps( _mm_sub_ps( one, _mm_mul_ps( e, eighth ) ), zero );
+					w = _mm_mul_ps( w, w );
+					w = _mm_mul_ps( w, w );
+					w = _mm_mul_ps( w, w );
+					w = _mm_mul_ps( w, _mm_set1_ps( kB3[i] * kB3[j] ) );
+
+					sum = _mm_add_ps( sum, _mm_mul_ps( color_q, w ) );
+					sum_weights = _mm_add_ps( sum_weights, w );
+				}
+			}
+
+			// the center tap has the full weight so the sum of weights is never zero
+			_mm_store_ps( filtered + p, _mm_div_ps( sum, sum_weights ) );
+		}
+	}
+}
+
+/* log2 of positive normalized numbers by the polynomial of logf of the Cephes library */
+Float Log2( const Float x )
+{
+	static const float kCoefficients[] = { 7.0376836292e-2f, -1.1514610310e-1f, 1.1676998740e-1f, -1.2420140846e-1f, 1.4249322787e-1f,
+		-1.6668057665e-1f, 2.0000714765e-1f, -2.4999993993e-1f, 3.3333331174e-1f };
+
+	const Float one = Simd::set1( 1.0f );
+
+	// x = m * 2^e with m within <sqrt( 1/2 ), sqrt( 2 ))
+	Float e = Simd::int_to_float( Simd::add_int( Simd::shift_right_int( x, 23 ), Simd::set1_int( -127 ) ) );
+	Float m = Simd::or_bits( Simd::and_bits( x, Simd::set1_int( 0x007fffff ) ), one );
+	const Mask above = Simd::gt( m, Simd::set1( 1.41421356f ) );
+	m = Simd::select( above, Simd::mul( m, Simd::set1( 0.5f ) ), m );
+	e = Simd::select( above, Simd::add( e, one ), e );
+
+	// log( 1 + f ) = f - f^2 / 2 + f^3 p( f )
+	const Float f = Simd::sub( m, one );
+	const Float f2 = Simd::mul( f, f );
+	Float p = Simd::set1( kCoefficients[0] );
+
+	for ( int i = 1; i < 9; ++i ) p = Simd::add( Simd::mul( p, f ), Simd::set1( kCoefficients[i] ) );
+
+	const Float log = Simd::add( f, Simd::sub( Simd::mul( Simd::mul( p, f ), f2 ), Simd::mul( f2, Simd::set1( 0.5f ) ) ) );
+
+	return Simd::add( Simd::mul( log, Simd::set1( 1.44269504f ) ), e );
+}
+
+/* 2^x by the polynomial of exp2f of the Cephes library, results are clamped to normalized numbers */
+Float Exp2( const Float x )
+{
+	static const float kCoefficients[] = { 1.535336188319500e-4f, 1.339887440266574e-3f, 9.618437357674640e-3f, 5.550332471162809e-2f,
+		2.402264791363012e-1f, 6.931472028550421e-1f };
+
+	// x = n + f with f within <-1/2, 1/2>
+	const Float clamped = Simd::min( Simd::max( x, Simd::set1( -126.0f ) ), Simd::set1( 127.0f ) );
+	const Float n = Simd::round_to_int( clamped );
+	const Float f = Simd::sub( clamped, Simd::int_to_float( n ) );
+	Float p = Simd::set1( kCoefficients[0] );
+
+	for ( int i = 1; i < 6; ++i ) p = Simd::add( Simd::mul( p, f ), Simd::set1( kCoefficients[i] ) );
+
+	p = Simd::add( Simd::mul( p, f ), Simd::set1( 1.0f ) );
+
+	return Simd::mul( p, Simd::shift_left_int( Simd::add_int( n, Simd::set1_int( 127 ) ), 23 ) );
+}
+
+/* x^s of x >= 0 within a few ulps of powf including its values at zero */
+Float Pow( const Float x, const float s )
+{
+	const Float power = Exp2( Simd::mul( Simd::set1( s ), Log2( Simd::max( x, Simd::set1( FLT_MIN ) ) ) ) );
+
+	return Simd::select( Simd::gt( x, Simd::set1( 0.0f ) ), power, Simd::set1( ( s == 0.0f ) ? 1.0f : 0.0f ) );
+}
+
+/* the same operations in the same order as CpuTracer::Shade except powf, which is replaced by Pow, lanes of skipped light points add nothing */
+void ShadeBatch( const ShadingBatch & batch, float * rgb )
+{
+	const Float zero = Simd::set1( 0.0f );
+	const Float light_weight = Simd::set1( batch.light_weight );
+	const Float ambient[3] = { Simd::set1( batch.ambient[0] ), Simd::set1( batch.ambient[1] ), Simd::set1( batch.ambient[2] ) };
+	const Float specular[3] = { Simd::set1( batch.specular[0] ), Simd::set1( batch.specular[1] ), Simd::set1( batch.specular[2] ) };
+	const Float emitted[3] = { Simd::set1( batch.emitted[0] ), Simd::set1( batch.emitted[1] ), Simd::set1( batch.emitted[2] ) };
+	const bool phong = batch.model == ShadingModel::PHONG;
+	// zero specular times a finite power adds nothing, the negation of Color3f::is_zero
+	const bool glossy = phong && ( batch.specular[0] != 0.0f || batch.specular[1] != 0.0f || batch.specular[2] != 0.0f );
+
+	for ( int i = 0; i < batch.no_hits; i += Simd::kWidth )
+	{
+		const int no_lanes = ( batch.no_hits - i < Simd::kWidth ) ? batch.no_hits - i : Simd::kWidth;
+		const unsigned int lanes = ( 1u << no_lanes ) - 1;
+
+		Float normal[3], ambient_occlusion[3], result[3];
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			normal[c] = Simd::load( batch.normal[c] + i );
+			ambient_occlusion[c] = Simd::load( batch.ambient_occlusion[c] + i );
+		}
+
+		if ( batch.model == ShadingModel::NORMAL )
+		{
+			for ( int c = 0; c < 3; ++c )
+			{
+				result[c] = Simd::add( Simd::mul( Simd::mul( normal[c], ambient_occlusion[c] ), Simd::set1( 0.5f ) ), emitted[c] );
+			}
+		}
+		else
+		{
+			Float view[3], diffuse[3], direct[3];
+
+			for ( int c = 0; c < 3; ++c )
+			{
+				view[c] = Simd::mul( Simd::set1( -1.0f ), Simd::load( batch.direction[c] + i ) );
+				diffuse[c] = Simd::load( batch.diffuse[c] + i );
+				direct[c] = zero;
+			}
+
+			for ( int j = 0; j < batch.no_lights; ++j )
+			{
+				const int l = j * batch.light_stride + i;
+				Float light[3], radiance[3];
+
+				for ( int c = 0; c < 3; ++c )
+				{
+					light[c] = Simd::load( batch.light_direction[c] + l );
+					radiance[c] = Simd::load( batch.light_radiance[c] + l );
+				}
+
+				const Float cos_theta = Simd::add( Simd::add( Simd::mul( light[0], normal[0] ), Simd::mul( light[1], normal[1] ) ),
+					Simd::mul( light[2], normal[2] ) );
+				const unsigned int black = Simd::bits( Simd::eq( radiance[0], zero ) ) & Simd::bits( Simd::eq( radiance[1], zero ) ) &
+					Simd::bits( Simd::eq( radiance[2], zero ) );
+				const unsigned int valid = Simd::bits( Simd::gt( cos_theta, zero ) ) & ~black & lanes;
+				if ( valid == 0 ) continue;
+
+				Float power = zero;
+
+				if ( glossy )
+				{
+					const Float two_cos_theta = Simd::mul( Simd::set1( 2.0f ), cos_theta );
+					Float cos_alpha = zero;
+
+					for ( int c = 0; c < 3; ++c )
+					{
+						const Float lr = Simd::sub( Simd::mul( two_cos_theta, normal[c] ), light[c] );
+						cos_alpha = ( c == 0 ) ? Simd::mul( view[c], lr ) : Simd::add( cos_alpha, Simd::mul( view[c], lr ) );
+					}
+
+					power = Pow( Simd::max( cos_alpha, zero ), batch.shininess );
+				}
+
+				const Mask mask = Simd::from_bits( valid );
+
+				for ( int c = 0; c < 3; ++c )
+				{
+					const Float term = ( phong ) ? Simd::add( Simd::mul( diffuse[c], cos_theta ), Simd::mul( specular[c], power ) ) :
+						Simd::mul( diffuse[c], cos_theta );
+					direct[c] = Simd::add( direct[c], Simd::select( mask, Simd::mul( term, radiance[c] ), zero ) );
+				}
+			}
+
+			for ( int c = 0; c < 3; ++c )
+			{
+				direct[c] = Simd::mul( direct[c], light_weight );
+				result[c] = Simd::add( Simd::mul( ( phong ) ? Simd::add( ambient[c], direct[c] ) : direct[c], ambient_occlusion[c] ), emitted[c] );
+			}
+		}
+
+		float r[Simd::kWidth], g[Simd::kWidth], b[Simd::kWidth];
+		Simd::store( r, result[0] );
+		Simd::store( g, result[1] );
+		Simd::store( b, result[2] );
+
+		for ( int k = 0; k < no_lanes; ++k )
+		{
+			rgb[( i + k ) * 3] = r[k];
+			rgb[( i + k ) * 3 + 1] = g[k];
+			rgb[( i + k ) * 3 + 2] = b[k];
+		}
+	}
+}
+
+/* four non-negative halves zero-extended to 32 bits as floats, the halves are either zero or normal so plain integer operations suffice */
+__m128 HalvesToFloats( const __m128i halves )
+{
+	const __m128i bits = _mm_add_epi32( _mm_slli_epi32( halves, 13 ), _mm_set1_epi32( ( 127 - 15 ) << 23 ) );
+
+	return _mm_castsi128_ps( _mm_andnot_si128( _mm_cmpeq_epi32( halves, _mm_setzero_si128() ), bits ) );
+}
+
+/* bilinear blend of the texel ( x0, y0 ) and its right and lower neighbours by 128-bit vectors */
+void BlendGridTexels( const TexelGrid & grid, const int x0, const int y0, const float weights[4], float * rgba )
+{
+	const size_t offset = ( size_t( y0 ) * grid.pitch + x0 ) * 4;
+	__m128 texels[4];
+
+	if ( grid.halves )
+	{
+		// a single load holds both texels of a row
+		const unsigned short * p = reinterpret_cast<const unsigned short *>( grid.data ) + offset;
+		const __m128i row0 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) );
+		const __m128i row1 = _mm_loadu_si128( reinterpret_cast<const __m128i *>( p + grid.pitch * 4 ) );
+		texels[0] = HalvesToFloats( _mm_cvtepu16_epi32( row0 ) );
+		texels[1] = HalvesToFloats( _mm_cvtepu16_epi32( _mm_srli_si128( row0, 8 ) ) );
+		texels[2] = HalvesToFloats( _mm_cvtepu16_epi32( row1 ) );
+		texels[3] = HalvesToFloats( _mm_cvtepu16_epi32( _mm_srli_si128( row1, 8 ) ) );
+	}
+	else
+	{
+		const float * p = reinterpret_cast<const float *>( grid.data ) + offset;
+		texels[0] = _mm_load_ps( p );
+		texels[1] = _mm_load_ps( p + 4 );
+		texels[2] = _mm_load_ps( p + grid.pitch * 4 );
+		texels[3] = _mm_load_ps( p + grid.pitch * 4 + 4 );
+	}
+
+	__m128 sum = _mm_mul_ps( texels[0], _mm_set1_ps( weights[0] ) );
+
+	for ( int j = 1; j < 4; ++j )
+	{
+		sum = _mm_add_ps( sum, _mm_mul_ps( texels[j], _mm_set1_ps( weights[j] ) ) );
+	}
+
+	_mm_storeu_ps( rgba, sum );
+}
+
+/* bilinear lookups of the same texels with the same weights as Texture::texel, positions and weights of full vectors of lookups are
+vectorized and each blend of four texels is done by 128-bit vectors, the remaining lookups are positioned by the same scalar operations */
+void SampleTexels( const TexelGrid & grid, const float * u, const float * v, const int no_lookups, float * rgba )
+{
+	const Float zero = Simd::set1( 0.0f );
+	const Float one = Simd::set1( 1.0f );
+	const Float width = Simd::set1( float( grid.width ) );
+	const Float height = Simd::set1( float( grid.height ) );
+	const Float last_x = Simd::set1( float( grid.width - 1 ) );
+	const Float last_y = Simd::set1( float( grid.height - 1 ) );
+	int i = 0;
+
+	for ( ; i + Simd::kWidth <= no_lookups; i += Simd::kWidth )
+	{
+		const Float x = Simd::mul( Simd::load( u + i ), width );
+		const Float y = Simd::mul( Simd::load( v + i ), height );
+
+		// clamping before the truncation gives the same texel as max( 0, min( width - 1, int( x ) ) )
+		const Float x0 = Simd::truncate_to_int( Simd::min( Simd::max( x, zero ), last_x ) );
+		const Float y0 = Simd::truncate_to_int( Simd::min( Simd::max( y, zero ), last_y ) );
+		const Float kx = Simd::sub( x, Simd::int_to_float( x0 ) );
+		const Float ky = Simd::sub( y, Simd::int_to_float( y0 ) );
+
+		int texel_x[Simd::kWidth], texel_y[Simd::kWidth];
+		float weights[4][Simd::kWidth];
+		Simd::store_int( texel_x, x0 );
+		Simd::store_int( texel_y, y0 );
+		Simd::store( weights[0], Simd::mul( Simd::sub( one, kx ), Simd::sub( one, ky ) ) );
+		Simd::store( weights[1], Simd::mul( kx, Simd::sub( one, ky ) ) );
+		Simd::store( weights[2], Simd::mul( Simd::sub( one, kx ), ky ) );
+		Simd::store( weights[3], Simd::mul( kx, ky ) );
+
+		for ( int k = 0; k < Simd::kWidth; ++k )
+		{
+			const float lane_weights[4] = { weights[0][k], weights[1][k], weights[2][k], weights[3][k] };
+			BlendGridTexels( grid, texel_x[k], texel_y[k], lane_weights, rgba + ( i + k ) * 4 );
+		}
+	}
+
+	for ( ; i < no_lookups; ++i )
+	{
+		const float x = u[i] * grid.width;
+		const float y = v[i] * grid.height;
+		// the clamping of the vector lanes, NaNs end up at zero
+		const float cx = ( x > 0.0f ) ? x : 0.0f;
+		const float cy = ( y > 0.0f ) ? y : 0.0f;
+		const int x0 = int( ( cx < float( grid.width - 1 ) ) ? cx : float( grid.width - 1 ) );
+		const int y0 = int( ( cy < float( grid.height - 1 ) ) ? cy : float( grid.height - 1 ) );
+		const float kx = x - x0;
+		const float ky = y - y0;
+		const float weights[4] = { ( 1 - kx ) * ( 1 - ky ), kx * ( 1 - ky ), ( 1 - kx ) * ky, kx * ky };
+
+		BlendGridTexels( grid, x0, y0, weights, rgba + i * 4 );
+	}
+}
@@ -0,0 +1,64 @@
+// built with /arch:AVX2, only the plain declarations of simdkernels.h and intrinsics are included, see there
+#include "simdkernels.h"
+#include <cfloat>
+#include <cstring>
+#include <immintrin.h>
+
+namespace
+{
+	struct Simd
+	{
+		static const int kWidth = 8;
+
+		typedef __m256 Float;
+		typedef __m256 Mask;
+
+		static Float set1( const float a ) { return _mm256_set1_ps( a ); }
+		static Float set1_int( const int a ) { return _mm256_castsi256_ps( _mm256_set1_epi32( a ) ); }
+		static Float load( const float * p ) { return _mm256_loadu_ps( p ); }
+		static Float load_int( const int * p ) { return _mm256_castsi256_ps( _mm256_loadu_si256( reinterpret_cast<const __m256i *>( p ) ) ); }
+		static void store( float * p, const Float a ) { _mm256_storeu_ps( p, a ); }
+		static void store_int( int * p, const Float a ) { _mm256_storeu_si256( reinterpret_cast<__m256i *>( p ), _mm256_castps_si256( a ) ); }
+
+		static Float add( const Float a, const Float b ) { return _mm256_add_ps( a, b ); }
+		static Float sub( const Float a, const Float b ) { return _mm256_sub_ps( a, b ); }
+		static Float mul( const Float a, const Float b ) { return _mm256_mul_ps( a, b ); }
+		static Float div( const Float a, const Float b ) { return _mm256_div_ps( a, b ); }
+		static Float min( const Float a, const Float b ) { return _mm256_min_ps( a, b ); }
+		static Float max( const Float a, const Float b ) { return _mm256_max_ps( a, b ); }
+
+		static Float and_bits( const Float a, const Float b ) { return _mm256_and_ps( a, b ); }
+		static Float or_bits( const Float a, const Float b ) { return _mm256_or_ps( a, b ); }
+		static Float add_int( const Float a, const Float b ) { return _mm256_castsi256_ps( _mm256_add_epi32( _mm256_castps_si256( a ), _mm256_castps_si256( b ) ) ); }
+		static Float shift_left_int( const Float a, const int n ) { return _mm256_castsi256_ps( _mm256_sll_epi32( _mm256_castps_si256( a ), _mm_cvtsi32_si128( n ) ) ); }
+		static Float shift_right_int( const Float a, const int n ) { return _mm256_castsi256_ps( _mm256_srl_epi32( _mm256_castps_si256( a ), _mm_cvtsi32_si128( n ) ) ); }
+		static Float int_to_float( const Float a ) { return _mm256_cvtepi32_ps( _mm256_castps_si256( a ) ); }
+		static Float round_to_int( const Float a ) { return _mm256_castsi256_ps( _mm256_cvtps_epi32( a ) ); }
+		static Float truncate_to_int( const Float a ) { return _mm256_castsi256_ps( _mm256_cvttps_epi32( a ) ); }
+
+		static Mask lt( const Float a, const Float b ) { return _mm256_cmp_ps( a, b, _CMP_LT_OQ ); }
+		static Mask gt( const Float a, const Float b ) { return _mm256_cmp_ps( a, b, _CMP_GT_OQ ); }
+		static Mask eq( const Float a, const Float b ) { return _mm256_cmp_ps( a, b, _CMP_EQ_OQ ); }
+		static Float select( const Mask m, const Float a, const Float b ) { return _mm256_blendv_ps( b, a, m ); }
+		static unsigned int bits( const Mask m ) { return static_cast<unsigned int>( _mm256_movemask_ps( m ) ); }
+
+		static Mask from_bits( const unsigned int bits )
+		{
+			const __m256i lanes = _mm256_setr_epi32( 1, 2, 4, 8, 16, 32, 64, 128 );
+			return _mm256_castsi256_ps( _mm256_cmpeq_epi32( _mm256_and_si256( _mm256_set1_epi32( bits ), lanes ), lanes ) );
+		}
+	};
+
+	typedef Simd::Float Float;
+	typedef Simd::Mask Mask;
+
+#include "simdkernels.inl"
+}
+
+const SimdKernels & simd_kernels_avx2()
+{
+	static const SimdKernels kernels = { IsaLevel::AVX2, IntersectBox, IntersectTriangle,
+		ConvertColors, BlendTexels, FilterAtrous, ShadeBatch, SampleTexels };
+
+	return kernels;
+}
@@ -0,0 +1,60 @@
+// built with /arch:AVX512, only the plain declarations of simdkernels.h and intrinsics are included, see there
+#include "simdkernels.h"
+#include <cfloat>
+#include <cstring>
+#include <immintrin.h>
+
+namespace
+{
+	struct Simd
+	{
+		static const int kWidth = 16;
+
+		typedef __m512 Float;
+		typedef __mmask16 Mask;
+
+		static Float set1( const float a ) { return _mm512_set1_ps( a ); }
+		static Float set1_int( const int a ) { return _mm512_castsi512_ps( _mm512_set1_epi32( a ) ); }
+		static Float load( const float * p ) { return _mm512_loadu_ps( p ); }
+		static Float load_int( const int * p ) { return _mm512_castsi512_ps( _mm512_loadu_si512( p ) ); }
+		static void store( float * p, const Float a ) { _mm512_storeu_ps( p, a ); }
+		static void store_int( int * p, const Float a ) { _mm512_storeu_si512( p, _mm512_castps_si512( a ) ); }
+
+		static Float add( const Float a, const Float b ) { return _mm512_add_ps( a, b ); }
+		static Float sub( const Float a, const Float b ) { return _mm512_sub_ps( a, b ); }
+		static Float mul( const Float a, const Float b ) { return _mm512_mul_ps( a, b ); }
+		static Float div( const Float a, const Float b ) { return _mm512_div_ps( a, b ); }
+		static Float min( const Float a, const Float b ) { return _mm512_min_ps( a, b ); }
+		static Float max( const Float a, const Float b ) { return _mm512_max_ps( a, b ); }
+
+		// bitwise operations on floats need AVX-512DQ, the integer ones are in AVX-512F
+		static Float and_bits( const Float a, const Float b ) { return _mm512_castsi512_ps( _mm512_and_si512( _mm512_castps_si512( a ), _mm512_castps_si512( b ) ) ); }
+		static Float or_bits( const Float a, const Float b ) { return _mm512_castsi512_ps( _mm512_or_si512( _mm512_castps_si512( a ), _mm512_castps_si512( b ) ) ); }
+		static Float add_int( const Float a, const Float b ) { return _mm512_castsi512_ps( _mm512_add_epi32( _mm512_castps_si512( a ), _mm512_castps_si512( b ) ) ); }
+		static Float shift_left_int( const Float a, const int n ) { return _mm512_castsi512_ps( _mm512_sll_epi32( _mm512_castps_si512( a ), _mm_cvtsi32_si128( n ) ) ); }
+		static Float shift_right_int( const Float a, const int n ) { return _mm512_castsi512_ps( _mm512_srl_epi32( _mm512_castps_si512( a ), _mm_cvtsi32_si128( n ) ) ); }
+		static Float int_to_float( const Float a ) { return _mm512_cvtepi32_ps( _mm512_castps_si512( a ) ); }
+		static Float round_to_int( const Float a ) { return _mm512_castsi512_ps( _mm512_cvtps_epi32( a ) ); }
+		static Float truncate_to_int( const Float a ) { return _mm512_castsi512_ps( _mm512_cvttps_epi32( a ) ); }
+
+		static Mask lt( const Float a, const Float b ) { return _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ ); }
+		static Mask gt( const Float a, const Float b ) { return _mm512_cmp_ps_mask( a, b, _CMP_GT_OQ ); }
+		static Mask eq( const Float a, const Float b ) { return _mm512_cmp_ps_mask( a, b, _CMP_EQ_OQ ); }
+		static Float select( const Mask m, const Float a, const Float b ) { return _mm512_mask_blend_ps( m, b, a ); }
+		static unsigned int bits( const Mask m ) { return static_cast<unsigned int>( m ); }
+		static Mask from_bits( const unsigned int bits ) { return static_cast<Mask>( bits ); }
+	};
+
+	typedef Simd::Float Float;
+	typedef Simd::Mask Mask;
+
+#include "simdkernels.inl"
+}
+
+const SimdKernels & simd_kernels_avx512()
+{
+	static const SimdKernels kernels = { IsaLevel::AVX512, IntersectBox, IntersectTriangle,
+		ConvertColors, BlendTexels, FilterAtrous, ShadeBatch, SampleTexels };
+
+	return kernels;
+}
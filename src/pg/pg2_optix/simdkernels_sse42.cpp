@@ -0,0 +1,64 @@
+// SSE4.2 needs no /arch on x64, the unit includes only the plain declarations of simdkernels.h and intrinsics as the other levels
+#include "simdkernels.h"
+#include <cfloat>
+#include <cstring>
+#include <nmmintrin.h>
+
+namespace
+{
+	struct Simd
+	{
+		static const int kWidth = 4;
+
+		typedef __m128 Float;
+		typedef __m128 Mask;
+
+		static Float set1( const float a ) { return _mm_set1_ps( a ); }
+		static Float set1_int( const int a ) { return _mm_castsi128_ps( _mm_set1_epi32( a ) ); }
+		static Float load( const float * p ) { return _mm_loadu_ps( p ); }
+		static Float load_int( const int * p ) { return _mm_castsi128_ps( _mm_loadu_si128( reinterpret_cast<const __m128i *>( p ) ) ); }
+		static void store( float * p, const Float a ) { _mm_storeu_ps( p, a ); }
+		static void store_int( int * p, const Float a ) { _mm_storeu_si128( reinterpret_cast<__m128i *>( p ), _mm_castps_si128( a ) ); }
+
+		static Float add( const Float a, const Float b ) { return _mm_add_ps( a, b ); }
+		static Float sub( const Float a, const Float b ) { return _mm_sub_ps( a, b ); }
+		static Float mul( const Float a, const Float b ) { return _mm_mul_ps( a, b ); }
+		static Float div( const Float a, const Float b ) { return _mm_div_ps( a, b ); }
+		static Float min( const Float a, const Float b ) { return _mm_min_ps( a, b ); }
+		static Float max( const Float a, const Float b ) { return _mm_max_ps( a, b ); }
+
+		static Float and_bits( const Float a, const Float b ) { return _mm_and_ps( a, b ); }
+		static Float or_bits( const Float a, const Float b ) { return _mm_or_ps( a, b ); }
+		static Float add_int( const Float a, const Float b ) { return _mm_castsi128_ps( _mm_add_epi32( _mm_castps_si128( a ), _mm_castps_si128( b ) ) ); }
+		static Float shift_left_int( const Float a, const int n ) { return _mm_castsi128_ps( _mm_sll_epi32( _mm_castps_si128( a ), _mm_cvtsi32_si128( n ) ) ); }
+		static Float shift_right_int( const Float a, const int n ) { return _mm_castsi128_ps( _mm_srl_epi32( _mm_castps_si128( a ), _mm_cvtsi32_si128( n ) ) ); }
+		static Float int_to_float( const Float a ) { return _mm_cvtepi32_ps( _mm_castps_si128( a ) ); }
+		static Float round_to_int( const Float a ) { return _mm_castsi128_ps( _mm_cvtps_epi32( a ) ); }
+		static Float truncate_to_int( const Float a ) { return _mm_castsi128_ps( _mm_cvttps_epi32( a ) ); }
+
+		static Mask lt( const Float a, const Float b ) { return _mm_cmplt_ps( a, b ); }
+		static Mask gt( const Float a, const Float b ) { return _mm_cmpgt_ps( a, b ); }
+		static Mask eq( const Float a, const Float b ) { return _mm_cmpeq_ps( a, b ); }
+		static Float select( const Mask m, const Float a, const Float b ) { return _mm_blendv_ps( b, a, m ); }
+		static unsigned int bits( const Mask m ) { return static_cast<unsigned int>( _mm_movemask_ps( m ) ); }
+
+		static Mask from_bits( const unsigned int bits )
+		{
+			const __m128i lanes = _mm_setr_epi32( 1, 2, 4, 8 );
+			return _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( _mm_set1_epi32( bits ), lanes ), lanes ) );
+		}
+	};
+
+	typedef Simd::Float Float;
+	typedef Simd::Mask Mask;
+
+#include "simdkernels.inl"
+}
+
+const SimdKernels & simd_kernels_sse42()
+{
+	static const SimdKernels kernels = { IsaLevel::SSE42, IntersectBox, IntersectTriangle,
+		ConvertColors, BlendTexels, FilterAtrous, ShadeBatch, SampleTexels };
+
+	return kernels;
+}
@@ -88,6 +88,30 @@ int SimpleGuiDX11::get_image(BYTE * buffer) {
 	return 0;
 }
 
+const Color3f * SimpleGuiDX11::frame_colors() const
+{
+	return nullptr;
+}
+
+void SimpleGuiDX11::PostProcess( BYTE * buffer )
+{
+}
+
+bool SimpleGuiDX11::post_process_changed()
+{
+	return false;
+}
+
+bool SimpleGuiDX11::post_process_ready() const
+{
+	return true;
+}
+
+bool SimpleGuiDX11::view_changed()
+{
+	return false;
+}
+
 
 template <class T> inline void update( T & oldsample, const T newsample, const int no_samples )
 {		
@@ -101,6 +125,8 @@ void SimpleGuiDX11::Producer()
 	const int no_subpixels = width_ * height_ * 4;
 	float * local_accumulator = new float[no_subpixels];
 	memset( local_accumulator, 0, no_subpixels * sizeof( float ) );	
+	BYTE * local_average = new BYTE[no_subpixels]; // the displayed image before PostProcess
+	memset( local_average, 0, no_subpixels * sizeof( BYTE ) );
 
 	float t = 0.0f; // time
 	auto t0 = std::chrono::high_resolution_clock::now();
@@ -109,6 +135,41 @@ void SimpleGuiDX11::Producer()
 	// refinenment loop
 	while ( !finish_request_.load( std::memory_order_acquire ) )
 	{
+		// any change of the view discards the accumulated frames
+		if ( view_changed() || !accumulate_ )
+		{
+			no_frames_.store( 0, std::memory_order_release );
+			accumulation_error_.store( 0.0f, std::memory_order_release );
+		}
+
+		const bool post_process_dirty = post_process_changed();
+		const int no_frames = no_frames_.load( std::memory_order_acquire );
+
+		// converged images are kept until the view changes, new settings of the post-processing are applied to the kept average,
+		// unless they need outputs the last frame did not render and one more frame is averaged in
+		if ( no_frames > 1 && ( ( max_frames_ > 0 && no_frames >= max_frames_ ) ||
+			accumulation_error_.load( std::memory_order_acquire ) < convergence_threshold_ ) && ( !post_process_dirty || post_process_ready() ) )
+		{
+			if ( post_process_dirty )
+			{
+				memcpy( local_data, local_average, no_subpixels * sizeof( BYTE ) );
+				PostProcess( local_data );
+
+				{
+					std::lock_guard<std::mutex> lock( tex_data_lock_ );
+					memcpy( tex_data_, local_data, no_subpixels * sizeof( BYTE ) );
+				}
+
+				repaint_request_.store( true, std::memory_order_release );
+			}
+			else
+			{
+				std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+			}
+
+			continue;
+		}
+
 		auto t1 = std::chrono::high_resolution_clock::now();
 		std::chrono::duration<float> dt = t1 - t0;
 		//printf( "# %d in %0.1f ms\n", frame, dt.count() * 1e+3 );
@@ -116,8 +177,55 @@ void SimpleGuiDX11::Producer()
 		t0 = t1;
 
 		get_image(local_data);
+		const Color3f * colors = frame_colors();
 		// compute rendering
 		frame++; // frame finished
+
+		// running average of frames, the spread of the new frame around the average estimates the variance of a single frame
+		double sum = 0.0;
+		int no_values = no_subpixels;
+
+		if ( colors != nullptr )
+		{
+			// linear colors are averaged and only the average is converted as the tracers convert a frame, averaged bytes would keep
+			// the clamping and truncation of every single frame, the spread is taken in 8-bit levels of the displayed range
+			no_values = width_ * height_ * 3;
+
+#pragma omp parallel for reduction( + : sum )
+			for ( int i = 0; i < width_ * height_; ++i )
+			{
+				const float sample[3] = { colors[i].r, colors[i].g, colors[i].b };
+				float * average = &local_accumulator[i * 4];
+
+				for ( int c = 0; c < 3; ++c )
+				{
+					if ( no_frames > 0 ) sum += sqr( 255.0f * ( clamp( sample[c], 0.0f, 1.0f ) - clamp( average[c], 0.0f, 1.0f ) ) );
+					update( average[c], sample[c], no_frames + 1 );
+					local_data[i * 4 + c] = BYTE( clamp( average[c], 0.0f, 1.0f ) * 255.0f );
+				}
+
+				local_data[i * 4 + 3] = 255;
+			}
+		}
+		else
+		{
+#pragma omp parallel for reduction( + : sum )
+			for ( int i = 0; i < no_subpixels; ++i )
+			{
+				const float sample = local_data[i];
+				if ( no_frames > 0 ) sum += sqr( sample - local_accumulator[i] );
+				update( local_accumulator[i], sample, no_frames + 1 );
+				local_data[i] = BYTE( local_accumulator[i] + 0.5f );
+			}
+		}
+
+		no_frames_.store( no_frames + 1, std::memory_order_release );
+		accumulation_error_.store( ( no_frames > 0 ) ? float( sqrt( sum / no_values / ( no_frames + 1 ) ) ) : FLT_MAX,
+			std::memory_order_release );
+
+		// local_data is overwritten by the next frame, so the filtered image never reaches the accumulator
+		memcpy( local_average, local_data, no_subpixels * sizeof( BYTE ) );
+		PostProcess( local_data );
 		
 		//if ( samples % 1000 == 0 )
 		{
@@ -141,6 +249,18 @@ void SimpleGuiDX11::Producer()
 
 	delete[] local_accumulator;
 	local_accumulator = nullptr;
+	delete[] local_average;
+	local_average = nullptr;
+}
+
+int SimpleGuiDX11::no_frames() const
+{
+	return no_frames_.load( std::memory_order_acquire );
+}
+
+float SimpleGuiDX11::accumulation_error() const
+{
+	return accumulation_error_.load( std::memory_order_acquire );
 }
 
 int SimpleGuiDX11::width() const
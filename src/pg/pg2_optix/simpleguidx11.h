@@ -28,14 +28,38 @@ protected:
 	virtual Color3f get_pixel( const int x, const int y, const float t = 0.0f );
 	virtual int get_image(BYTE * buffer);
 
+	/* linear colors of the frame of the last get_image, nullptr if only its bytes are known and the producer averages the bytes */
+	virtual const Color3f * frame_colors() const;
+
+	/* filters the displayed copy of the averaged image, frames are accumulated and their error is estimated before any filtering */
+	virtual void PostProcess( BYTE * buffer );
+
+	/* called by the producer before each frame, returns true if the settings of PostProcess changed since the last call */
+	virtual bool post_process_changed();
+
+	/* false while PostProcess needs outputs the last frame did not render, a converged image then gets one more frame */
+	virtual bool post_process_ready() const;
+
+	/* called by the producer before each frame, returns true if anything the image depends on changed since the last call */
+	virtual bool view_changed();
 
 	void Producer();
 
 	int width() const;
 	int height() const;
+
+	/* number of frames averaged into the displayed image, i.e. the sample index of the frame being rendered */
+	int no_frames() const;
+
+	/* estimated standard error of the averaged image in 8-bit levels */
+	float accumulation_error() const;
+
 	ImRect imageRect;
 
 	bool vsync_{ true };
+	bool accumulate_{ true }; // average frames while the view is static, otherwise every frame is the sample 0
+	int max_frames_{ 0 }; // refinement stops after this number of frames, zero means no limit
+	float convergence_threshold_{ 0.0f }; // refinement stops once accumulation_error drops below this, zero means never
 	float gamma_{ 2.4f };
 	float mouseSensitivity = { 0.5 };
 	int speed = { 5 };
@@ -61,4 +85,7 @@ private:
 	// https://stackoverflow.com/questions/44685403/do-i-need-stdatomicbool-or-is-pod-bool-good-enough	
 	std::atomic<bool> finish_request_{ false };	
 	std::atomic<bool> repaint_request_{ false };
+
+	std::atomic<int> no_frames_{ 0 };
+	std::atomic<float> accumulation_error_{ 0.0f };
 };
@@ -1,6 +1,26 @@
 #include "pch.h"
 #include "texture.h"
 #include "mymath.h"
+#include "simdkernels.h"
+
+namespace
+{
+	/* IEEE half of a non-negative float, values below the smallest normal half flush to zero and values above the largest half saturate */
+	unsigned short ToHalf( const float f )
+	{
+		if ( !( f >= 6.10351562e-5f ) ) return 0;
+		if ( f >= 65504.0f ) return 0x7bff;
+
+		unsigned int bits;
+		memcpy( &bits, &f, sizeof( bits ) );
+
+		// rebias the exponent and round the mantissa to the nearest even
+		bits -= ( 127 - 15 ) << 23;
+		bits += 0x0fff + ( ( bits >> 13 ) & 1 );
+
+		return static_cast<unsigned short>( min( bits >> 13, 0x7bffu ) );
+	}
+}
 
 Texture::Texture( const char * file_name )
 {
@@ -78,6 +98,14 @@ Texture::~Texture()
 
 Color3f Texture::texel( const float u, const float v, const bool linearize ) const
 {
+	if ( storage_ != TextureStorage::BYTES && linearize == linear_ )
+	{
+		alignas( 16 ) float rgba[4];
+		simd_kernels().sample_texels( grid(), &u, &v, 1, rgba );
+
+		return Color3f( rgba[0], rgba[1], rgba[2] );
+	}
+
 	//assert( ( u >= 0.0f && u <= 1.0f ) && ( v >= 0.0f && v <= 1.0f ) );
 	
 	// nearest neighbour
@@ -112,11 +140,11 @@ Color3f Texture::texel( const float u, const float v, const bool linearize ) con
 
 	if ( pixel_size_ < 12 )
 	{
-		Color3f texel = ( Color3f::make_from_bgr<BYTE>( p1 ) * ( 1 - kx ) * ( 1 - ky ) +
-			Color3f::make_from_bgr<BYTE>( p2 ) * kx * ( 1 - ky ) +
-			Color3f::make_from_bgr<BYTE>( p3 ) * ( 1 - kx ) * ky +
-			Color3f::make_from_bgr<BYTE>( p4 ) * kx * ky ) *
-			( 1.0f / 255.0f );
+		const BYTE * const texels[4] = { p1, p2, p3, p4 };
+		const float weights[4] = { ( 1 - kx ) * ( 1 - ky ), kx * ( 1 - ky ), ( 1 - kx ) * ky, kx * ky };
+		float rgb[3];
+		simd_kernels().blend_texels( texels, weights, rgb );
+		Color3f texel( rgb[0], rgb[1], rgb[2] );
 		if ( linearize )
 			return texel.linear();
 		else
@@ -131,6 +159,86 @@ Color3f Texture::texel( const float u, const float v, const bool linearize ) con
 	}
 }
 
+void Texture::texels( const float * u, const float * v, const int no_lookups, const bool linearize, Color3f * colors ) const
+{
+	if ( storage_ == TextureStorage::BYTES || linearize != linear_ )
+	{
+		for ( int i = 0; i < no_lookups; ++i )
+		{
+			colors[i] = texel( u[i], v[i], linearize );
+		}
+
+		return;
+	}
+
+	const int kChunk = 64;
+	alignas( 16 ) float rgba[kChunk * 4];
+	const TexelGrid texel_grid = grid();
+	const SimdKernels & kernels = simd_kernels();
+
+	for ( int first = 0; first < no_lookups; first += kChunk )
+	{
+		const int n = min( kChunk, no_lookups - first );
+		kernels.sample_texels( texel_grid, u + first, v + first, n, rgba );
+
+		for ( int i = 0; i < n; ++i )
+		{
+			colors[first + i] = Color3f( rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2] );
+		}
+	}
+}
+
+void Texture::Convert( const TextureStorage storage, const bool linearize )
+{
+	grid_.clear();
+	grid_.shrink_to_fit();
+	storage_ = ( data_ != nullptr ) ? storage : TextureStorage::BYTES;
+	linear_ = linearize;
+	pitch_ = 0;
+
+	if ( storage_ == TextureStorage::BYTES ) return;
+
+	// one more column and row repeating the last ones, rows of 64 bytes multiples
+	pitch_ = ( width_ + 1 + 7 ) / 8 * 8;
+	const size_t texel_size = ( storage_ == TextureStorage::FLOAT16 ) ? 4 * sizeof( unsigned short ) : 4 * sizeof( float );
+	grid_.assign( size_t( pitch_ ) * ( height_ + 1 ) * texel_size, 0 );
+
+	for ( int y = 0; y <= height_; ++y )
+	{
+		for ( int x = 0; x <= width_; ++x )
+		{
+			BYTE * p = &data_[min( y, height_ - 1 ) * scan_width_ + min( x, width_ - 1 ) * pixel_size_];
+
+			// the same colors texel blends, float images are never linearized
+			Color3f c = ( pixel_size_ < 12 ) ? Color3f::make_from_bgr<BYTE>( p ) * ( 1.0f / 255.0f ) : Color3f::make_from_bgr<float>( p );
+			if ( linearize && pixel_size_ < 12 ) c = c.linear();
+
+			const float rgba[4] = { c.r, c.g, c.b, 1.0f };
+			const size_t offset = ( size_t( y ) * pitch_ + x ) * texel_size;
+
+			if ( storage_ == TextureStorage::FLOAT16 )
+			{
+				unsigned short * halves = reinterpret_cast<unsigned short *>( &grid_[offset] );
+				for ( int i = 0; i < 4; ++i ) halves[i] = ToHalf( rgba[i] );
+			}
+			else
+			{
+				memcpy( &grid_[offset], rgba, sizeof( rgba ) );
+			}
+		}
+	}
+}
+
+TextureStorage Texture::storage() const
+{
+	return storage_;
+}
+
+TexelGrid Texture::grid() const
+{
+	return TexelGrid{ grid_.data(), storage_ == TextureStorage::FLOAT16, width_, height_, pitch_ };
+}
+
 int Texture::width() const
 {
 	return width_;
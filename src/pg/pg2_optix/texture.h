@@ -3,10 +3,25 @@
 
 #include "freeimage.h"
 #include "structs.h"
+#include "alignedallocator.h"
+#include "simdkernels.h"
+
+/*! \enum TextureStorage
+\brief Texels the lookups of a texture read.
+*/
+enum class TextureStorage : char
+{
+	BYTES, /*!< The original bytes, each lookup is linearized. */
+	FLOAT16, /*!< RGBA halves converted once at load time, 8 bytes per texel. */
+	FLOAT32 /*!< RGBA floats converted once at load time, 16 bytes per texel. */
+};
 
 /*! \class Texture
 \brief Single texture stored in original byte format (srgb is expected).
 
+The bytes may be converted once into a grid of linear float texels, see Convert, lookups
+then skip the per-lookup linearization and filter by the vectorized kernel.
+
 \author Tom Fabin
 \version 0.95
 \date 2012-2018
@@ -20,6 +35,14 @@ public:
 	/* returns interpolated texel in linear format */
 	Color3f texel( const float u, const float v, const bool linearize ) const;
 
+	/* interpolated texels at no_lookups coordinates, converted texels are filtered by SimdKernels::sample_texels several lookups at once */
+	void texels( const float * u, const float * v, const int no_lookups, const bool linearize, Color3f * colors ) const;
+
+	/* converts the bytes into the padded grid of the storage, lookups with the same linearize read the grid and the others still the bytes */
+	void Convert( const TextureStorage storage, const bool linearize );
+
+	TextureStorage storage() const;
+
 	int width() const;
 	int height() const;
 	BYTE * getData();
@@ -32,6 +55,14 @@ private:
 
 	BYTE * data_{ nullptr }; // image data in BGR format
 
+	TextureStorage storage_{ TextureStorage::BYTES };
+	bool linear_{ false }; // the grid holds linearized colors
+	int pitch_{ 0 }; // texels per row of the grid
+	std::vector<BYTE, AlignedAllocator<BYTE, 64>> grid_; // converted texels, empty for BYTES
+
+	/* the grid as the kernels read it */
+	TexelGrid grid() const;
+
 	Texture( const Texture & ) = delete;
 	Texture & operator=( const Texture & ) = delete;
 };
@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "tilescheduler.h"
+#include "mymath.h"
+#include <algorithm>
+#include <omp.h>
+
+void TileScheduler::Run( const int no_tiles_x, const int no_tiles_y, const std::function<void( const int, const int )> & render_tile )
+{
+	Order( no_tiles_x, no_tiles_y );
+
+	const int no_threads = omp_get_max_threads();
+	const int no_tiles = static_cast<int>( tiles_.size() );
+
+	if ( static_cast<int>( workers_.size() ) != no_threads )
+	{
+		workers_.clear();
+
+		for ( int t = 0; t < no_threads; ++t )
+		{
+			workers_.emplace_back( new Worker() );
+		}
+	}
+
+	// contiguous runs of the curve, one per thread
+	for ( int t = 0; t < no_threads; ++t )
+	{
+		workers_[t]->tiles.assign( tiles_.begin() + ( long long )no_tiles * t / no_threads,
+			tiles_.begin() + ( long long )no_tiles * ( t + 1 ) / no_threads );
+	}
+
+	stats_.resize( no_threads );
+	std::fill( stats_.begin(), stats_.end(), ThreadStats() );
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+#pragma omp parallel num_threads( no_threads )
+	{
+		const int thread = omp_get_thread_num();
+		ThreadStats & stats = stats_[thread];
+		int tile;
+
+		for ( ;; )
+		{
+			if ( !Pop( thread, tile ) )
+			{
+				if ( !Steal( thread, tile ) ) break; // no work is spawned during the run so everything is done
+
+				++stats.no_steals;
+			}
+
+			auto t1 = std::chrono::high_resolution_clock::now();
+			render_tile( tile % no_tiles_x, tile / no_tiles_x );
+			stats.busy_time += std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t1 ).count();
+			++stats.no_tiles;
+		}
+	}
+
+	const double wall_time = std::chrono::duration<double>( std::chrono::high_resolution_clock::now() - t0 ).count();
+
+	for ( ThreadStats & stats : stats_ )
+	{
+		stats.idle_time = max( 0.0, wall_time - stats.busy_time );
+	}
+}
+
+const std::vector<TileScheduler::ThreadStats> & TileScheduler::stats() const
+{
+	return stats_;
+}
+
+void TileScheduler::Order( const int no_tiles_x, const int no_tiles_y )
+{
+	const int no_tiles = no_tiles_x * no_tiles_y;
+
+	// the curve covers the smallest power of two square grid containing all tiles
+	unsigned int n = 1;
+	while ( n < static_cast<unsigned int>( max( no_tiles_x, no_tiles_y ) ) ) n *= 2;
+
+	std::vector<std::pair<unsigned int, int>> keys( no_tiles );
+
+	for ( int i = 0; i < no_tiles; ++i )
+	{
+		const unsigned int x = i % no_tiles_x;
+		const unsigned int y = i / no_tiles_x;
+
+		switch ( order )
+		{
+		case TileOrder::MORTON: keys[i] = std::make_pair( Morton2( x, y ), i ); break;
+		case TileOrder::HILBERT: keys[i] = std::make_pair( Hilbert2( n, x, y ), i ); break;
+		default: keys[i] = std::make_pair( static_cast<unsigned int>( i ), i ); break;
+		}
+	}
+
+	std::sort( keys.begin(), keys.end() );
+
+	tiles_.resize( no_tiles );
+
+	for ( int i = 0; i < no_tiles; ++i )
+	{
+		tiles_[i] = keys[i].second;
+	}
+}
+
+bool TileScheduler::Pop( const int thread, int & tile )
+{
+	Worker & worker = *workers_[thread];
+	std::lock_guard<std::mutex> lock( worker.lock );
+
+	if ( worker.tiles.empty() ) return false;
+
+	tile = worker.tiles.front();
+	worker.tiles.pop_front();
+
+	return true;
+}
+
+bool TileScheduler::Steal( const int thread, int & tile )
+{
+	const int no_threads = static_cast<int>( workers_.size() );
+
+	for ( int k = 1; k < no_threads; ++k )
+	{
+		Worker & victim = *workers_[( thread + k ) % no_threads];
+		std::deque<int> stolen;
+
+		{
+			std::lock_guard<std::mutex> lock( victim.lock );
+
+			if ( victim.tiles.empty() ) continue;
+
+			// the back half is the farthest from where the victim currently renders
+			const size_t half = ( victim.tiles.size() + 1 ) / 2;
+			stolen.assign( victim.tiles.end() - half, victim.tiles.end() );
+			victim.tiles.erase( victim.tiles.end() - half, victim.tiles.end() );
+		}
+
+		tile = stolen.front();
+		stolen.pop_front();
+
+		if ( !stolen.empty() )
+		{
+			Worker & worker = *workers_[thread];
+			std::lock_guard<std::mutex> lock( worker.lock );
+			worker.tiles.insert( worker.tiles.end(), stolen.begin(), stolen.end() );
+		}
+
+		return true;
+	}
+
+	return false;
+}
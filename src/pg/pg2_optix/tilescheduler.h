@@ -0,0 +1,53 @@
+#ifndef TILE_SCHEDULER_H_
+#define TILE_SCHEDULER_H_
+
+#include <deque>
+#include <functional>
+#include <memory>
+
+/* order in which tiles of the frame are visited */
+enum class TileOrder : char { SCANLINE = 0, MORTON = 1, HILBERT = 2 };
+
+/*! \class TileScheduler
+\brief Distributes tiles of the frame among threads with work stealing.
+
+Tiles are ordered along a space filling curve and split into contiguous runs, one per thread.
+Each thread takes tiles from the front of its own deque, i.e. it walks along the curve, and once
+it runs out of work it steals the back half of the deque of another thread.
+*/
+class TileScheduler
+{
+public:
+	/* per-thread statistics of the last run */
+	struct ThreadStats
+	{
+		double busy_time{ 0.0 }; /*!< Time spent rendering tiles in seconds. */
+		double idle_time{ 0.0 }; /*!< Time spent looking for work and waiting for other threads in seconds. */
+		int no_tiles{ 0 }; /*!< Number of rendered tiles. */
+		int no_steals{ 0 }; /*!< Number of successful steals from other threads. */
+	};
+
+	/* calls render_tile( tile_x, tile_y ) for every tile of the grid and returns once all of them are done */
+	void Run( const int no_tiles_x, const int no_tiles_y, const std::function<void( const int, const int )> & render_tile );
+
+	const std::vector<ThreadStats> & stats() const;
+
+	TileOrder order{ TileOrder::HILBERT };
+
+private:
+	struct Worker
+	{
+		std::mutex lock;
+		std::deque<int> tiles;
+	};
+
+	void Order( const int no_tiles_x, const int no_tiles_y );
+	bool Pop( const int thread, int & tile );
+	bool Steal( const int thread, int & tile );
+
+	std::vector<int> tiles_; // tile indices x + y * no_tiles_x in the visiting order
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::vector<ThreadStats> stats_;
+};
+
+#endif
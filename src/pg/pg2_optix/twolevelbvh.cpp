@@ -0,0 +1,273 @@
+#include "pch.h"
+#include "twolevelbvh.h"
+#include "utils.h"
+#include <algorithm>
+
+void TwoLevelBvh::Build( const std::vector<Surface *> & surfaces, const BvhSettings & settings )
+{
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	meshes_.clear();
+	instances_.clear();
+	instance_indices_.clear();
+
+	BvhSettings mesh_settings = settings;
+	mesh_settings.verbose = false;
+
+	int first_triangle = 0;
+
+	for ( auto surface : surfaces )
+	{
+		// the same order of triangles as SceneGeometry::Build
+		std::vector<Surface *> mesh_surfaces( 1, surface );
+		std::unique_ptr<Mesh> mesh( new Mesh() );
+		mesh->geometry.Build( mesh_surfaces );
+		mesh->bvh.Build( mesh->geometry, mesh_settings );
+		mesh->bounds = mesh->geometry.bounds();
+
+		Instance instance;
+		instance.mesh = static_cast<int>( meshes_.size() );
+		instance.first_triangle = first_triangle;
+		instance.bounds = mesh->bounds;
+
+		instance_indices_[surface] = static_cast<int>( instances_.size() );
+		instances_.push_back( instance );
+		meshes_.push_back( std::move( mesh ) );
+
+		first_triangle += surface->no_triangles();
+	}
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	build_time_ = std::chrono::duration<double>( t1 - t0 ).count();
+
+	dirty_ = true;
+	Update();
+
+	if ( settings.verbose )
+	{
+		printf( "Two-level BVH (%d meshes, %d triangles, %d top-level nodes) built in %s, top level in %s.\n", no_meshes(),
+			first_triangle, static_cast<int>( top_nodes_.size() ), TimeToString( build_time_ ).c_str(),
+			TimeToString( top_level_build_time_ ).c_str() );
+	}
+}
+
+void TwoLevelBvh::SetTransform( Surface * surface, const Matrix3x3 & rotation, const Vector3 & translation )
+{
+	auto it = instance_indices_.find( surface );
+	if ( it == instance_indices_.end() ) return;
+
+	Instance & instance = instances_[it->second];
+	instance.rotation = rotation;
+	instance.inv_rotation = rotation.Transpose();
+	instance.translation = translation;
+	dirty_ = true;
+
+	// bounds of the transformed corners of the mesh box
+	const AABB & mesh_bounds = meshes_[instance.mesh]->bounds;
+	instance.bounds = AABB();
+
+	if ( mesh_bounds.is_empty() ) return;
+
+	for ( int i = 0; i < 8; ++i )
+	{
+		const Vector3 corner( ( i & 1 ) ? mesh_bounds.upper.x : mesh_bounds.lower.x,
+			( i & 2 ) ? mesh_bounds.upper.y : mesh_bounds.lower.y,
+			( i & 4 ) ? mesh_bounds.upper.z : mesh_bounds.lower.z );
+		instance.bounds.merge( rotation * corner + translation );
+	}
+}
+
+void TwoLevelBvh::Update()
+{
+	if ( !dirty_ ) return;
+
+	auto t0 = std::chrono::high_resolution_clock::now();
+
+	top_nodes_.clear();
+	top_indices_.resize( instances_.size() );
+
+	for ( int i = 0; i < no_instances(); ++i )
+	{
+		top_indices_[i] = i;
+	}
+
+	if ( !instances_.empty() )
+	{
+		top_nodes_.reserve( 2 * instances_.size() );
+		BuildTopLevelNode( 0, no_instances() );
+	}
+
+	auto t1 = std::chrono::high_resolution_clock::now();
+	top_level_build_time_ = std::chrono::duration<double>( t1 - t0 ).count();
+
+	dirty_ = false;
+}
+
+int TwoLevelBvh::BuildTopLevelNode( const int first, const int count )
+{
+	const int node_index = static_cast<int>( top_nodes_.size() );
+	top_nodes_.push_back( BvhNode() );
+
+	AABB bounds;
+	AABB centroid_bounds;
+
+	for ( int i = first; i < first + count; ++i )
+	{
+		bounds.merge( instances_[top_indices_[i]].bounds );
+		centroid_bounds.merge( instances_[top_indices_[i]].bounds.centroid() );
+	}
+
+	top_nodes_[node_index].bounds = bounds;
+
+	if ( count <= kMaxLeafSize )
+	{
+		top_nodes_[node_index].offset = first;
+		top_nodes_[node_index].count = static_cast<unsigned short>( count );
+
+		return node_index;
+	}
+
+	// there are only a few instances, a median split is good enough and keeps the per-frame rebuild cheap
+	const int axis = centroid_bounds.longest_axis();
+	const int mid = count / 2;
+
+	std::nth_element( top_indices_.begin() + first, top_indices_.begin() + first + mid, top_indices_.begin() + first + count,
+		[&]( const int a, const int b )
+	{
+		return instances_[a].bounds.centroid().data[axis] < instances_[b].bounds.centroid().data[axis];
+	} );
+
+	BuildTopLevelNode( first, mid );
+	const int right_child = BuildTopLevelNode( first + mid, count - mid );
+
+	top_nodes_[node_index].offset = right_child;
+	top_nodes_[node_index].axis = static_cast<unsigned short>( axis );
+
+	return node_index;
+}
+
+Ray TwoLevelBvh::object_ray( const Instance & instance, const Ray & ray ) const
+{
+	return Ray( instance.inv_rotation * ( ray.origin - instance.translation ), instance.inv_rotation * ray.direction,
+		ray.t_near, ray.t_far );
+}
+
+bool TwoLevelBvh::Intersect( Ray & ray, RayHit & hit ) const
+{
+	if ( top_nodes_.empty() ) return false;
+
+	const Vector3 inv_direction = ray.inv_direction();
+
+	int stack[Bvh::kStackSize];
+	int top = 0;
+	stack[top++] = 0;
+
+	bool found = false;
+
+	while ( top > 0 )
+	{
+		const int node_index = stack[--top];
+		const BvhNode & node = top_nodes_[node_index];
+
+		float t0 = ray.t_near;
+		float t1 = ray.t_far;
+
+		if ( !node.bounds.intersect( ray.origin, inv_direction, t0, t1 ) ) continue;
+
+		if ( node.is_leaf() )
+		{
+			for ( int k = 0; k < node.count; ++k )
+			{
+				const Instance & instance = instances_[top_indices_[node.offset + k]];
+				Ray local_ray = object_ray( instance, ray );
+				RayHit local_hit;
+
+				if ( meshes_[instance.mesh]->bvh.Intersect( local_ray, local_hit ) )
+				{
+					// rigid transforms keep distances so t_far is valid in both spaces
+					ray.t_far = local_ray.t_far;
+					hit.triangle_id = instance.first_triangle + local_hit.triangle_id;
+					hit.u = local_hit.u;
+					hit.v = local_hit.v;
+					found = true;
+				}
+			}
+		}
+		else
+		{
+			int near_child = node_index + 1;
+			int far_child = node.offset;
+
+			if ( ray.direction.data[node.axis] < 0.0f ) utils::swap( near_child, far_child );
+
+			stack[top++] = far_child;
+			stack[top++] = near_child;
+		}
+	}
+
+	return found;
+}
+
+bool TwoLevelBvh::Occluded( const Ray & ray ) const
+{
+	if ( top_nodes_.empty() ) return false;
+
+	const Vector3 inv_direction = ray.inv_direction();
+
+	int stack[Bvh::kStackSize];
+	int top = 0;
+	stack[top++] = 0;
+
+	while ( top > 0 )
+	{
+		const int node_index = stack[--top];
+		const BvhNode & node = top_nodes_[node_index];
+
+		float t0 = ray.t_near;
+		float t1 = ray.t_far;
+
+		if ( !node.bounds.intersect( ray.origin, inv_direction, t0, t1 ) ) continue;
+
+		if ( node.is_leaf() )
+		{
+			for ( int k = 0; k < node.count; ++k )
+			{
+				const Instance & instance = instances_[top_indices_[node.offset + k]];
+
+				if ( meshes_[instance.mesh]->bvh.Occluded( object_ray( instance, ray ) ) ) return true;
+			}
+		}
+		else
+		{
+			stack[top++] = node.offset;
+			stack[top++] = node_index + 1;
+		}
+	}
+
+	return false;
+}
+
+int TwoLevelBvh::no_meshes() const
+{
+	return static_cast<int>( meshes_.size() );
+}
+
+int TwoLevelBvh::no_instances() const
+{
+	return static_cast<int>( instances_.size() );
+}
+
+AABB TwoLevelBvh::bounds() const
+{
+	return ( top_nodes_.empty() ) ? AABB() : top_nodes_[0].bounds;
+}
+
+double TwoLevelBvh::build_time() const
+{
+	return build_time_;
+}
+
+double TwoLevelBvh::top_level_build_time() const
+{
+	return top_level_build_time_;
+}
@@ -0,0 +1,82 @@
+#ifndef TWO_LEVEL_BVH_H_
+#define TWO_LEVEL_BVH_H_
+
+#include "bvh.h"
+#include "matrix3x3.h"
+
+/*! \class TwoLevelBvh
+\brief Bottom-level BVHs of meshes in object space and a top-level BVH over their instances.
+
+Each surface becomes a mesh with its own BVH built once from the loaded (untransformed)
+positions. Instances place meshes into the world by a rigid transform, moving a surface only
+changes its instance and the small top-level tree over instance bounds is rebuilt from scratch
+on the next Update. Triangle ids of hits refer to the flattened SceneGeometry built from the
+same surfaces, i.e. the first triangle of the instance plus the local id within the mesh.
+*/
+class TwoLevelBvh
+{
+public:
+	static const int kMaxLeafSize = 2; /*!< Maximal number of instances in a top-level leaf. */
+
+	/* builds one bottom-level BVH per surface and the top-level BVH over their identity instances */
+	void Build( const std::vector<Surface *> & surfaces, const BvhSettings & settings = BvhSettings() );
+
+	/* places the instance of the surface, the same transform as SceneGeometry::SetTransform, the rotation must be orthonormal */
+	void SetTransform( Surface * surface, const Matrix3x3 & rotation, const Vector3 & translation );
+
+	/* rebuilds the top-level BVH if any instance has moved */
+	void Update();
+
+	/* the same semantics as Bvh::Intersect */
+	bool Intersect( Ray & ray, RayHit & hit ) const;
+
+	/* the same semantics as Bvh::Occluded */
+	bool Occluded( const Ray & ray ) const;
+
+	int no_meshes() const;
+	int no_instances() const;
+	AABB bounds() const;
+
+	/* wall time of building all bottom-level BVHs in seconds */
+	double build_time() const;
+
+	/* wall time of the last top-level rebuild in seconds */
+	double top_level_build_time() const;
+
+private:
+	/* geometry of a single surface in object space with its own BVH */
+	struct Mesh
+	{
+		SceneGeometry geometry;
+		Bvh bvh;
+		AABB bounds;
+	};
+
+	struct Instance
+	{
+		int mesh{ 0 };
+		int first_triangle{ 0 }; // offset of local triangle ids in the flattened geometry
+		Matrix3x3 rotation; // object to world
+		Matrix3x3 inv_rotation; // world to object
+		Vector3 translation;
+		AABB bounds; // world bounds of the transformed mesh box
+	};
+
+	int BuildTopLevelNode( const int first, const int count );
+
+	/* the ray transformed into the object space of the instance, the parametrization of t is kept */
+	Ray object_ray( const Instance & instance, const Ray & ray ) const;
+
+	std::vector<std::unique_ptr<Mesh>> meshes_; // Bvh keeps a pointer to its geometry, meshes must not move
+	std::vector<Instance> instances_;
+	std::map<Surface *, int> instance_indices_;
+
+	std::vector<BvhNode> top_nodes_; // the same layout as Bvh, leaves reference ranges of top_indices_
+	std::vector<int> top_indices_;
+	bool dirty_{ false };
+
+	double build_time_{ 0.0 };
+	double top_level_build_time_{ 0.0 };
+};
+
+#endif
@@ -1,14 +1,6 @@
 #include "pch.h"
 #include "utils.h"
 
-using std::mt19937;
-using std::uniform_real_distribution;
-
-typedef mt19937                                     Engine;
-typedef uniform_real_distribution<float>            Distribution;
-
-auto uniform_generator = std::bind( Distribution( 0.0f, 1.0f ), Engine( 1 ) );
-
 RTresult createAndSetMaterialColorVariable(RTmaterial rtMaterial, const char* label, Color3f color) {
 	RTresult result;
 	RTvariable materialColor;
@@ -26,26 +18,6 @@ RTresult createAndSetMaterialScalarVariable(RTmaterial rtMaterial, const char* l
 	return result;
 }
 
-float Random( const float range_min, const float range_max )
-{
-	float ksi;
-
-//#pragma omp critical ( random ) 
-	{
-		//ksi = static_cast<float>( rand() ) / ( RAND_MAX + 1 );		
-		ksi = static_cast<float>( uniform_generator() );
-
-		/*static float randoms[] = { 0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f, 0.7f, 0.8f, 0.9f };
-		static int next = 0;
-		ksi = randoms[next];
-#pragma omp atomic
-		next++;
-		if ( next > 10 ) next = 0;*/
-	}
-
-	return ksi * ( range_max - range_min ) + range_min;
-}
-
 long long GetFileSize64( const char * file_name )
 {
 	FILE * file = fopen( file_name, "rb" );
@@ -52,14 +52,6 @@ namespace utils
 	}
 }
 
-/*! \fn float Random( const float range_min, const float range_max )
-\brief Vrt pseudonhodn slo s normlnm rozdlenm v intervalu <range_min, range_max).
-\param range_min Doln mez intervalu.
-\param range_max Horn mez intervalu.
-\return Pseudonhodn slo.
-*/
-float Random( const float range_min = 0.0f, const float range_max = 1.0f );
-
 /*! \fn long long GetFileSize64( const char * file_name )
 \brief Vrt velikost souboru v bytech.
 \param file_name pln cesta k souboru
@@ -0,0 +1,586 @@
+#include "pch.h"
+#include "wavefronttracer.h"
+#include "cputracer.h"
+#include "mymath.h"
+#include "simdkernels.h"
+#include <algorithm>
+
+namespace
+{
+	const int kNoShaders = 9; // Shader values fit into 1..8
+	const int kMaxBatchSize = 256; // longer runs of a material are split so that threads share the queue
+}
+
+void WavefrontTracer::set_scene( const SceneGeometry * geometry, const Bvh * bvh )
+{
+	geometry_ = geometry;
+	bvh_ = bvh;
+}
+
+void WavefrontTracer::set_two_level( const TwoLevelBvh * two_level_bvh )
+{
+	two_level_bvh_ = two_level_bvh;
+}
+
+void WavefrontTracer::set_lights( const LightList * lights )
+{
+	lights_ = lights;
+}
+
+int WavefrontTracer::Render( Camera & camera, BYTE * buffer, const int width, const int height, GBuffer * gbuffer, Color3f * colors )
+{
+	if ( geometry_ == nullptr || bvh_ == nullptr ) return S_OK;
+
+	colors_ = colors;
+	width_ = width;
+	height_ = height;
+	view_from_ = camera.view_from();
+	M_c_w_ = camera.M_c_w();
+	focal_length_ = camera.focalLength();
+	no_samples_ = min( max( no_ao_samples, 1 ), CpuTracer::kMaxAOSamples ); // the same bound as CpuTracer::no_samples
+	no_light_points_ = ( lights_ != nullptr && lights_->no_lights() > 0 ) ? min( max( no_light_samples, 1 ), kMaxLightSamples ) : 1;
+
+	no_tiles_x_ = ( width + kTileSize - 1 ) / kTileSize;
+	const int no_tiles_y = ( height + kTileSize - 1 ) / kTileSize;
+	const int no_tiles = no_tiles_x_ * no_tiles_y;
+
+	shade_queues_.resize( kNoShaders );
+	if ( gbuffer != nullptr ) gbuffer->resize( width, height );
+
+	for ( int first_tile = 0; first_tile < no_tiles; first_tile += kWavefrontSize )
+	{
+		const int last_tile = min( first_tile + kWavefrontSize, no_tiles );
+
+		GenerateRays( first_tile, last_tile );
+		Extend();
+		if ( gbuffer != nullptr ) WriteGBuffer( *gbuffer );
+		SortByShader();
+		GenerateOcclusionRays();
+		GenerateLightRays();
+		Occlude();
+
+		ShadeMiss( buffer );
+
+		if ( shader_sorting )
+		{
+			// the kernel itself falls back to Lambert for the remaining shaders
+			for ( const auto & queue : shade_queues_ )
+			{
+				ShadeBatches( queue, buffer );
+			}
+		}
+		else
+		{
+			ShadePhong( shade_queues_[int( Shader::PHONG )], buffer );
+			ShadeNormal( shade_queues_[int( Shader::NORMAL )], buffer );
+
+			// all remaining shaders fall back to Lambert the same way as CpuTracer::Shade does
+			for ( int shader = 0; shader < kNoShaders; ++shader )
+			{
+				if ( shader != int( Shader::PHONG ) && shader != int( Shader::NORMAL ) )
+				{
+					ShadeLambert( shade_queues_[shader], buffer );
+				}
+			}
+		}
+	}
+
+	return S_OK;
+}
+
+void WavefrontTracer::GenerateRays( const int first_tile, const int last_tile )
+{
+	const int no_tiles = last_tile - first_tile;
+	tile_offsets_.resize( no_tiles + 1 );
+	tile_offsets_[0] = 0;
+
+	for ( int t = 0; t < no_tiles; ++t )
+	{
+		const int tile = first_tile + t;
+		const int x0 = ( tile % no_tiles_x_ ) * kTileSize;
+		const int y0 = ( tile / no_tiles_x_ ) * kTileSize;
+		tile_offsets_[t + 1] = tile_offsets_[t] + ( min( x0 + kTileSize, width_ ) - x0 ) * ( min( y0 + kTileSize, height_ ) - y0 );
+	}
+
+	primary_rays_.resize( tile_offsets_[no_tiles] );
+
+#pragma omp parallel for schedule( static )
+	for ( int t = 0; t < no_tiles; ++t )
+	{
+		const int tile = first_tile + t;
+		const int x0 = ( tile % no_tiles_x_ ) * kTileSize;
+		const int y0 = ( tile / no_tiles_x_ ) * kTileSize;
+		const int x1 = min( x0 + kTileSize, width_ );
+		const int y1 = min( y0 + kTileSize, height_ );
+
+		for ( int y = y0, i = tile_offsets_[t]; y < y1; ++y )
+		{
+			for ( int x = x0; x < x1; ++x, ++i )
+			{
+				primary_rays_.set( i, view_from_, primary_direction( float( x ), float( y ) ), x + y * width_ );
+			}
+		}
+	}
+}
+
+void WavefrontTracer::Extend()
+{
+	if ( two_level_active() )
+	{
+		const int no_rays = primary_rays_.size();
+
+		// instances have no packet traversal
+#pragma omp parallel for schedule( dynamic, 64 )
+		for ( int i = 0; i < no_rays; ++i )
+		{
+			Ray ray = primary_rays_.ray( i );
+			RayHit hit;
+			two_level_bvh_->Intersect( ray, hit );
+			primary_rays_.set_hit( i, ray.t_far, hit );
+		}
+
+		return;
+	}
+
+	const int no_tiles = static_cast<int>( tile_offsets_.size() ) - 1;
+
+	// primary rays of a tile share the origin and are traced as a single packet
+#pragma omp parallel for schedule( dynamic )
+	for ( int t = 0; t < no_tiles; ++t )
+	{
+		const int first = tile_offsets_[t];
+		const int last = tile_offsets_[t + 1];
+		const int tile_width = primary_rays_.pixel[last - 1] % width_ - primary_rays_.pixel[first] % width_ + 1;
+
+		RayPacket packet;
+		packet.origin = view_from_;
+		packet.t_near = primary_rays_.t_near;
+
+		for ( int i = first; i < last; ++i )
+		{
+			packet.add( Vector3( primary_rays_.dir_x[i], primary_rays_.dir_y[i], primary_rays_.dir_z[i] ), primary_rays_.t_far[i] );
+		}
+
+		const int corners[4] = { first, first + tile_width - 1, last - 1, last - tile_width };
+		Vector3 directions[4];
+
+		for ( int c = 0; c < 4; ++c )
+		{
+			directions[c] = Vector3( primary_rays_.dir_x[corners[c]], primary_rays_.dir_y[corners[c]], primary_rays_.dir_z[corners[c]] );
+		}
+
+		packet.set_frustum( directions[0], directions[1], directions[2], directions[3] );
+		bvh_->IntersectPacket( packet );
+
+		for ( int i = first; i < last; ++i )
+		{
+			primary_rays_.set_hit( i, packet.t_far[i - first], packet.hit( i - first ) );
+		}
+	}
+}
+
+void WavefrontTracer::WriteGBuffer( GBuffer & gbuffer ) const
+{
+	const int no_rays = primary_rays_.size();
+
+#pragma omp parallel for schedule( static )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		const int triangle_id = primary_rays_.triangle_id[i];
+		const Vector3 normal = ( triangle_id >= 0 ) ? shading_normal( i ) : Vector3( 0.0f, 0.0f, 0.0f );
+		gbuffer.Write( primary_rays_.pixel[i], *geometry_, triangle_id, primary_rays_.u[i], primary_rays_.v[i], primary_rays_.t_far[i], normal );
+	}
+}
+
+void WavefrontTracer::SortByShader()
+{
+	for ( auto & queue : shade_queues_ )
+	{
+		queue.clear();
+	}
+
+	const int no_rays = primary_rays_.size();
+
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		const int triangle_id = primary_rays_.triangle_id[i];
+
+		if ( triangle_id >= 0 )
+		{
+			const int shader = int( geometry_->material( triangle_id )->shader() );
+			shade_queues_[( shader > 0 && shader < kNoShaders ) ? shader : int( Shader::LAMBERT )].push_back( i );
+		}
+	}
+
+	if ( !shader_sorting ) return;
+
+	for ( auto & queue : shade_queues_ )
+	{
+		std::stable_sort( queue.begin(), queue.end(), [this]( const int a, const int b )
+		{
+			return geometry_->material( primary_rays_.triangle_id[a] )->materialIndex < geometry_->material( primary_rays_.triangle_id[b] )->materialIndex;
+		} );
+	}
+}
+
+void WavefrontTracer::GenerateOcclusionRays()
+{
+	const int no_rays = primary_rays_.size();
+	occlusion_offsets_.resize( no_rays );
+
+	int no_occlusion_rays = 0;
+
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( primary_rays_.triangle_id[i] >= 0 )
+		{
+			occlusion_offsets_[i] = no_occlusion_rays;
+			no_occlusion_rays += no_samples_;
+		}
+		else
+		{
+			occlusion_offsets_[i] = -1;
+		}
+	}
+
+	occlusion_rays_.resize( no_occlusion_rays );
+	occlusion_weights_.resize( no_occlusion_rays );
+
+	// random numbers are keyed by pixels so the noise matches CpuTracer
+#pragma omp parallel for schedule( static )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( occlusion_offsets_[i] < 0 ) continue;
+
+		const Vector3 point = primary_rays_.ray( i ).point( primary_rays_.t_far[i] );
+		const Vector3 normal = shading_normal( i );
+		const int pixel = primary_rays_.pixel[i];
+		PixelSampler ao_sampler = pixel_sampler( sampler, pixel % width_, pixel / width_, width_, sample_index, no_samples_ );
+
+		for ( int j = 0, k = occlusion_offsets_[i]; j < no_samples_; ++j, ++k )
+		{
+			float weight;
+			const Vector3 omega_i = SampleAmbientOcclusion( normal, ao_sampler, cosine_sampling, weight );
+
+			occlusion_rays_.set( k, point, omega_i, i, ao_radius );
+			occlusion_weights_[k] = weight;
+		}
+	}
+}
+
+void WavefrontTracer::GenerateLightRays()
+{
+	const int no_rays = primary_rays_.size();
+	light_offsets_.resize( no_rays );
+
+	int no_light_rays = 0;
+
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		light_offsets_[i] = ( primary_rays_.triangle_id[i] >= 0 ) ? no_light_rays : -1;
+		if ( light_offsets_[i] >= 0 ) no_light_rays += no_light_points_;
+	}
+
+	light_rays_.resize( no_light_rays );
+	light_radiance_.resize( no_light_rays );
+
+	// the same light points as CpuTracer::Shade draws for the pixel
+#pragma omp parallel for schedule( static )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( light_offsets_[i] < 0 ) continue;
+
+		const Vector3 point = primary_rays_.ray( i ).point( primary_rays_.t_far[i] );
+		const Vector3 normal = shading_normal( i );
+		RandomStream rng( primary_rays_.pixel[i], sample_index, kLightDimension );
+
+		for ( int j = 0, k = light_offsets_[i]; j < no_light_points_; ++j, ++k )
+		{
+			const LightSample light = ( lights_ != nullptr ) ? lights_->Sample( point, normal, rng, light_sampling ) : LightList::DefaultLight( point );
+			const bool visible = light.direction.DotProduct( normal ) > 0.0f && !light.radiance.is_zero();
+
+			light_rays_.set( k, point, light.direction, i, ( visible && light.distance > 0.0f ) ? light.distance - 0.01f : 0.0f );
+			light_radiance_[k] = ( visible ) ? light.radiance : Color3f( 0.0f, 0.0f, 0.0f );
+		}
+	}
+}
+
+void WavefrontTracer::OccludeRays( RayStream & rays, const std::vector<int> & offsets, const int no_rays_per_hit ) const
+{
+	const int no_rays = primary_rays_.size();
+
+	// fewer rays than the packet traversal keeps together and rays through instances are traced one by one
+	if ( no_rays_per_hit < Bvh::kMinActiveRays || two_level_active() )
+	{
+		const int no_stream_rays = rays.size();
+		const bool two_level_rays = two_level_active();
+
+#pragma omp parallel for schedule( dynamic, 256 )
+		for ( int k = 0; k < no_stream_rays; ++k )
+		{
+			const bool occluded = rays.t_far[k] > 0.0f &&
+				( ( two_level_rays ) ? two_level_bvh_->Occluded( rays.ray( k ) ) : bvh_->Occluded( rays.ray( k ) ) );
+			rays.triangle_id[k] = ( occluded ) ? 0 : -1;
+		}
+
+		return;
+	}
+
+	// rays of a hit share its point as the origin, they are traced as packets without a frustum as they span the hemisphere
+#pragma omp parallel for schedule( dynamic, 16 )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( offsets[i] < 0 ) continue;
+
+		for ( int first = offsets[i]; first < offsets[i] + no_rays_per_hit; first += RayPacket::kSize )
+		{
+			const int last = min( first + RayPacket::kSize, offsets[i] + no_rays_per_hit );
+
+			RayPacket packet;
+			packet.origin = Vector3( rays.origin_x[first], rays.origin_y[first], rays.origin_z[first] );
+			packet.t_near = rays.t_near;
+
+			for ( int k = first; k < last; ++k )
+			{
+				packet.add( Vector3( rays.dir_x[k], rays.dir_y[k], rays.dir_z[k] ), rays.t_far[k] );
+			}
+
+			bvh_->OccludedPacket( packet );
+
+			for ( int k = first; k < last; ++k )
+			{
+				rays.triangle_id[k] = ( packet.triangle_id[k - first] >= 0 ) ? 0 : -1;
+			}
+		}
+	}
+}
+
+void WavefrontTracer::Occlude()
+{
+	// the hit itself is just flagged, rays of the default point light and of lights behind the surface have zero t_far and are never occluded
+	OccludeRays( occlusion_rays_, occlusion_offsets_, no_samples_ );
+	OccludeRays( light_rays_, light_offsets_, no_light_points_ );
+
+	const int no_light_rays = light_rays_.size();
+
+#pragma omp parallel for schedule( static )
+	for ( int k = 0; k < no_light_rays; ++k )
+	{
+		if ( light_rays_.triangle_id[k] >= 0 ) light_radiance_[k] = Color3f( 0.0f, 0.0f, 0.0f );
+	}
+
+	const int no_rays = primary_rays_.size();
+	ambient_occlusion_.resize( no_rays );
+
+#pragma omp parallel for schedule( static )
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		if ( occlusion_offsets_[i] < 0 ) continue;
+
+		const Color3f diffuse = geometry_->material( primary_rays_.triangle_id[i] )->diffuse();
+		Color3f sum;
+
+		for ( int k = occlusion_offsets_[i]; k < occlusion_offsets_[i] + no_samples_; ++k )
+		{
+			const float shade = ( occlusion_rays_.triangle_id[k] < 0 ) ? 1.0f : 0.0f;
+			sum = sum + diffuse * ( shade * occlusion_weights_[k] );
+		}
+
+		ambient_occlusion_[i] = sum * ( 1.0f / no_samples_ );
+	}
+}
+
+void WavefrontTracer::ShadePhong( const std::vector<int> & queue, BYTE * buffer ) const
+{
+	const int no_rays = static_cast<int>( queue.size() );
+
+#pragma omp parallel for schedule( static )
+	for ( int k = 0; k < no_rays; ++k )
+	{
+		const int i = queue[k];
+		const int triangle_id = primary_rays_.triangle_id[i];
+		const Material * material = geometry_->material( triangle_id );
+
+		const Vector3 direction( primary_rays_.dir_x[i], primary_rays_.dir_y[i], primary_rays_.dir_z[i] );
+		const Vector3 normal = shading_normal( i );
+		const Coord2f texcoord = geometry_->texcoord( triangle_id, primary_rays_.u[i], primary_rays_.v[i] );
+		const Coord2f flipped_texcoord{ texcoord.u, 1.0f - texcoord.v };
+		const Color3f diffuse = material->diffuse( &flipped_texcoord );
+
+		Color3f direct;
+
+		for ( int l = light_offsets_[i]; l < light_offsets_[i] + no_light_points_; ++l )
+		{
+			if ( light_radiance_[l].is_zero() ) continue;
+
+			const Vector3 to_light( light_rays_.dir_x[l], light_rays_.dir_y[l], light_rays_.dir_z[l] );
+			const float cos_theta = to_light.DotProduct( normal );
+			const Vector3 lr = ( 2.0f * cos_theta ) * normal - to_light;
+			direct = direct + ( diffuse * cos_theta + material->specular() * powf( max( 0.0f, ( -direction ).DotProduct( lr ) ),
+				material->shininess ) ) * light_radiance_[l];
+		}
+
+		direct = direct * ( light_scale / no_light_points_ );
+
+		set_pixel( buffer, primary_rays_.pixel[i], ( material->ambient() + direct ) * ambient_occlusion_[i] + material->emission() * light_scale );
+	}
+}
+
+void WavefrontTracer::ShadeNormal( const std::vector<int> & queue, BYTE * buffer ) const
+{
+	const int no_rays = static_cast<int>( queue.size() );
+
+#pragma omp parallel for schedule( static )
+	for ( int k = 0; k < no_rays; ++k )
+	{
+		const int i = queue[k];
+		const Vector3 normal = shading_normal( i );
+		const Color3f emitted = geometry_->material( primary_rays_.triangle_id[i] )->emission() * light_scale;
+
+		set_pixel( buffer, primary_rays_.pixel[i], Color3f( normal.x, normal.y, normal.z ) * ambient_occlusion_[i] * 0.5f + emitted );
+	}
+}
+
+void WavefrontTracer::ShadeLambert( const std::vector<int> & queue, BYTE * buffer ) const
+{
+	const int no_rays = static_cast<int>( queue.size() );
+
+#pragma omp parallel for schedule( static )
+	for ( int k = 0; k < no_rays; ++k )
+	{
+		const int i = queue[k];
+		const int triangle_id = primary_rays_.triangle_id[i];
+
+		const Material * material = geometry_->material( triangle_id );
+
+		const Vector3 normal = shading_normal( i );
+		const Coord2f texcoord = geometry_->texcoord( triangle_id, primary_rays_.u[i], primary_rays_.v[i] );
+		const Coord2f flipped_texcoord{ texcoord.u, 1.0f - texcoord.v };
+		const Color3f diffuse = material->diffuse( &flipped_texcoord );
+
+		Color3f direct;
+
+		for ( int l = light_offsets_[i]; l < light_offsets_[i] + no_light_points_; ++l )
+		{
+			if ( light_radiance_[l].is_zero() ) continue;
+
+			const Vector3 to_light( light_rays_.dir_x[l], light_rays_.dir_y[l], light_rays_.dir_z[l] );
+			direct = direct + diffuse * to_light.DotProduct( normal ) * light_radiance_[l];
+		}
+
+		direct = direct * ( light_scale / no_light_points_ );
+
+		set_pixel( buffer, primary_rays_.pixel[i], direct * ambient_occlusion_[i] + material->emission() * light_scale );
+	}
+}
+
+void WavefrontTracer::ShadeBatches( const std::vector<int> & queue, BYTE * buffer )
+{
+	const int no_hits = static_cast<int>( queue.size() );
+	if ( no_hits == 0 ) return;
+
+	shading_buffer_.resize( no_hits, no_light_points_ );
+	shaded_colors_.resize( no_hits );
+
+#pragma omp parallel for schedule( static )
+	for ( int k = 0; k < no_hits; ++k )
+	{
+		const int i = queue[k];
+		const int triangle_id = primary_rays_.triangle_id[i];
+		const Material * material = geometry_->material( triangle_id );
+		const Vector3 direction( primary_rays_.dir_x[i], primary_rays_.dir_y[i], primary_rays_.dir_z[i] );
+		const Vector3 normal = shading_normal( i );
+
+		if ( material->shader() == Shader::NORMAL )
+		{
+			shading_buffer_.set_hit( k, normal, direction, Color3f(), ambient_occlusion_[i] );
+			continue;
+		}
+
+		const Coord2f texcoord = geometry_->texcoord( triangle_id, primary_rays_.u[i], primary_rays_.v[i] );
+		const Coord2f flipped_texcoord{ texcoord.u, 1.0f - texcoord.v };
+		shading_buffer_.set_hit( k, normal, direction, material->diffuse( &flipped_texcoord ), ambient_occlusion_[i] );
+
+		for ( int j = 0, l = light_offsets_[i]; j < no_light_points_; ++j, ++l )
+		{
+			shading_buffer_.set_light( k, j, Vector3( light_rays_.dir_x[l], light_rays_.dir_y[l], light_rays_.dir_z[l] ), light_radiance_[l] );
+		}
+	}
+
+	// runs of a material split into batches of at most kMaxBatchSize hits
+	batch_offsets_.clear();
+
+	for ( int k = 0; k < no_hits; ++k )
+	{
+		if ( k == 0 || k - batch_offsets_.back() == kMaxBatchSize ||
+			geometry_->material( primary_rays_.triangle_id[queue[k]] ) != geometry_->material( primary_rays_.triangle_id[queue[k - 1]] ) )
+		{
+			batch_offsets_.push_back( k );
+		}
+	}
+
+	batch_offsets_.push_back( no_hits );
+
+	const SimdKernels & kernels = simd_kernels();
+	const int no_batches = static_cast<int>( batch_offsets_.size() ) - 1;
+
+#pragma omp parallel for schedule( dynamic )
+	for ( int b = 0; b < no_batches; ++b )
+	{
+		const int first = batch_offsets_[b];
+		const Material * material = geometry_->material( primary_rays_.triangle_id[queue[first]] );
+
+		kernels.shade_batch( shading_buffer_.batch( first, batch_offsets_[b + 1], *material, light_scale ),
+			reinterpret_cast<float *>( &shaded_colors_[first] ) );
+	}
+
+#pragma omp parallel for schedule( static )
+	for ( int k = 0; k < no_hits; ++k )
+	{
+		set_pixel( buffer, primary_rays_.pixel[queue[k]], shaded_colors_[k] );
+	}
+}
+
+void WavefrontTracer::ShadeMiss( BYTE * buffer ) const
+{
+	const int no_rays = primary_rays_.size();
+
+	for ( int i = 0; i < no_rays; ++i )
+	{
+		// miss_program returns black
+		if ( primary_rays_.triangle_id[i] < 0 ) set_pixel( buffer, primary_rays_.pixel[i], Color3f( 0.0f, 0.0f, 0.0f ) );
+	}
+}
+
+Vector3 WavefrontTracer::primary_direction( const float x, const float y ) const
+{
+	const Vector3 d_c( x - width_ * 0.5f, height_ * 0.5f - y, -focal_length_ );
+	Vector3 d_w = M_c_w_ * d_c;
+	d_w.Normalize();
+
+	return d_w;
+}
+
+Vector3 WavefrontTracer::shading_normal( const int i ) const
+{
+	// attribute_program
+	Vector3 normal = geometry_->normal( primary_rays_.triangle_id[i], primary_rays_.u[i], primary_rays_.v[i] );
+
+	if ( Vector3( primary_rays_.dir_x[i], primary_rays_.dir_y[i], primary_rays_.dir_z[i] ).DotProduct( normal ) > 0.0f )
+	{
+		normal *= -1.0f;
+	}
+
+	return normal;
+}
+
+void WavefrontTracer::set_pixel( BYTE * buffer, const int pixel, const Color3f & color ) const
+{
+	simd_kernels().convert_colors( &color.r, 1, &buffer[pixel * 4] );
+	if ( colors_ != nullptr ) colors_[pixel] = color;
+}
+
+bool WavefrontTracer::two_level_active() const
+{
+	return two_level && two_level_bvh_ != nullptr;
+}
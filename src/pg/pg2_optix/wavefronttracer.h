@@ -0,0 +1,125 @@
+#ifndef WAVEFRONT_TRACER_H_
+#define WAVEFRONT_TRACER_H_
+
+#include "bvh.h"
+#include "twolevelbvh.h"
+#include "camera.h"
+#include "sampler.h"
+#include "gbuffer.h"
+#include "lights.h"
+#include "shadingbatch.h"
+
+/*! \class WavefrontTracer
+\brief Stream counterpart of CpuTracer, renders the same image by a sequence of kernels.
+
+Instead of shading each hit recursively, the frame is processed in wavefronts of tiles and
+every stage runs over the whole wavefront at once: ray generation fills the primary queue,
+extend finds closest hits, hits are binned into queues per Shader, ambient occlusion rays of
+all hits are gathered into the occlusion queue and shadow rays towards sampled light points
+into the light queue, both queues are traced together and finally each shader
+kernel resolves its queue. Queues are SoA RayStreams so that kernels are plain loops over
+arrays which run in parallel across cores.
+*/
+class WavefrontTracer
+{
+public:
+	static const int kTileSize = 8; /*!< The same as CpuTracer::kBlockSize, each tile is traced as a primary packet. */
+	static const int kWavefrontSize = 256; /*!< Number of tiles processed by a single wavefront. */
+
+	void set_scene( const SceneGeometry * geometry, const Bvh * bvh );
+
+	/* the same as CpuTracer::set_two_level */
+	void set_two_level( const TwoLevelBvh * two_level_bvh );
+
+	/* the same as CpuTracer::set_lights */
+	void set_lights( const LightList * lights );
+
+	/* renders the whole frame into the RGBA buffer of the given size, the requested outputs of primary hits go to the optional G-buffer,
+	the optional colors receive the linear color of each pixel as CpuTracer::Render */
+	int Render( Camera & camera, BYTE * buffer, const int width, const int height, GBuffer * gbuffer = nullptr, Color3f * colors = nullptr );
+
+	float ao_radius{ FLT_MAX }; /*!< Maximal distance of occluders, the same as CpuTracer::ao_radius. */
+	unsigned int sample_index{ 0 }; /*!< Index of the frame sample, the same as CpuTracer::sample_index. */
+	int no_ao_samples{ 32 }; /*!< The same as CpuTracer::no_ao_samples. */
+	SamplerType sampler{ SamplerType::SOBOL }; /*!< The same as CpuTracer::sampler. */
+	bool cosine_sampling{ true }; /*!< The same as CpuTracer::cosine_sampling. */
+	int no_light_samples{ 1 }; /*!< The same as CpuTracer::no_light_samples. */
+	float light_scale{ 1.0f }; /*!< The same as CpuTracer::light_scale. */
+	LightSampling light_sampling{ LightSampling::TREE }; /*!< The same as CpuTracer::light_sampling. */
+	bool shader_sorting{ false }; /*!< Sort shader queues by material and resolve them by SimdKernels::shade_batch, see CpuTracer::shader_sorting. */
+	bool two_level{ false }; /*!< The same as CpuTracer::two_level, extend and occlusion trace rays one by one through the instances. */
+
+private:
+	/* raygen: primary rays of all tiles of the wavefront, rays of each tile are stored in the scanline order */
+	void GenerateRays( const int first_tile, const int last_tile );
+
+	/* extend: closest hits of all primary rays, each tile is traced as a packet */
+	void Extend();
+
+	/* requested outputs of all primary rays, the same as CpuTracer writes */
+	void WriteGBuffer( GBuffer & gbuffer ) const;
+
+	/* bins hit rays into queues by their shader, with shader_sorting each queue is ordered by material */
+	void SortByShader();
+
+	/* spawns ambient occlusion rays of all hits into the occlusion queue */
+	void GenerateOcclusionRays();
+
+	/* spawns shadow rays towards light points sampled for all hits into the light queue */
+	void GenerateLightRays();
+
+	/* any hit queries of the occlusion and light queues, AO results are reduced per primary ray */
+	void Occlude();
+
+	/* flags occluded rays of the stream by a non-negative triangle_id, rays of each hit are traced together as packets by Bvh::OccludedPacket */
+	void OccludeRays( RayStream & rays, const std::vector<int> & offsets, const int no_rays_per_hit ) const;
+
+	void ShadePhong( const std::vector<int> & queue, BYTE * buffer ) const;
+	void ShadeNormal( const std::vector<int> & queue, BYTE * buffer ) const;
+	void ShadeLambert( const std::vector<int> & queue, BYTE * buffer ) const;
+
+	/* the queue sorted by material gathered into SoA arrays and shaded in batches of a single material */
+	void ShadeBatches( const std::vector<int> & queue, BYTE * buffer );
+
+	/* writes black pixels of rays which missed the scene */
+	void ShadeMiss( BYTE * buffer ) const;
+
+	Vector3 primary_direction( const float x, const float y ) const;
+	Vector3 shading_normal( const int i ) const;
+	bool two_level_active() const;
+	void set_pixel( BYTE * buffer, const int pixel, const Color3f & color ) const;
+
+	const SceneGeometry * geometry_{ nullptr };
+	const Bvh * bvh_{ nullptr };
+	const TwoLevelBvh * two_level_bvh_{ nullptr };
+	const LightList * lights_{ nullptr };
+
+	Color3f * colors_{ nullptr }; // linear colors of the frame being rendered, see Render
+
+	// camera snapshot of the frame being rendered
+	int width_{ 0 };
+	int height_{ 0 };
+	int no_tiles_x_{ 0 };
+	Vector3 view_from_;
+	Matrix3x3 M_c_w_;
+	float focal_length_{ 1.0f };
+
+	// queues of the current wavefront
+	RayStream primary_rays_;
+	std::vector<int> tile_offsets_; // the first primary ray of each tile
+	std::vector<std::vector<int>> shade_queues_; // indices of primary rays per Shader
+	RayStream occlusion_rays_;
+	std::vector<float> occlusion_weights_; // cosine over pdf of each occlusion ray
+	std::vector<int> occlusion_offsets_; // the first occlusion ray of each primary ray, -1 for misses
+	std::vector<Color3f> ambient_occlusion_; // per primary ray
+	int no_samples_{ 0 }; // AO rays per hit of the current frame
+	RayStream light_rays_; // rays of the default point light and of lights behind the surface are not traced, their t_far is zero
+	std::vector<Color3f> light_radiance_; // LightSample::radiance of each light ray, zero once the ray is occluded
+	std::vector<int> light_offsets_; // the first light ray of each primary ray, -1 for misses
+	int no_light_points_{ 1 }; // light rays per hit of the current frame
+	ShadingBuffer shading_buffer_; // hits of the shaded queue
+	std::vector<int> batch_offsets_; // the first hit of each batch of the shaded queue and the end of the queue
+	std::vector<Color3f> shaded_colors_; // per hit of the shaded queue
+};
+
+#endif